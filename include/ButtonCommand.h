@@ -16,34 +16,102 @@ limitations under the License.
 
 #pragma once
 
+#include "command_arena.h"
+
 #include <Arduino.h>
 
 #define RF_CODE_LENGTH 3
+// Tsyn, Tlow and Thigh, in that order.
+#define RF_TIMING_COUNT 3
+// The longest command which can be sent to the Assistant, including the terminating NUL.
+#define MAX_COMMAND_LENGTH 200
+// Size of the buffer needed for RfCode::to_hex, including the terminating NUL.
+#define RF_CODE_HEX_SIZE ((RF_TIMING_COUNT * 2 + RF_CODE_LENGTH) * 2 + 1)
 
 struct RfCode {
+  // Pulse timings in microseconds, as reported by the RF module. All zero if unknown.
+  uint16_t timings[RF_TIMING_COUNT];
   uint8_t bytes[RF_CODE_LENGTH];
 
   RfCode() {
+    memset(timings, 0, sizeof(timings));
     memset(bytes, 0, RF_CODE_LENGTH);
   }
 
   RfCode(const RfCode &other) {
+    memcpy(timings, other.timings, sizeof(timings));
     copy_from(other.bytes);
   }
 
-  bool operator==(const RfCode &other) {
+  // Compares only the data bytes, not the timings.
+  bool operator==(const RfCode &other) const {
     return memcmp(bytes, other.bytes, RF_CODE_LENGTH) == 0;
   }
 
-  static RfCode from_hex(const String &hex_string);
+  // The data bytes packed into an integer, for sorting and searching.
+  uint32_t key() const {
+    return ((uint32_t) bytes[0] << 16) | ((uint32_t) bytes[1] << 8) | bytes[2];
+  }
+
+  static RfCode from_hex(const char *hex_string);
+  static RfCode from_message(const uint8_t *buffer);
   void copy_from(const uint8_t *buffer);
-  String to_hex() const;
+  void to_message(uint8_t *buffer) const;
+  uint8_t timing_error(const RfCode &received) const;
+  const char *to_hex(char buffer[RF_CODE_HEX_SIZE]) const;
+};
+
+// Where to send a command when its code is received.
+enum ActionType {
+  // Send the command as a query to the Google Assistant.
+  ACTION_ASSISTANT,
+  // POST the command to a local HTTP server.
+  ACTION_HTTP,
+  // Send the command as a UDP datagram.
+  ACTION_UDP,
+  // Send the command as a text message to a local websocket server.
+  ACTION_WEBSOCKET,
+  // Transmit another RF code through the RF module.
+  ACTION_RF,
+  ACTION_TYPE_COUNT,
+};
+
+// How often a command's code has been received, how well it matched, and how sending the command went.
+struct CommandStats {
+  uint32_t matches;
+  // Codes with the right data bytes but timings outside the tolerance.
+  uint32_t timing_rejects;
+  // Sum of timing errors of all matches, in percent.
+  uint32_t timing_error_sum;
+  uint8_t max_timing_error;
+  uint32_t successes;
+  uint32_t failures;
+  // When the code was last matched, in seconds since the epoch.
+  time_t last_seen;
+  // Time from receiving the code from the RF module to a successful response, in milliseconds.
+  uint32_t latency_sum;
+  uint32_t max_latency;
+
+  CommandStats(): matches(0), timing_rejects(0), timing_error_sum(0), max_timing_error(0), successes(0), failures(0),
+    last_seen(0), latency_sum(0), max_latency(0) {}
 };
 
 struct ButtonCommand {
   RfCode code;
-  String command;
+  ActionType action;
+  // Offset of the command's text in the command arena.
+  uint16_t command_offset;
+  // Offset in the command arena of the host, port and path to send the command to, for local actions.
+  uint16_t target_offset;
+  CommandStats stats;
+
+  ButtonCommand(): action(ACTION_ASSISTANT), command_offset(NO_TEXT), target_offset(NO_TEXT) {}
 
-  ButtonCommand() {}
-  ButtonCommand(RfCode &code, const String &command): code(code), command(command) {}
+  const char *command() const {
+    return arena_text(command_offset);
+  }
+
+  const char *target() const {
+    return arena_text(target_offset);
+  }
 };
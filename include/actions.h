@@ -0,0 +1,37 @@
+/*
+Copyright 2018 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ */
+
+#pragma once
+
+#include "ButtonCommand.h"
+
+#include <Arduino.h>
+
+// Totals for all commands sent with each type of action.
+struct ActionStats {
+  uint32_t successes;
+  uint32_t failures;
+  // Time from receiving the code from the RF module to the action completing, in milliseconds.
+  uint32_t latency_sum;
+  uint32_t max_latency;
+};
+
+extern const char *const action_names[ACTION_TYPE_COUNT];
+extern ActionStats action_stats[ACTION_TYPE_COUNT];
+
+bool run_action(const ButtonCommand &button_command);
+void record_action_result(ActionType action, bool success, uint32_t latency);
+void actions_loop();
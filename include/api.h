@@ -0,0 +1,80 @@
+/*
+Copyright 2018 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ */
+
+#pragma once
+
+#include "chunked_writer.h"
+#include "jobs.h"
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <ESP8266WebServer.h>
+#include <functional>
+
+#define API_PREFIX "/api/v1"
+// Room for one object in a request body, such as one element of a bulk request, parsed in place.
+#define API_JSON_BUFFER_SIZE JSON_OBJECT_SIZE(8)
+// Longest request body object, or element of a bulk request, which can be parsed.
+#define API_MAX_JSON_SIZE 512
+
+// Streams a JSON response through a fixed buffer.
+class JsonWriter : public ChunkedWriter {
+public:
+  explicit JsonWriter(ESP8266WebServer &server): ChunkedWriter(server), need_comma(false) {}
+
+  void begin(int code = 200) {
+    ChunkedWriter::begin(code, "application/json");
+  }
+
+  JsonWriter &begin_object();
+  JsonWriter &end_object();
+  JsonWriter &begin_array();
+  JsonWriter &end_array();
+  JsonWriter &key(const char *name);
+  JsonWriter &value(const char *string);
+  JsonWriter &value(const String &string) {
+    return value(string.c_str());
+  }
+  JsonWriter &value(bool boolean);
+  JsonWriter &value(int number) {
+    return value((long) number);
+  }
+  JsonWriter &value(unsigned int number) {
+    return value((unsigned long) number);
+  }
+  JsonWriter &value(long number);
+  JsonWriter &value(unsigned long number);
+  JsonWriter &null_value();
+
+  template <typename T>
+  JsonWriter &field(const char *name, T field_value) {
+    key(name);
+    return value(field_value);
+  }
+
+private:
+  void separate();
+
+  bool need_comma;
+};
+
+// Applies one element of a bulk request, returning nullptr on success or else an error message.
+typedef std::function<const char *(JsonVariant element)> BulkOperation;
+
+void api_error(int code, const char *message);
+void api_submit_job(const char *name, const JobStep &step);
+JsonObject *api_parse_object(JsonBuffer &json_buffer);
+void api_bulk(const BulkOperation &operation);
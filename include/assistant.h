@@ -21,5 +21,5 @@ limitations under the License.
 extern const char *client_id;
 
 bool assistant_init();
-void auth_and_send_request(const String &command);
+bool auth_and_send_request(const char *command);
 bool oauth_with_code(const String &code);
@@ -0,0 +1,46 @@
+/*
+Copyright 2018 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include <ESP8266WebServer.h>
+
+#define CHUNK_BUFFER_SIZE 512
+
+// Sends a response of unknown length through one fixed buffer, in chunks, rather than building it up in Strings.
+class ChunkedWriter {
+public:
+  explicit ChunkedWriter(ESP8266WebServer &server): server(server), used(0) {}
+
+  void begin(int code, const char *content_type);
+  void end();
+
+protected:
+  void write(const char *data, size_t length);
+  void write(const char *string) {
+    write(string, strlen(string));
+  }
+  void write(char c) {
+    write(&c, 1);
+  }
+  void flush();
+
+private:
+  ESP8266WebServer &server;
+  char buffer[CHUNK_BUFFER_SIZE];
+  size_t used;
+};
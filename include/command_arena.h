@@ -0,0 +1,28 @@
+/*
+Copyright 2018 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+
+// Offset used for a command with no text.
+#define NO_TEXT 0xffff
+
+const char *arena_text(uint16_t offset);
+bool arena_store(const char *text, uint16_t *offset);
+void arena_clear();
+void compact_arena();
+size_t arena_used();
@@ -0,0 +1,33 @@
+/*
+Copyright 2018 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ */
+
+#pragma once
+
+#include "ButtonCommand.h"
+
+#include <Arduino.h>
+
+bool load_commands();
+bool compact_commands();
+bool save_command_stats();
+bool load_command_stats();
+void save_command_stats_periodically();
+
+// Each of these changes button_commands and appends a record of the change to the command log.
+bool add_command(const RfCode &code, const char *command, ActionType action, const char *target);
+bool update_command(size_t i, const char *command);
+bool set_command_action(size_t i, ActionType action, const char *target);
+bool remove_command(size_t i);
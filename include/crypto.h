@@ -0,0 +1,24 @@
+/*
+Copyright 2018 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+
+#define HMAC_SHA256_SIZE 32
+
+void hmac_sha256(const void *key, size_t key_length, const void *data, size_t length, uint8_t out[HMAC_SHA256_SIZE]);
+bool constant_time_equal(const void *a, const void *b, size_t length);
@@ -0,0 +1,44 @@
+/*
+Copyright 2018 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include <ESP8266WebServer.h>
+
+// Number of clients which can be subscribed to /events at once.
+#define MAX_EVENT_CLIENTS 2
+// Longest event which can be published, including its type and framing.
+#define MAX_EVENT_SIZE 256
+// How often to send a comment to subscribed clients, so that dead connections are noticed.
+#define EVENT_KEEPALIVE_INTERVAL 15000 // 15 seconds
+
+struct EventStats {
+  uint32_t published;
+  // Events which were too long to send.
+  uint32_t oversized;
+  // Clients which were disconnected because they weren't reading events fast enough.
+  uint32_t clients_dropped;
+  // Clients which couldn't subscribe because there were already too many.
+  uint32_t clients_rejected;
+};
+
+extern EventStats event_stats;
+
+bool have_event_clients();
+void publish_event(const char *type, const char *format, ...) __attribute__((format(printf, 2, 3)));
+void events_setup(ESP8266WebServer &server);
+void events_loop();
@@ -0,0 +1,79 @@
+/*
+Copyright 2018 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ */
+
+#pragma once
+
+#include "chunked_writer.h"
+
+#include <Arduino.h>
+#include <ESP8266WebServer.h>
+
+// A fragment of HTML to be inserted into a template as it is, without escaping.
+struct RawHtml {
+  const char *html;
+};
+
+// Streams an HTML page through a fixed buffer, filling in templates without allocating.
+//
+// Each "{}" in a template is replaced by the next argument, with strings escaped and numbers formatted in decimal, so
+//   html.render("<td>{}</td><td>{}</td>", switch_names[i], switch_brightness[i]);
+// writes a table cell with the name and another with the brightness.
+class HtmlWriter : public ChunkedWriter {
+public:
+  explicit HtmlWriter(ESP8266WebServer &server): ChunkedWriter(server) {}
+
+  void begin() {
+    ChunkedWriter::begin(200, "text/html");
+  }
+
+  HtmlWriter &render(const char *html) {
+    write(html);
+    return *this;
+  }
+
+  template <typename T, typename... Rest>
+  HtmlWriter &render(const char *html, const T &first, const Rest &... rest) {
+    const char *hole = strstr(html, "{}");
+    if (hole == nullptr) {
+      write(html);
+      return *this;
+    }
+    write(html, hole - html);
+    put(first);
+    return render(hole + 2, rest...);
+  }
+
+private:
+  void put(const char *text);
+  void put(const String &text) {
+    put(text.c_str());
+  }
+  void put(RawHtml raw) {
+    write(raw.html);
+  }
+  void put(char c) {
+    char text[] = {c, '\0'};
+    put(text);
+  }
+  void put(int number) {
+    put((long) number);
+  }
+  void put(unsigned int number) {
+    put((unsigned long) number);
+  }
+  void put(long number);
+  void put(unsigned long number);
+};
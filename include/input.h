@@ -0,0 +1,63 @@
+/*
+Copyright 2018 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ */
+
+#pragma once
+
+#include "config.h"
+
+#include <Arduino.h>
+
+static constexpr uint8_t input_pins_for_count[] = INPUT_PINS;
+#define NUM_INPUTS sizeof(input_pins_for_count)
+
+enum InputActionType {
+  INPUT_NONE,
+  // Toggle the target switch.
+  INPUT_TOGGLE,
+  // Turn the target switch on and step its brightness down, wrapping around to full brightness.
+  INPUT_DIM,
+  // Apply the target scene.
+  INPUT_SCENE,
+  INPUT_ACTION_COUNT,
+};
+
+enum InputPress {
+  SHORT_PRESS,
+  LONG_PRESS,
+  INPUT_PRESS_COUNT,
+};
+
+struct InputAction {
+  uint8_t type;
+  // Index of the switch or scene.
+  uint8_t target;
+};
+
+struct InputStats {
+  uint32_t presses[INPUT_PRESS_COUNT];
+  // Edges which were dropped because the queue from the interrupt handler was full.
+  uint32_t overflows;
+};
+
+extern const uint8_t input_pins[];
+extern const size_t num_inputs;
+extern const char *const input_action_names[];
+extern InputAction input_actions[][INPUT_PRESS_COUNT];
+extern InputStats input_stats;
+
+bool save_input_actions();
+void input_setup();
+void input_loop();
@@ -0,0 +1,70 @@
+/*
+Copyright 2018 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ */
+
+#pragma once
+
+#include "metrics.h"
+
+#include <Arduino.h>
+#include <functional>
+
+// Number of background jobs remembered at once, including finished ones so their status can be checked.
+#define MAX_JOBS 4
+// Number of buckets in the loop duration histogram, not counting the overflow bucket.
+#define NUM_LOOP_BUCKETS 8
+
+enum JobState : uint8_t {
+  JOB_QUEUED,
+  JOB_RUNNING,
+  JOB_SUCCEEDED,
+  JOB_FAILED,
+};
+
+// Does the next step of a job, returning JOB_RUNNING if it needs to be called again on a later loop.
+typedef std::function<JobState()> JobStep;
+
+// Work which is too slow to do while answering an HTTP request.
+struct Job {
+  // 0 if the slot is unused.
+  uint32_t id;
+  const char *name;
+  JobState state;
+  unsigned long submitted_millis;
+  // Time spent running steps of the job.
+  uint32_t run_micros;
+  JobStep step;
+};
+
+struct JobStats {
+  uint32_t submitted;
+  // Jobs which couldn't be submitted because every slot held an unfinished job.
+  uint32_t rejected;
+  uint32_t succeeded;
+  uint32_t failed;
+  // Longest single step of any job, which is the longest a job has held up the loop.
+  uint32_t max_step_micros;
+};
+
+extern Job jobs[MAX_JOBS];
+extern JobStats job_stats;
+// Time between successive calls to jobs_loop, which is the length of one iteration of the main loop, in microseconds.
+extern StaticHistogram<NUM_LOOP_BUCKETS> loop_durations;
+extern uint32_t max_loop_micros;
+
+const char *job_state_name(JobState state);
+uint32_t submit_job(const char *name, const JobStep &step);
+const Job *find_job(uint32_t id);
+void jobs_loop();
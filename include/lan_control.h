@@ -0,0 +1,34 @@
+/*
+Copyright 2018 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+
+// Counts of LAN control requests.
+struct LanStats {
+  uint32_t requests;
+  // Requests which were too short, had the wrong magic or version, or had the wrong authentication code.
+  uint32_t invalid;
+  // Requests which were replayed or too far from the current time.
+  uint32_t stale;
+};
+
+extern String lan_key;
+extern LanStats lan_stats;
+
+void lan_control_setup();
+void lan_control_loop();
@@ -29,6 +29,13 @@ WiFiClient get_log_client();
 #define LOG(x) get_log_client().print(x)
 #define LOGH(x) get_log_client().print(x, HEX)
 #define LOGLN(x) get_log_client().println(x)
+#elif EVENT_LOGGING && !ENV_MINIUPDATE
+// Publishes each logged line as a "log" event.
+extern Print &event_log;
+
+#define LOG(x) event_log.print(x)
+#define LOGH(x) event_log.print(x, HEX)
+#define LOGLN(x) event_log.println(x)
 #elif SERIAL_LOGGING
 #define LOG(x) Serial.print(x)
 #define LOGH(x) Serial.print(x, HEX)
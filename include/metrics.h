@@ -0,0 +1,169 @@
+/*
+Copyright 2018 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ */
+
+#pragma once
+
+#include "chunked_writer.h"
+
+#include <Arduino.h>
+#include <ESP8266WebServer.h>
+
+// Most series which can be registered, counting each set of labels and each part of a summary separately.
+#define MAX_METRICS 64
+#define MAX_METRIC_COLLECTORS 4
+
+enum MetricType : uint8_t {
+  METRIC_COUNTER,
+  METRIC_GAUGE,
+  METRIC_SUMMARY,
+  METRIC_HISTOGRAM,
+};
+
+// Counts of observations in buckets with fixed upper bounds.
+class Histogram {
+public:
+  Histogram(const uint32_t *bounds, size_t bucket_count, uint32_t *counts):
+    bounds(bounds), bucket_count(bucket_count), counts(counts), sum(0), count(0) {}
+
+  void observe(uint32_t value);
+
+  const uint32_t *const bounds;
+  const size_t bucket_count;
+  // Observations in each bucket, not cumulative, then those above every bound.
+  uint32_t *const counts;
+  uint64_t sum;
+  uint32_t count;
+};
+
+// A histogram with its own storage for the counts of the given number of buckets.
+template <size_t N>
+class StaticHistogram : public Histogram {
+public:
+  explicit StaticHistogram(const uint32_t (&bounds)[N]): Histogram(bounds, N, storage), storage() {}
+
+private:
+  uint32_t storage[N + 1];
+};
+
+// Gets the current value of a metric which isn't kept in a variable.
+typedef int64_t (*MetricFunction)();
+
+// Where a metric's value comes from.
+struct MetricValue {
+  enum Source : uint8_t {
+    U32,
+    I32,
+    U64,
+    FUNCTION,
+    HISTOGRAM,
+  };
+
+  MetricValue(): source(FUNCTION) {
+    value.function = nullptr;
+  }
+  MetricValue(const uint32_t *u32): source(U32) {
+    value.u32 = u32;
+  }
+  MetricValue(const int32_t *i32): source(I32) {
+    value.i32 = i32;
+  }
+  MetricValue(const uint64_t *u64): source(U64) {
+    value.u64 = u64;
+  }
+  MetricValue(MetricFunction function): source(FUNCTION) {
+    value.function = function;
+  }
+  MetricValue(const Histogram *histogram): source(HISTOGRAM) {
+    value.histogram = histogram;
+  }
+
+  int64_t read() const;
+
+  Source source;
+  union {
+    const uint32_t *u32;
+    const int32_t *i32;
+    const uint64_t *u64;
+    MetricFunction function;
+    const Histogram *histogram;
+  } value;
+};
+
+// One registered series. Registering returns it, so that these can be chained on.
+struct Metric {
+  Metric &labels(const char *labels) {
+    label_text = labels;
+    return *this;
+  }
+  // Set the unit, which should also end the name, before any "_total".
+  Metric &unit(const char *unit) {
+    unit_name = unit;
+    return *this;
+  }
+  // Report the value shifted right by the given number of decimal places, such as 6 for microseconds as seconds.
+  Metric &scale(uint8_t decimal_places) {
+    decimals = decimal_places;
+    return *this;
+  }
+
+  const char *name;
+  // Added to the name of the family for this series, such as "_sum" for part of a summary.
+  const char *suffix;
+  // Labels inside the braces, such as `result="sent"`, or nullptr for none.
+  const char *label_text;
+  const char *unit_name;
+  MetricType type;
+  uint8_t decimals;
+  MetricValue value;
+};
+
+// Streams metrics in the Prometheus text format through a fixed buffer.
+//
+// A collector writes each series as
+//   writer.sample("rf_code_matches_total").label("index", i).value(matches);
+// after writing the family with writer.family("rf_code_matches_total", METRIC_COUNTER).
+class MetricWriter : public ChunkedWriter {
+public:
+  explicit MetricWriter(ESP8266WebServer &server): ChunkedWriter(server), in_labels(false) {}
+
+  void begin() {
+    ChunkedWriter::begin(200, "text/plain; version=0.0.4");
+  }
+
+  MetricWriter &family(const char *name, MetricType type, const char *unit = nullptr);
+  MetricWriter &sample(const char *name, const char *suffix = "");
+  MetricWriter &labels(const char *labels);
+  MetricWriter &label(const char *name, const char *value);
+  MetricWriter &label(const char *name, unsigned long value);
+  MetricWriter &value(int64_t value, uint8_t decimals = 0);
+  MetricWriter &histogram(const char *name, const char *labels, const Histogram &histogram, uint8_t decimals = 0);
+
+private:
+  void open_labels();
+  void number(int64_t value, uint8_t decimals);
+
+  bool in_labels;
+};
+
+// Writes metrics whose series can't be registered in advance, such as one for each stored command.
+typedef void (*MetricCollector)(MetricWriter &writer);
+
+Metric &register_counter(const char *name, MetricValue value);
+Metric &register_gauge(const char *name, MetricValue value);
+void register_summary(const char *name, MetricValue sum, MetricValue count, uint8_t decimals = 0);
+Metric &register_histogram(const char *name, const Histogram *histogram);
+void register_collector(MetricCollector collector);
+void write_metrics(MetricWriter &writer);
@@ -16,8 +16,14 @@ limitations under the License.
 
 #pragma once
 
+#include "html_writer.h"
+
 #include <Arduino.h>
 #include <ESP8266WebServer.h>
 
 void module_handle_root_args(ESP8266WebServer &server, String &error);
-void module_root_output(ESP8266WebServer &server);
+void module_root_output(HtmlWriter &html);
+#if !ENV_MINIUPDATE
+void module_register_metrics();
+void module_api_setup(ESP8266WebServer &server);
+#endif
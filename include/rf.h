@@ -20,10 +20,32 @@ limitations under the License.
 
 #include <Vector.h>
 
+// Counts of codes transmitted through the RF module.
+struct TransmitStats {
+  uint32_t transmits;
+  uint32_t ack_timeouts;
+  // Codes which were given up on after the RF module failed to acknowledge them too many times.
+  uint32_t failures;
+  // Codes which couldn't be queued because the queue was full.
+  uint32_t dropped;
+};
+
+enum LearnState : uint8_t {
+  LEARN_IDLE,
+  LEARN_WAITING,
+  LEARN_SUCCEEDED,
+  LEARN_FAILED,
+};
+
 extern Vector<ButtonCommand> button_commands;
+extern TransmitStats transmit_stats;
 
-bool save_commands();
-bool load_commands();
+void rebuild_code_index();
 
-bool learn_code(RfCode *code);
-void handle_message();
+bool start_learning();
+LearnState learn_result(RfCode *code);
+bool queue_transmit(const RfCode &code, uint8_t repeats);
+bool queue_transmit(const char *target);
+void set_raw_mode(bool enabled);
+void rf_init();
+void rf_loop();
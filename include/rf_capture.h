@@ -0,0 +1,40 @@
+/*
+Copyright 2018 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ */
+
+#pragma once
+
+#include "ButtonCommand.h"
+
+#include <Arduino.h>
+
+// Counts of raw frames received from the RF module.
+struct CaptureStats {
+  uint32_t frames;
+  uint32_t bytes;
+  // Frames which were dropped from the capture buffer to make room for newer ones.
+  uint32_t dropped;
+  // Messages which were too long to receive.
+  uint32_t overflows;
+};
+
+extern CaptureStats capture_stats;
+// Whether the RF module is sending raw frames rather than decoded codes.
+extern bool raw_mode;
+
+void capture_frame(const uint8_t *frame, size_t length);
+size_t capture_used();
+RfCode raw_signature(const uint8_t *frame, size_t length);
+void capture_init();
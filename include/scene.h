@@ -0,0 +1,47 @@
+/*
+Copyright 2018 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ */
+
+#pragma once
+
+#include "sinric.h"
+
+#include <Arduino.h>
+
+// Level for a switch which a scene leaves as it is.
+#define SCENE_UNCHANGED 0xff
+#define NO_SCENE -1
+
+// A named set of switch states, applied together.
+struct Scene {
+  String name;
+  // Sinric ID of a device which applies the scene when switched on, or empty.
+  String sinric_id;
+  // For each switch, its brightness in percent with SCENE_ON_BIT set if it is on, or SCENE_UNCHANGED.
+  uint8_t levels[NUM_SWITCHES];
+};
+
+#define SCENE_ON_BIT 0x80
+
+extern Scene scenes[];
+extern size_t scene_count;
+
+bool load_scenes();
+bool save_scenes();
+bool add_scene_from_current_state(const String &name);
+bool remove_scene(size_t i);
+int find_scene_by_id(const char *sinric_id);
+void set_scene_levels(size_t i, bool selected[]);
+void apply_scene(size_t i);
@@ -0,0 +1,65 @@
+/*
+Copyright 2018 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+
+enum ScheduleType {
+  // At a time of day, on the given days of the week.
+  SCHEDULE_TIME,
+  // At an offset from sunrise or sunset, on the given days of the week.
+  SCHEDULE_SUNRISE,
+  SCHEDULE_SUNSET,
+  // Once, at a given time.
+  SCHEDULE_ONCE,
+  SCHEDULE_TYPE_COUNT,
+};
+
+enum ScheduleAction {
+  SCHEDULE_OFF,
+  SCHEDULE_ON,
+  // Set the brightness without turning the switch on or off.
+  SCHEDULE_BRIGHTNESS,
+  SCHEDULE_ACTION_COUNT,
+};
+
+// One entry in the schedule, stored as-is in /schedules.bin.
+struct ScheduleEntry {
+  // For SCHEDULE_ONCE, when to run, in seconds since the Unix epoch.
+  uint32_t once_time;
+  // For SCHEDULE_TIME, minutes after local midnight. For sunrise and sunset, minutes after the event, or before if
+  // negative.
+  int16_t minutes;
+  uint16_t switch_index;
+  uint8_t type;
+  // Bit 0 for Sunday to bit 6 for Saturday.
+  uint8_t days;
+  uint8_t action;
+  // Brightness in percent, for SCHEDULE_BRIGHTNESS.
+  uint8_t value;
+};
+
+#define ALL_DAYS 0x7f
+
+extern ScheduleEntry schedule[];
+extern size_t schedule_length;
+
+bool add_schedule_entry(const ScheduleEntry &entry);
+bool remove_schedule_entry(size_t i);
+time_t next_occurrence(const ScheduleEntry &entry, time_t after);
+void schedule_setup();
+void schedule_loop();
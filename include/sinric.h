@@ -16,8 +16,46 @@ limitations under the License.
 
 #pragma once
 
+#include "config.h"
+#include "sinric_messages.h"
+
 #include <Arduino.h>
 
+// The switch pins again as a constant expression, so that files other than sinric.cpp can size arrays by the number of
+// switches.
+static constexpr uint8_t switch_pins_for_count[] = SWITCH_PINS;
+#define NUM_SWITCHES sizeof(switch_pins_for_count)
+
+// Counts of switch state reports to Sinric.
+struct ReportStats {
+  uint32_t sent;
+  // Reports which weren't sent because a later change to the same switch was reported instead.
+  uint32_t coalesced;
+  // Reports which weren't sent because Sinric already had the state.
+  uint32_t unchanged;
+};
+
+// Health of the connection to Sinric.
+struct ConnectionStats {
+  uint32_t reconnects;
+  // Connection attempts which failed, as far as can be told from the outside of the websocket library.
+  uint32_t reconnect_attempts;
+  // Disconnections while a ping was unanswered, taken to be from the connection being dropped for being idle.
+  uint32_t idle_disconnects;
+  // Total time connected, not counting the current connection.
+  uint64_t connected_millis;
+  uint32_t probes_sent;
+  uint32_t probes_lost;
+  // Round trip times of pings to Sinric, in milliseconds.
+  uint32_t last_rtt;
+  uint64_t rtt_sum;
+  uint32_t rtt_count;
+  // Time from a command arriving from Sinric to the pins being set, in microseconds.
+  uint64_t command_micros_sum;
+  uint32_t command_count;
+  uint32_t command_micros_max;
+};
+
 extern const uint8_t switch_pins[];
 extern const char *const switch_names[];
 extern const size_t num_switches;
@@ -28,12 +66,20 @@ extern bool switch_initial_state[];
 extern String switch_ids[];
 extern bool switch_state[];
 extern int switch_brightness[];
+// Weight of each switch within the colour of a device made of several switches with the same ID, out of 255.
+extern uint8_t switch_colour[];
+extern ReportStats report_stats;
+extern ConnectionStats connection_stats;
+extern unsigned long heartbeat_interval;
 
 bool save_switch_config();
 bool save_switch_ids();
 
-void send_switch_state(size_t i);
+void report_switch_state(size_t i);
+void flush_switch_reports();
 void sinric_setup();
 void sinric_connect();
 void sinric_loop();
+unsigned long sinric_connection_uptime();
 void update_switch(size_t i);
+void update_switches(const bool selected[]);
@@ -0,0 +1,47 @@
+/*
+Copyright 2018 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+
+// Counts of commands received from Sinric.
+struct CommandStats {
+  uint32_t handled;
+  // Commands with an action which isn't in the dispatch table.
+  uint32_t unknown;
+};
+
+extern CommandStats command_stats;
+
+// Get the smallest power of 2 which is at least twice the given number of entries, so that a hash table with open
+// addressing is never more than half full.
+static constexpr size_t id_table_size(size_t entries, size_t size = 1) {
+  return size >= entries * 2 ? size : id_table_size(entries, size * 2);
+}
+
+uint32_t hash_sinric_id(const char *id);
+
+// What the actions in messages from Sinric do to the switches, in sinric.cpp.
+void switch_device(const char *device_id, bool on);
+void set_brightness(const char *device_id, int brightness);
+void adjust_brightness(const char *device_id, int delta);
+void set_colour_rgb(const char *device_id, uint32_t rgb);
+void set_colour_temperature(const char *device_id, int kelvin);
+
+void build_action_table();
+bool handle_sinric_message(char *payload);
+size_t format_power_state(char *buffer, size_t size, const char *device_id, bool state);
@@ -22,6 +22,7 @@ limitations under the License.
 #define safe_copy(src, dest) snprintf((dest), sizeof(dest), "%s", (src))
 
 void copyStreamToPrint(Stream &from, Print &to);
+uint32_t crc32_update(uint32_t crc, const void *data, size_t length);
 bool write_line_to_file(const char *path, const char *token);
 String read_line_from_file(const char *filename);
 bool write_strings_to_file(const char *path, const String values[], size_t size);
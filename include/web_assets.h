@@ -0,0 +1,88 @@
+/*
+Copyright 2018 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ */
+
+// Generated by tools/web_assets.py from the files in web/. Do not edit.
+
+#pragma once
+
+#include <Arduino.h>
+
+struct WebAsset {
+  const char *path;
+  const char *content_type;
+  // Quoted, as it is sent in the ETag header.
+  const char *etag;
+  const uint8_t *data;
+  size_t length;
+};
+
+// app.js: 848 bytes, 465 compressed.
+#define APP_JS_ETAG "77362d37"
+static const uint8_t app_js_gz[] PROGMEM = {
+  0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x6d, 0x52, 0x4d, 0x8f, 0xd3, 0x30,
+  0x10, 0xbd, 0xe7, 0x57, 0x0c, 0x97, 0x75, 0x2a, 0x2a, 0x67, 0xc5, 0x11, 0x54, 0x10, 0xbb, 0xf4,
+  0x80, 0x84, 0xc4, 0x61, 0x8f, 0x88, 0x83, 0xeb, 0x4c, 0x1a, 0xb3, 0x8e, 0x5d, 0xd9, 0x93, 0x64,
+  0x2b, 0xd4, 0xff, 0xce, 0xd8, 0x4e, 0xda, 0x15, 0x90, 0x83, 0x67, 0x26, 0xf3, 0xfd, 0xde, 0x34,
+  0x0d, 0x7c, 0x8e, 0xcf, 0x70, 0xc0, 0xce, 0x07, 0x84, 0x16, 0x2d, 0x92, 0x71, 0x47, 0x50, 0xee,
+  0x4c, 0x3d, 0x2b, 0x5b, 0x50, 0x11, 0xa8, 0x47, 0xf6, 0x99, 0x08, 0xce, 0xc3, 0xe8, 0x5a, 0x2f,
+  0xab, 0xd6, 0xeb, 0x71, 0x40, 0x47, 0x52, 0xb5, 0xed, 0x7e, 0x62, 0xe5, 0x9b, 0x89, 0x84, 0x0e,
+  0x43, 0x2d, 0xb4, 0x35, 0xfa, 0x59, 0x6c, 0xa1, 0x1b, 0x9d, 0x26, 0xe3, 0x5d, 0x8d, 0xc9, 0xbf,
+  0x81, 0xdf, 0x15, 0xc0, 0xa4, 0x02, 0x90, 0x0a, 0x47, 0x24, 0xd8, 0x41, 0xfe, 0x2f, 0x8b, 0xf9,
+  0x81, 0x9d, 0xa6, 0x83, 0xba, 0x58, 0x92, 0xce, 0x27, 0x84, 0xdd, 0x0e, 0x44, 0x1c, 0x0f, 0x83,
+  0x21, 0x01, 0x77, 0x77, 0x4b, 0x9e, 0x74, 0x6a, 0x40, 0x69, 0x5c, 0x8b, 0x2f, 0xdf, 0xbb, 0x5a,
+  0xe4, 0x79, 0x51, 0x6c, 0x52, 0xf0, 0x7d, 0x8a, 0x7a, 0xa3, 0xbd, 0xeb, 0x4c, 0x18, 0xd6, 0x4a,
+  0x93, 0xb2, 0x23, 0xc2, 0x5b, 0x10, 0x9f, 0xc4, 0xa6, 0xcc, 0x00, 0x4b, 0xe3, 0x53, 0xc8, 0xf2,
+  0x0b, 0x76, 0x6a, 0xb4, 0x54, 0x6f, 0xd2, 0x08, 0x97, 0xea, 0xc2, 0xb2, 0x6a, 0x1a, 0x78, 0xea,
+  0xfd, 0x5c, 0x02, 0x23, 0x74, 0xc1, 0x0f, 0x09, 0x03, 0x46, 0x67, 0x32, 0x1a, 0x17, 0x44, 0xce,
+  0xd0, 0xab, 0xd3, 0x09, 0xdd, 0x16, 0x1c, 0xce, 0x18, 0x09, 0xb8, 0x6d, 0x24, 0x59, 0xa5, 0x1d,
+  0x97, 0xc4, 0x1d, 0x5c, 0x71, 0xe2, 0x59, 0xf6, 0x16, 0x93, 0xfa, 0x70, 0xfe, 0xda, 0xd6, 0xa2,
+  0x44, 0x08, 0xee, 0x96, 0xd6, 0x5e, 0xe2, 0x79, 0xfe, 0x99, 0x57, 0xf3, 0xb3, 0xcc, 0x98, 0x3e,
+  0xf9, 0x31, 0x68, 0xbc, 0x21, 0x17, 0xb3, 0xcd, 0x55, 0xb9, 0x21, 0xbc, 0x8a, 0xa8, 0x45, 0x73,
+  0x2b, 0x07, 0xf0, 0x43, 0xc4, 0xd9, 0x90, 0xee, 0x99, 0x03, 0x11, 0xba, 0xf4, 0xaa, 0x4c, 0x44,
+  0xd2, 0x7e, 0xf9, 0x43, 0x12, 0xd6, 0x1f, 0xc5, 0x4f, 0xc9, 0x8c, 0xef, 0x95, 0xee, 0xeb, 0x2b,
+  0x53, 0x09, 0xf6, 0x15, 0xa4, 0xd2, 0xec, 0x5f, 0x7e, 0x53, 0xcc, 0xff, 0xc9, 0x4d, 0x5f, 0x1a,
+  0xd3, 0x10, 0x0e, 0xaf, 0x57, 0xd7, 0x01, 0x15, 0xe1, 0xb2, 0x7d, 0x2d, 0xac, 0x29, 0x63, 0xa6,
+  0x2f, 0x85, 0x4a, 0xc2, 0x17, 0x7a, 0xf4, 0x8e, 0xcb, 0xa7, 0xab, 0xc8, 0xd4, 0x33, 0x5f, 0xef,
+  0x41, 0xb0, 0x28, 0x54, 0xb5, 0x8a, 0xd4, 0x9a, 0x52, 0x36, 0xe5, 0x0b, 0x88, 0x18, 0xe8, 0x21,
+  0x5f, 0x6d, 0x9d, 0xca, 0x6c, 0x57, 0x4f, 0xa6, 0xe1, 0xb1, 0x37, 0xb6, 0xbd, 0xb6, 0x99, 0xd9,
+  0xc2, 0x15, 0x65, 0xa9, 0x93, 0x2f, 0xa0, 0x93, 0x16, 0xdd, 0x91, 0x7a, 0xf8, 0x08, 0xef, 0xee,
+  0x6f, 0x1b, 0x5c, 0x3b, 0x04, 0x1c, 0xfc, 0x84, 0xb9, 0xd0, 0x9a, 0x69, 0xd5, 0xdf, 0x95, 0x2f,
+  0x59, 0x5e, 0xca, 0xf1, 0xf0, 0x7b, 0xa9, 0xfe, 0x00, 0xcc, 0xf6, 0xe3, 0xcd, 0x50, 0x03, 0x00,
+  0x00,
+};
+
+// style.css: 301 bytes, 197 compressed.
+#define STYLE_CSS_ETAG "244863be"
+static const uint8_t style_css_gz[] PROGMEM = {
+  0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x75, 0x8d, 0xc1, 0x6a, 0xc3, 0x30,
+  0x10, 0x44, 0xef, 0xfd, 0x8a, 0xb9, 0xf4, 0xe8, 0x62, 0xdf, 0xc2, 0x9a, 0xfa, 0x47, 0x4a, 0x0f,
+  0xa2, 0x5a, 0xcb, 0x02, 0x59, 0x12, 0xeb, 0x35, 0xb1, 0x29, 0xf9, 0xf7, 0xac, 0x43, 0xc8, 0xc9,
+  0xb9, 0x0c, 0xec, 0xec, 0x9b, 0x99, 0xb1, 0xc8, 0x8c, 0x01, 0x6b, 0xc2, 0x3f, 0x52, 0x5c, 0xb4,
+  0x59, 0x74, 0x4f, 0x4c, 0xc8, 0x25, 0x73, 0x8f, 0xea, 0xbc, 0x8f, 0x39, 0x10, 0xda, 0xba, 0xe1,
+  0xf6, 0x31, 0xbe, 0xe0, 0xc1, 0x60, 0x4b, 0xf8, 0xb8, 0xd4, 0xe4, 0x76, 0xc2, 0x98, 0x78, 0xeb,
+  0x1f, 0xda, 0x5c, 0xc5, 0x55, 0xc2, 0xa1, 0x3d, 0x66, 0x67, 0x77, 0xf4, 0x3a, 0x11, 0x2e, 0xed,
+  0x69, 0xc7, 0x80, 0x98, 0xeb, 0xaa, 0x3f, 0xba, 0x57, 0xfe, 0x56, 0xde, 0xf4, 0xd7, 0x6a, 0x1f,
+  0x3d, 0x41, 0xca, 0x95, 0xd0, 0x9d, 0x45, 0x96, 0xea, 0xb2, 0x61, 0xb3, 0x93, 0x10, 0x73, 0x93,
+  0x78, 0x54, 0x82, 0x5b, 0xb5, 0xbc, 0x65, 0x9f, 0x2b, 0x96, 0x99, 0x38, 0x86, 0xc9, 0xf0, 0xae,
+  0x6d, 0x3f, 0x0d, 0xd7, 0xc9, 0xbc, 0x63, 0xb6, 0x71, 0x29, 0x86, 0x4c, 0x38, 0xca, 0xcc, 0xff,
+  0x62, 0x91, 0x22, 0xf6, 0xfb, 0x2b, 0xa9, 0x08, 0x41, 0xd8, 0x9b, 0x7b, 0x07, 0xa2, 0xd7, 0xb1,
+  0xfc, 0x2d, 0x01, 0x00, 0x00,
+};
+
+static const WebAsset web_assets[] = {
+  {"/app.js", "application/javascript", "\"" APP_JS_ETAG "\"", app_js_gz, sizeof(app_js_gz)},
+  {"/style.css", "text/css", "\"" STYLE_CSS_ETAG "\"", style_css_gz, sizeof(style_css_gz)},
+};
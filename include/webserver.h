@@ -19,8 +19,31 @@ limitations under the License.
 #include <Arduino.h>
 #include <ESP8266WebServer.h>
 
+// Cost of serving the web UI.
+struct PageStats {
+  uint32_t root_renders;
+  uint64_t root_render_micros;
+  // Change in free heap over the last render of the root page.
+  int32_t root_heap_change;
+  uint32_t assets_sent;
+  uint32_t assets_not_modified;
+};
+
+// How requests for admin pages and the API were authenticated.
+struct AuthStats {
+  // Requests let through by a session cookie.
+  uint32_t sessions;
+  // Successful digest logins, each of which starts a session.
+  uint32_t logins;
+  // Requests which were asked to authenticate.
+  uint32_t challenges;
+};
+
 extern ESP8266WebServer server;
+extern PageStats page_stats;
+extern AuthStats auth_stats;
 
+bool authenticate_admin();
 void start_webserver();
 void webserver_loop();
 String load_command();
@@ -16,4 +16,13 @@ limitations under the License.
 
 #pragma once
 
+#include <Arduino.h>
+
+struct WifiStats {
+  // Times the connection to the access point was lost, after which it reconnects by itself.
+  uint32_t disconnects;
+};
+
+extern WifiStats wifi_stats;
+
 bool wifi_setup();
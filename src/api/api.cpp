@@ -0,0 +1,258 @@
+/*
+Copyright 2018 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ */
+
+#include "api.h"
+
+#include "logging.h"
+#include "webserver.h"
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <ESP8266WebServer.h>
+
+// Write a comma if this isn't the first value in an object or array.
+void JsonWriter::separate() {
+  if (need_comma) {
+    write(',');
+  }
+  need_comma = false;
+}
+
+JsonWriter &JsonWriter::begin_object() {
+  separate();
+  write('{');
+  return *this;
+}
+
+JsonWriter &JsonWriter::end_object() {
+  write('}');
+  need_comma = true;
+  return *this;
+}
+
+JsonWriter &JsonWriter::begin_array() {
+  separate();
+  write('[');
+  return *this;
+}
+
+JsonWriter &JsonWriter::end_array() {
+  write(']');
+  need_comma = true;
+  return *this;
+}
+
+JsonWriter &JsonWriter::key(const char *name) {
+  value(name);
+  write(':');
+  need_comma = false;
+  return *this;
+}
+
+JsonWriter &JsonWriter::value(const char *string) {
+  separate();
+  write('"');
+  for (const char *c = string; *c != '\0'; ++c) {
+    if (*c == '"' || *c == '\\') {
+      char escaped[] = {'\\', *c};
+      write(escaped, 2);
+    } else if ((uint8_t) *c < 0x20) {
+      char escaped[7];
+      snprintf(escaped, sizeof(escaped), "\\u%04x", *c);
+      write(escaped, 6);
+    } else {
+      write(*c);
+    }
+  }
+  write('"');
+  need_comma = true;
+  return *this;
+}
+
+JsonWriter &JsonWriter::value(bool boolean) {
+  separate();
+  write(boolean ? "true" : "false");
+  need_comma = true;
+  return *this;
+}
+
+JsonWriter &JsonWriter::value(long number) {
+  char digits[12];
+  separate();
+  write(digits, snprintf(digits, sizeof(digits), "%ld", number));
+  need_comma = true;
+  return *this;
+}
+
+JsonWriter &JsonWriter::value(unsigned long number) {
+  char digits[12];
+  separate();
+  write(digits, snprintf(digits, sizeof(digits), "%lu", number));
+  need_comma = true;
+  return *this;
+}
+
+JsonWriter &JsonWriter::null_value() {
+  separate();
+  write("null");
+  need_comma = true;
+  return *this;
+}
+
+void api_error(int code, const char *message) {
+  JsonWriter writer(server);
+  writer.begin(code);
+  writer.begin_object().field("error", message).end_object();
+  writer.end();
+}
+
+// Run slow work as a background job, and tell the client where to check on it.
+void api_submit_job(const char *name, const JobStep &step) {
+  uint32_t id = submit_job(name, step);
+  if (id == 0) {
+    api_error(503, "Too many background jobs");
+    return;
+  }
+  server.sendHeader("Location", String(API_PREFIX "/jobs?id=") + id);
+  JsonWriter writer(server);
+  writer.begin(202);
+  writer.begin_object().field("job", id).end_object();
+  writer.end();
+}
+
+// JSON from the request body is copied here to be parsed in place, rather than changing the server's copy of the body.
+// Strings in the parsed JSON point into it, so they last until the next request is parsed.
+static char json_text[API_MAX_JSON_SIZE];
+
+// Copy JSON text into json_text, returning false if it is too long.
+static bool copy_json_text(const char *json, size_t length) {
+  if (length >= sizeof(json_text)) {
+    return false;
+  }
+  memcpy(json_text, json, length);
+  json_text[length] = '\0';
+  return true;
+}
+
+// Parse the request body as a JSON object, or send an error response and return nullptr if it isn't one.
+JsonObject *api_parse_object(JsonBuffer &json_buffer) {
+  const String &body = server.arg("plain");
+  if (!copy_json_text(body.c_str(), body.length())) {
+    api_error(413, "Request body too long");
+    return nullptr;
+  }
+  JsonObject &json = json_buffer.parseObject(json_text);
+  if (!json.success()) {
+    api_error(400, "Expected a JSON object");
+    return nullptr;
+  }
+  return &json;
+}
+
+// Find the end of the JSON value starting at the given position, which must be after any whitespace, without parsing
+// it. Returns nullptr if it is cut short.
+static const char *skip_value(const char *json) {
+  int depth = 0;
+  bool in_string = false;
+  for (const char *c = json; *c != '\0'; ++c) {
+    if (in_string) {
+      if (*c == '\\' && c[1] != '\0') {
+        ++c;
+      } else if (*c == '"') {
+        in_string = false;
+      }
+    } else if (*c == '"') {
+      in_string = true;
+    } else if (*c == '{' || *c == '[') {
+      ++depth;
+    } else if (*c == '}' || *c == ']') {
+      if (depth == 0) {
+        return c;
+      }
+      --depth;
+    } else if (*c == ',' && depth == 0) {
+      return c;
+    }
+  }
+  return depth == 0 && !in_string ? json + strlen(json) : nullptr;
+}
+
+static const char *skip_whitespace(const char *json) {
+  while (*json == ' ' || *json == '\t' || *json == '\r' || *json == '\n') {
+    ++json;
+  }
+  return json;
+}
+
+// Check that the request body is a whole JSON array, so that one which is malformed or cut short is rejected before any
+// of it is applied. Returns its first element, or nullptr if it isn't one.
+static const char *bulk_elements(const char *json) {
+  json = skip_whitespace(json);
+  if (*json != '[') {
+    return nullptr;
+  }
+  const char *first = skip_whitespace(json + 1);
+  json = first;
+  while (*json != ']') {
+    const char *end = skip_value(json);
+    // Each element must have something in it, so "[,]" and "[1,]" are rejected.
+    if (end == nullptr || end == json || (*end != ',' && *end != ']')) {
+      return nullptr;
+    }
+    json = *end == ',' ? skip_whitespace(end + 1) : end;
+    if (*end == ',' && *json == ']') {
+      return nullptr;
+    }
+  }
+  return *skip_whitespace(json + 1) == '\0' ? first : nullptr;
+}
+
+// Apply an operation to each element of a JSON array in the request body, and respond with the result of each. Only one
+// element is parsed at a time, so a large bulk request doesn't need room for all of them at once.
+void api_bulk(const BulkOperation &operation) {
+  const char *json = bulk_elements(server.arg("plain").c_str());
+  if (json == nullptr) {
+    api_error(400, "Expected a complete JSON array");
+    return;
+  }
+
+  JsonWriter writer(server);
+  writer.begin();
+  writer.begin_object().key("results").begin_array();
+  uint32_t succeeded = 0;
+  uint32_t failed = 0;
+  while (*json != ']') {
+    const char *end = skip_value(json);
+    const char *error;
+    if (!copy_json_text(json, end - json)) {
+      error = "Element too long";
+    } else {
+      StaticJsonBuffer<API_JSON_BUFFER_SIZE> json_buffer;
+      JsonVariant element = json_buffer.parse(json_text);
+      error = element.success() ? operation(element) : "Invalid JSON";
+    }
+    if (error == nullptr) {
+      ++succeeded;
+      writer.null_value();
+    } else {
+      ++failed;
+      writer.value(error);
+    }
+    json = skip_whitespace(*end == ',' ? end + 1 : end);
+  }
+  writer.end_array().field("succeeded", succeeded).field("failed", failed).end_object();
+  writer.end();
+}
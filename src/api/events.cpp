@@ -0,0 +1,129 @@
+/*
+Copyright 2018 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ */
+
+#include "events.h"
+
+#include "metrics.h"
+#include "webserver.h"
+
+#include <Arduino.h>
+#include <ESP8266WebServer.h>
+#include <WiFiClient.h>
+#include <stdarg.h>
+
+EventStats event_stats;
+
+// Clients subscribed to /events, which are kept after the server has finished with the request.
+static WiFiClient event_clients[MAX_EVENT_CLIENTS];
+static unsigned long last_send_time = 0;
+// Set while sending to clients, so that anything logged meanwhile isn't published in the middle of another event.
+static bool sending = false;
+
+bool have_event_clients() {
+  for (WiFiClient &client : event_clients) {
+    if (client.connected()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Send a complete event to every subscribed client. A client whose send buffer doesn't have room for it is dropped
+// rather than waited for, so that one slow client can't hold up the loop.
+static void send_to_clients(const char *text, size_t length) {
+  sending = true;
+  for (WiFiClient &client : event_clients) {
+    if (!client.connected()) {
+      continue;
+    }
+    if (client.availableForWrite() < length) {
+      client.stop();
+      ++event_stats.clients_dropped;
+      continue;
+    }
+    client.write((const uint8_t *) text, length);
+  }
+  last_send_time = millis();
+  sending = false;
+}
+
+// Publish an event of the given type to all subscribed clients, with its data formatted by printf into a fixed buffer.
+// Nothing is formatted if there are no clients, so publishing is cheap when nobody is watching. The data must not
+// contain newlines.
+void publish_event(const char *type, const char *format, ...) {
+  if (sending || !have_event_clients()) {
+    return;
+  }
+  char event[MAX_EVENT_SIZE];
+  int length = snprintf(event, sizeof(event), "event: %s\ndata: ", type);
+  if (length >= 0 && (size_t) length < sizeof(event)) {
+    va_list arguments;
+    va_start(arguments, format);
+    int data_length = vsnprintf(&event[length], sizeof(event) - length, format, arguments);
+    va_end(arguments);
+    length = data_length < 0 ? -1 : length + data_length;
+  }
+  if (length < 0 || (size_t) length + 2 >= sizeof(event)) {
+    ++event_stats.oversized;
+    return;
+  }
+  event[length++] = '\n';
+  event[length++] = '\n';
+  event[length] = '\0';
+  ++event_stats.published;
+  send_to_clients(event, length);
+}
+
+// Subscribe the client to events. The response never finishes, so the headers are written straight to the connection.
+static void handle_events() {
+  if (!authenticate_admin()) {
+    return;
+  }
+  WiFiClient *slot = nullptr;
+  for (WiFiClient &client : event_clients) {
+    if (!client.connected()) {
+      slot = &client;
+      break;
+    }
+  }
+  if (slot == nullptr) {
+    ++event_stats.clients_rejected;
+    server.send(503, "text/plain", "Too many event clients");
+    return;
+  }
+  *slot = server.client();
+  slot->setNoDelay(true);
+  slot->print("HTTP/1.1 200 OK\r\n"
+    "Content-Type: text/event-stream\r\n"
+    "Cache-Control: no-cache\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n");
+}
+
+void events_setup(ESP8266WebServer &server) {
+  server.on("/events", HTTP_GET, handle_events);
+  register_counter("events_published_total", &event_stats.published);
+  register_counter("events_oversized_total", &event_stats.oversized);
+  register_counter("event_clients_total", &event_stats.clients_dropped).labels("result=\"dropped\"");
+  register_counter("event_clients_total", &event_stats.clients_rejected).labels("result=\"rejected\"");
+}
+
+void events_loop() {
+  if (millis() - last_send_time >= EVENT_KEEPALIVE_INTERVAL) {
+    static const char keepalive[] = ":\n\n";
+    send_to_clients(keepalive, sizeof(keepalive) - 1);
+  }
+}
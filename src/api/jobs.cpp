@@ -0,0 +1,148 @@
+/*
+Copyright 2018 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ */
+
+#include "jobs.h"
+
+#include "events.h"
+#include "logging.h"
+
+#include <Arduino.h>
+
+// Upper bounds of the loop duration histogram buckets, in microseconds.
+static const uint32_t loop_bucket_bounds[NUM_LOOP_BUCKETS] = {
+  1000, 5000, 10000, 50000, 100000, 500000, 1000000, 5000000,
+};
+
+Job jobs[MAX_JOBS];
+JobStats job_stats;
+StaticHistogram<NUM_LOOP_BUCKETS> loop_durations(loop_bucket_bounds);
+uint32_t max_loop_micros = 0;
+
+static uint32_t next_job_id = 1;
+// Slot of the job which last ran a step, so that running jobs take turns.
+static size_t last_job = 0;
+static unsigned long last_loop_micros = 0;
+
+const char *job_state_name(JobState state) {
+  switch (state) {
+    case JOB_QUEUED:
+      return "queued";
+    case JOB_RUNNING:
+      return "running";
+    case JOB_SUCCEEDED:
+      return "succeeded";
+    case JOB_FAILED:
+      return "failed";
+  }
+  return "unknown";
+}
+
+static bool job_finished(const Job &job) {
+  return job.state == JOB_SUCCEEDED || job.state == JOB_FAILED;
+}
+
+// Queue a job to be run from the main loop, returning its ID, or 0 if there are too many unfinished jobs.
+uint32_t submit_job(const char *name, const JobStep &step) {
+  // Use an empty slot, or else the one of the job which was submitted longest ago and has finished.
+  Job *slot = nullptr;
+  for (Job &job : jobs) {
+    if (job.id == 0) {
+      slot = &job;
+      break;
+    }
+    if (job_finished(job) && (slot == nullptr || job.id < slot->id)) {
+      slot = &job;
+    }
+  }
+  if (slot == nullptr) {
+    LOG("Too many jobs to submit ");
+    LOGLN(name);
+    ++job_stats.rejected;
+    return 0;
+  }
+  slot->id = next_job_id++;
+  slot->name = name;
+  slot->state = JOB_QUEUED;
+  slot->submitted_millis = millis();
+  slot->run_micros = 0;
+  slot->step = step;
+  ++job_stats.submitted;
+  LOG("Submitted job ");
+  LOG(slot->id);
+  LOG(" ");
+  LOGLN(name);
+  return slot->id;
+}
+
+const Job *find_job(uint32_t id) {
+  for (const Job &job : jobs) {
+    if (job.id != 0 && job.id == id) {
+      return &job;
+    }
+  }
+  return nullptr;
+}
+
+static void record_loop_time() {
+  unsigned long now = micros();
+  if (last_loop_micros != 0) {
+    uint32_t duration = now - last_loop_micros;
+    loop_durations.observe(duration);
+    if (duration > max_loop_micros) {
+      max_loop_micros = duration;
+    }
+  }
+  last_loop_micros = now;
+}
+
+// Run one step of the next unfinished job, if there is one, so that each iteration of the main loop does at most one
+// step of one job. Call once per iteration, as this also measures how long iterations take.
+void jobs_loop() {
+  record_loop_time();
+  for (size_t i = 1; i <= MAX_JOBS; ++i) {
+    size_t index = (last_job + i) % MAX_JOBS;
+    Job &job = jobs[index];
+    if (job.id == 0 || job_finished(job)) {
+      continue;
+    }
+    last_job = index;
+    job.state = JOB_RUNNING;
+    unsigned long start = micros();
+    JobState state = job.step();
+    uint32_t step_micros = micros() - start;
+    job.run_micros += step_micros;
+    if (step_micros > job_stats.max_step_micros) {
+      job_stats.max_step_micros = step_micros;
+    }
+    if (state == JOB_SUCCEEDED || state == JOB_FAILED) {
+      job.state = state;
+      // Free anything the step captured.
+      job.step = nullptr;
+      if (state == JOB_SUCCEEDED) {
+        ++job_stats.succeeded;
+      } else {
+        ++job_stats.failed;
+      }
+      LOG("Job ");
+      LOG(job.id);
+      LOG(" ");
+      LOGLN(job_state_name(state));
+      publish_event("job", "{\"id\":%lu,\"name\":\"%s\",\"state\":\"%s\"}", (unsigned long) job.id, job.name,
+        job_state_name(state));
+    }
+    break;
+  }
+}
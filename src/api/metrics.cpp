@@ -0,0 +1,242 @@
+/*
+Copyright 2018 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ */
+
+#include "metrics.h"
+
+#include "logging.h"
+
+#include <Arduino.h>
+
+static Metric metrics[MAX_METRICS];
+static size_t metric_count = 0;
+static MetricCollector collectors[MAX_METRIC_COLLECTORS];
+static size_t collector_count = 0;
+// Given out when the registry is full, so that callers can still chain onto it.
+static Metric unregistered_metric;
+
+void Histogram::observe(uint32_t value) {
+  size_t bucket = 0;
+  while (bucket < bucket_count && value > bounds[bucket]) {
+    ++bucket;
+  }
+  ++counts[bucket];
+  sum += value;
+  ++count;
+}
+
+int64_t MetricValue::read() const {
+  switch (source) {
+    case U32:
+      return *value.u32;
+    case I32:
+      return *value.i32;
+    case U64:
+      return *value.u64;
+    case FUNCTION:
+      return value.function != nullptr ? value.function() : 0;
+    case HISTOGRAM:
+      return value.histogram->count;
+  }
+  return 0;
+}
+
+////////////
+// Writer //
+////////////
+
+MetricWriter &MetricWriter::family(const char *name, MetricType type, const char *unit) {
+  static const char *const type_names[] = {"counter", "gauge", "summary", "histogram"};
+  write("# TYPE ");
+  write(name);
+  write(' ');
+  write(type_names[type]);
+  write('\n');
+  if (unit != nullptr) {
+    write("# UNIT ");
+    write(name);
+    write(' ');
+    write(unit);
+    write('\n');
+  }
+  return *this;
+}
+
+MetricWriter &MetricWriter::sample(const char *name, const char *suffix) {
+  write(name);
+  write(suffix);
+  in_labels = false;
+  return *this;
+}
+
+void MetricWriter::open_labels() {
+  write(in_labels ? ',' : '{');
+  in_labels = true;
+}
+
+// Add labels which are already formatted, such as `result="sent"`.
+MetricWriter &MetricWriter::labels(const char *labels) {
+  if (labels != nullptr) {
+    open_labels();
+    write(labels);
+  }
+  return *this;
+}
+
+MetricWriter &MetricWriter::label(const char *name, const char *value) {
+  open_labels();
+  write(name);
+  write("=\"");
+  const char *start = value;
+  for (const char *c = value; *c != '\0'; ++c) {
+    if (*c == '"' || *c == '\\' || *c == '\n') {
+      write(start, c - start);
+      write('\\');
+      write(*c == '\n' ? 'n' : *c);
+      start = c + 1;
+    }
+  }
+  write(start);
+  write('"');
+  return *this;
+}
+
+MetricWriter &MetricWriter::label(const char *name, unsigned long value) {
+  open_labels();
+  write(name);
+  write("=\"");
+  number(value, 0);
+  write('"');
+  return *this;
+}
+
+// Finish the sample with its value.
+MetricWriter &MetricWriter::value(int64_t value, uint8_t decimals) {
+  if (in_labels) {
+    write('}');
+    in_labels = false;
+  }
+  write(' ');
+  number(value, decimals);
+  write('\n');
+  return *this;
+}
+
+// Write the buckets, sum and count of a histogram, with the given labels on each.
+MetricWriter &MetricWriter::histogram(const char *name, const char *labels, const Histogram &histogram,
+    uint8_t decimals) {
+  uint32_t cumulative = 0;
+  for (size_t i = 0; i < histogram.bucket_count; ++i) {
+    cumulative += histogram.counts[i];
+    sample(name, "_bucket").labels(labels);
+    open_labels();
+    write("le=\"");
+    number(histogram.bounds[i], decimals);
+    write('"');
+    value(cumulative);
+  }
+  sample(name, "_bucket").labels(labels).label("le", "+Inf").value(histogram.count);
+  sample(name, "_sum").labels(labels).value(histogram.sum, decimals);
+  return sample(name, "_count").labels(labels).value(histogram.count);
+}
+
+// Write a number with the given number of digits after the decimal point, without going through floating point.
+void MetricWriter::number(int64_t value, uint8_t decimals) {
+  char digits[24];
+  char *end = &digits[sizeof(digits)];
+  char *c = end;
+  uint64_t magnitude = value < 0 ? -(uint64_t) value : value;
+  // Fill in digits from the right, with at least one before the decimal point.
+  for (uint8_t place = 0; place <= decimals || magnitude > 0; ++place) {
+    if (place == decimals && decimals > 0) {
+      *--c = '.';
+    }
+    *--c = '0' + magnitude % 10;
+    magnitude /= 10;
+  }
+  if (value < 0) {
+    *--c = '-';
+  }
+  write(c, end - c);
+}
+
+//////////////
+// Registry //
+//////////////
+
+static Metric &register_metric(const char *name, const char *suffix, MetricType type, MetricValue value) {
+  if (metric_count == MAX_METRICS) {
+    LOG("Too many metrics to register ");
+    LOGLN(name);
+    return unregistered_metric;
+  }
+  Metric &metric = metrics[metric_count++];
+  metric.name = name;
+  metric.suffix = suffix;
+  metric.label_text = nullptr;
+  metric.unit_name = nullptr;
+  metric.type = type;
+  metric.decimals = 0;
+  metric.value = value;
+  return metric;
+}
+
+// Register a series of a counter, whose name should end in "_total" so that the family and its samples match. Series
+// of the same family, with different labels, should be registered one after another.
+Metric &register_counter(const char *name, MetricValue value) {
+  return register_metric(name, "", METRIC_COUNTER, value);
+}
+
+Metric &register_gauge(const char *name, MetricValue value) {
+  return register_metric(name, "", METRIC_GAUGE, value);
+}
+
+void register_summary(const char *name, MetricValue sum, MetricValue count, uint8_t decimals) {
+  register_metric(name, "_sum", METRIC_SUMMARY, sum).scale(decimals);
+  register_metric(name, "_count", METRIC_SUMMARY, count);
+}
+
+// Register a histogram. Scaling it applies to its bucket bounds and sum.
+Metric &register_histogram(const char *name, const Histogram *histogram) {
+  return register_metric(name, "", METRIC_HISTOGRAM, histogram);
+}
+
+void register_collector(MetricCollector collector) {
+  if (collector_count == MAX_METRIC_COLLECTORS) {
+    LOGLN("Too many metric collectors");
+    return;
+  }
+  collectors[collector_count++] = collector;
+}
+
+// Write every registered metric, then everything the collectors have to add.
+void write_metrics(MetricWriter &writer) {
+  const char *last_family = nullptr;
+  for (size_t i = 0; i < metric_count; ++i) {
+    const Metric &metric = metrics[i];
+    if (last_family == nullptr || strcmp(metric.name, last_family) != 0) {
+      writer.family(metric.name, metric.type, metric.unit_name);
+      last_family = metric.name;
+    }
+    if (metric.type == METRIC_HISTOGRAM) {
+      writer.histogram(metric.name, metric.label_text, *metric.value.value.histogram, metric.decimals);
+      continue;
+    }
+    writer.sample(metric.name, metric.suffix).labels(metric.label_text).value(metric.value.read(), metric.decimals);
+  }
+  for (size_t i = 0; i < collector_count; ++i) {
+    collectors[i](writer);
+  }
+}
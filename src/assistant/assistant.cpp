@@ -16,6 +16,7 @@ limitations under the License.
 
 #include "assistant.h"
 
+#include "api.h"
 #include "config.h"
 #include "embedded_assistant.pb.h"
 #include "stream_body.pb.h"
@@ -139,13 +140,24 @@ bool oauth_with_code(const String &code) {
   return true;
 }
 
+// Background job to exchange an OAuth code for a token, which needs a TLS connection to Google.
+struct OAuthJob {
+  String code;
+
+  JobState operator()() const {
+    return oauth_with_code(code) ? JOB_SUCCEEDED : JOB_FAILED;
+  }
+};
+
 void handle_oauth() {
+  if (!authenticate_admin()) {
+    return;
+  }
   LOGLN("Start handle_oauth");
   const String &code = server.arg("code");
   if (code.length() > 0) {
-    bool success = oauth_with_code(code);
-    if (success) {
-      server.send(200, "text/html", "<html><head><title>Auth</title></head><body><p>Success</p><a href=\"/\">Home</a></body></html>");
+    if (submit_job("oauth", OAuthJob{code}) != 0) {
+      server.send(200, "text/html", "<html><head><title>Auth</title></head><body><p>Getting token, see background jobs for the result.</p><a href=\"/\">Home</a></body></html>");
     } else {
       server.send(200, "text/html", "<html><head><title>Auth</title></head><body><p>Failure</p><a href=\"/\">Home</a></body></html>");
     }
@@ -155,6 +167,37 @@ void handle_oauth() {
   }
 }
 
+static void handle_api_get_token() {
+  if (!authenticate_admin()) {
+    return;
+  }
+  JsonWriter writer(server);
+  writer.begin();
+  writer.begin_object()
+    .field("has_token", load_token().length() > 0)
+    .field("has_refresh_token", read_line_from_file("/refresh_token.txt").length() > 0)
+    .end_object();
+  writer.end();
+}
+
+// Exchange an OAuth code for a new token in the background.
+static void handle_api_post_token() {
+  if (!authenticate_admin()) {
+    return;
+  }
+  StaticJsonBuffer<API_JSON_BUFFER_SIZE> json_buffer;
+  JsonObject *json = api_parse_object(json_buffer);
+  if (json == nullptr) {
+    return;
+  }
+  const char *code = (*json)["code"];
+  if (code == nullptr || code[0] == '\0') {
+    api_error(400, "Missing code");
+  } else {
+    api_submit_job("oauth", OAuthJob{code});
+  }
+}
+
 // Use the refresh token to get a new auth token.
 // Return true on success.
 bool refresh_oauth() {
@@ -212,16 +255,16 @@ bool refresh_oauth() {
 }
 
 // Return true on success, false on failure for any reason.
-bool send_assistant_request(const String &command) {
+bool send_assistant_request(const char *command) {
   LOGLN("Start send_assistant_request");
   String token = load_token();
-  if (token.length() == 0 || command.length() == 0) {
+  if (token.length() == 0 || command[0] == '\0') {
     return false;
   }
 
   pb_byte_t request_buffer[REQUEST_BUFFER_SIZE];
   pb_ostream_t request_buffer_stream = pb_ostream_from_buffer(request_buffer, REQUEST_BUFFER_SIZE);
-  if (!encode_request(command.c_str(), &request_buffer_stream)) {
+  if (!encode_request(command, &request_buffer_stream)) {
     LOGLN("Failed to encode request.");
     return false;
   }
@@ -273,21 +316,26 @@ bool send_assistant_request(const String &command) {
 }
 
 // Send the request to Google Assistant, refreshing the auth token if necessary.
-void auth_and_send_request(const String &command) {
+// Return true on success.
+bool auth_and_send_request(const char *command) {
   if (send_assistant_request(command)) {
-    return;
+    return true;
   }
   LOGLN("First request failed, refreshing token");
   if (!refresh_oauth()) {
-    return;
+    return false;
   }
   if (!send_assistant_request(command)) {
     LOGLN("Second request failed");
+    return false;
   }
+  return true;
 }
 
 bool assistant_init() {
   server.on("/oauth", handle_oauth);
+  server.on(API_PREFIX "/token", HTTP_GET, handle_api_get_token);
+  server.on(API_PREFIX "/token", HTTP_POST, handle_api_post_token);
 
   int certificate_count = certificate_store.initCertStore(SPIFFS, PSTR("/certs.idx"), PSTR("/certs.ar"));
   LOG("Read ");
@@ -56,7 +56,7 @@ void setup() {
 
   // No point trying to send the Google Assistant request if we are running in AP mode.
   if (wifi_setup()) {
-    auth_and_send_request(load_command());
+    auth_and_send_request(load_command().c_str());
 
     // If the user double-presses the reset button, skip sleeping so that they can reconfigure it.
     if (!double_reset) {
@@ -16,9 +16,12 @@ limitations under the License.
 
 #include "module_webserver.h"
 
+#include "api.h"
 #include "assistant.h"
+#include "jobs.h"
 #include "logging.h"
 #include "streamutils.h"
+#include "webserver.h"
 
 #include <Arduino.h>
 #include <ESP8266WebServer.h>
@@ -36,19 +39,26 @@ String load_command() {
   return read_line_from_file("/command.txt");
 }
 
+// Background job to send the saved command to the Assistant, which takes a few seconds.
+static JobState send_saved_command() {
+  return auth_and_send_request(load_command().c_str()) ? JOB_SUCCEEDED : JOB_FAILED;
+}
+
 void module_handle_root_args(ESP8266WebServer &server, String &error) {
   const String &new_command = server.arg("command");
   if (server.hasArg("update") && new_command.length() > 0) {
     update_command(new_command.c_str());
   } else if (server.hasArg("test")) {
     update_command(new_command.c_str());
-    auth_and_send_request(new_command);
+    if (submit_job("test", send_saved_command) == 0) {
+      error = "Too many background jobs.";
+    }
   }
 }
 
-void module_root_output(ESP8266WebServer &server) {
-  server.sendContent(String("<h2>Google account</h2>") +
-    "<a href=\"https://accounts.google.com/o/oauth2/v2/auth?client_id=" + client_id +
+void module_root_output(HtmlWriter &html) {
+  html.render("<h2>Google account</h2>"
+    "<a href=\"https://accounts.google.com/o/oauth2/v2/auth?client_id={}"
     "&scope=https%3A%2F%2Fwww.googleapis.com%2Fauth%2Fassistant-sdk-prototype&access_type=offline"
     "&response_type=code&redirect_uri=urn:ietf:wg:oauth:2.0:oob"
     "&device_id=device_id&device_name=device_name\" target=\"_blank\">Get auth token</a><br/>"
@@ -57,8 +67,54 @@ void module_root_output(ESP8266WebServer &server) {
     "<input type=\"submit\" value=\"Set auth token\"/>"
     "</form>"
     "<h2>Command</h2>"
-    "<form method=\"post\" action=\"/\">" +
-    "Command: <input type=\"text\" name=\"command\" value=\"" + load_command() + "\">"
+    "<form method=\"post\" action=\"/\">"
+    "Command: <input type=\"text\" name=\"command\" value=\"{}\">"
     "<input type=\"submit\" name=\"update\" value=\"Update command\"/>"
-    "<input type=\"submit\" name=\"test\" value=\"Update and test command\"/></form>");
+    "<input type=\"submit\" name=\"test\" value=\"Update and test command\"/></form>", client_id, load_command());
+}
+
+void module_register_metrics() {
+}
+
+static void handle_api_get_command() {
+  if (!authenticate_admin()) {
+    return;
+  }
+  JsonWriter writer(server);
+  writer.begin();
+  writer.begin_object().field("command", load_command()).end_object();
+  writer.end();
+}
+
+static void handle_api_put_command() {
+  if (!authenticate_admin()) {
+    return;
+  }
+  StaticJsonBuffer<API_JSON_BUFFER_SIZE> json_buffer;
+  JsonObject *json = api_parse_object(json_buffer);
+  if (json == nullptr) {
+    return;
+  }
+  const char *command = (*json)["command"];
+  if (command == nullptr || command[0] == '\0') {
+    api_error(400, "Missing command");
+  } else if (!update_command(command)) {
+    api_error(500, "Failed to save command");
+  } else {
+    server.send(204);
+  }
+}
+
+// Send the saved command to the Assistant.
+static void handle_api_test() {
+  if (!authenticate_admin()) {
+    return;
+  }
+  api_submit_job("test", send_saved_command);
+}
+
+void module_api_setup(ESP8266WebServer &server) {
+  server.on(API_PREFIX "/command", HTTP_GET, handle_api_get_command);
+  server.on(API_PREFIX "/command", HTTP_PUT, handle_api_put_command);
+  server.on(API_PREFIX "/test", HTTP_POST, handle_api_test);
 }
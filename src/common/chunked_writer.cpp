@@ -0,0 +1,51 @@
+/*
+Copyright 2018 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ */
+
+#include "chunked_writer.h"
+
+#include <Arduino.h>
+#include <ESP8266WebServer.h>
+
+void ChunkedWriter::begin(int code, const char *content_type) {
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(code, content_type, "");
+}
+
+void ChunkedWriter::end() {
+  flush();
+  // Finish the response.
+  server.sendContent("");
+}
+
+void ChunkedWriter::flush() {
+  if (used > 0) {
+    server.sendContent(buffer, used);
+    used = 0;
+  }
+}
+
+void ChunkedWriter::write(const char *data, size_t length) {
+  while (length > 0) {
+    if (used == sizeof(buffer)) {
+      flush();
+    }
+    size_t chunk = min(length, sizeof(buffer) - used);
+    memcpy(&buffer[used], data, chunk);
+    used += chunk;
+    data += chunk;
+    length -= chunk;
+  }
+}
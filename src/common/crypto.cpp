@@ -0,0 +1,41 @@
+/*
+Copyright 2018 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ */
+
+#include "crypto.h"
+
+#include <Arduino.h>
+#include <bearssl/bearssl_hmac.h>
+
+// Compute the HMAC-SHA256 of the given data with the given key.
+void hmac_sha256(const void *key, size_t key_length, const void *data, size_t length, uint8_t out[HMAC_SHA256_SIZE]) {
+  br_hmac_key_context key_context;
+  br_hmac_context context;
+  br_hmac_key_init(&key_context, &br_sha256_vtable, key, key_length);
+  br_hmac_init(&context, &key_context, 0);
+  br_hmac_update(&context, data, length);
+  br_hmac_out(&context, out);
+}
+
+// Compare two buffers in a time which doesn't depend on where they differ, for checking authentication codes.
+bool constant_time_equal(const void *a, const void *b, size_t length) {
+  const uint8_t *a_bytes = static_cast<const uint8_t *>(a);
+  const uint8_t *b_bytes = static_cast<const uint8_t *>(b);
+  uint8_t difference = 0;
+  for (size_t i = 0; i < length; ++i) {
+    difference |= a_bytes[i] ^ b_bytes[i];
+  }
+  return difference == 0;
+}
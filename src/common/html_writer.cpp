@@ -0,0 +1,60 @@
+/*
+Copyright 2018 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ */
+
+#include "html_writer.h"
+
+#include <Arduino.h>
+
+// Write text, escaped so that it is safe both between tags and in quoted attribute values.
+void HtmlWriter::put(const char *text) {
+  const char *start = text;
+  for (const char *c = text; *c != '\0'; ++c) {
+    const char *entity;
+    switch (*c) {
+      case '&':
+        entity = "&amp;";
+        break;
+      case '<':
+        entity = "&lt;";
+        break;
+      case '>':
+        entity = "&gt;";
+        break;
+      case '"':
+        entity = "&quot;";
+        break;
+      case '\'':
+        entity = "&#39;";
+        break;
+      default:
+        continue;
+    }
+    write(start, c - start);
+    write(entity);
+    start = c + 1;
+  }
+  write(start);
+}
+
+void HtmlWriter::put(long number) {
+  char digits[12];
+  write(digits, snprintf(digits, sizeof(digits), "%ld", number));
+}
+
+void HtmlWriter::put(unsigned long number) {
+  char digits[12];
+  write(digits, snprintf(digits, sizeof(digits), "%lu", number));
+}
@@ -21,6 +21,10 @@ limitations under the License.
 #include <WiFiClient.h>
 #include <WiFiServer.h>
 
+#if EVENT_LOGGING && !ENV_MINIUPDATE
+#include "events.h"
+#endif
+
 #if NETWORK_LOGGING
 WiFiServer log_server(2222);
 WiFiClient log_client;
@@ -32,3 +36,31 @@ WiFiClient get_log_client() {
   return log_client;
 }
 #endif
+
+#if EVENT_LOGGING && !ENV_MINIUPDATE
+// Collects logged text into lines, to publish one event for each.
+class EventLog : public Print {
+public:
+  size_t write(uint8_t c) override {
+    if (c == '\r') {
+      return 1;
+    }
+    if (c != '\n') {
+      line[length++] = c;
+    }
+    if (c == '\n' || length == sizeof(line) - 1) {
+      line[length] = '\0';
+      publish_event("log", "%s", line);
+      length = 0;
+    }
+    return 1;
+  }
+
+private:
+  char line[EVENT_LOG_LINE_SIZE];
+  size_t length = 0;
+};
+
+static EventLog event_log_lines;
+Print &event_log = event_log_lines;
+#endif
@@ -33,6 +33,19 @@ void copyStreamToPrint(Stream &from, Print &to) {
   }
 }
 
+// Update a CRC-32 (as used by zlib) with the given data. Start with a crc of 0.
+uint32_t crc32_update(uint32_t crc, const void *data, size_t length) {
+  const uint8_t *bytes = static_cast<const uint8_t *>(data);
+  crc = ~crc;
+  for (size_t i = 0; i < length; ++i) {
+    crc ^= bytes[i];
+    for (int bit = 0; bit < 8; ++bit) {
+      crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+    }
+  }
+  return ~crc;
+}
+
 bool write_line_to_file(const char *path, const char *token) {
   File tokenFile = SPIFFS.open(path, "w");
   if (!tokenFile) {
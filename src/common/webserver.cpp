@@ -17,19 +17,42 @@ limitations under the License.
 #include "webserver.h"
 
 #include "config.h"
+#include "crypto.h"
+#include "html_writer.h"
 #include "logging.h"
 #include "module_webserver.h"
 #include "streamutils.h"
+#include "web_assets.h"
+#include "wifi.h"
 
 #include <Arduino.h>
 #include <ESP8266WebServer.h>
+#include <ESP8266WiFi.h>
 #include <FS.h>
 #include <time.h>
 
+#if !ENV_MINIUPDATE
+#include "api.h"
+#include "events.h"
+#include "jobs.h"
+#include "metrics.h"
+#endif
+
 ESP8266WebServer server(80);
 static String admin_password;
 static time_t boot_time;
 
+PageStats page_stats;
+AuthStats auth_stats;
+
+// Key for signing session tokens, chosen at random on boot and whenever the admin password changes, so that either
+// revokes all sessions.
+static uint8_t session_key[HMAC_SHA256_SIZE];
+
+#define SESSION_COOKIE "session="
+// 8 hex digits of the time the session started, a '.', then the HMAC in hex.
+#define SESSION_TOKEN_LENGTH (8 + 1 + HMAC_SHA256_SIZE * 2)
+
 bool write_wifi_config(const String &ssid, const String &password) {
   File wifiFile = SPIFFS.open("/wifi.txt", "w");
   if (!wifiFile) {
@@ -51,13 +74,118 @@ bool write_wifi_config(const String &ssid, const String &password) {
 // HTTP request handlers //
 ///////////////////////////
 
-void handle_root() {
-  if (admin_password.length() > 0 && !server.authenticate(ADMIN_USERNAME, admin_password.c_str())) {
+static void rotate_session_key() {
+  for (size_t i = 0; i < HMAC_SHA256_SIZE; i += sizeof(uint32_t)) {
+    uint32_t random = ESP.random();
+    memcpy(&session_key[i], &random, sizeof(random));
+  }
+}
+
+// Make the token for a session started at the given time, which is signed so that only this device can have made it.
+static void session_token(uint32_t started, char token[SESSION_TOKEN_LENGTH + 1]) {
+  snprintf(token, SESSION_TOKEN_LENGTH + 1, "%08lx.", (unsigned long) started);
+  uint8_t tag[HMAC_SHA256_SIZE];
+  hmac_sha256(session_key, sizeof(session_key), token, 8, tag);
+  for (size_t i = 0; i < HMAC_SHA256_SIZE; ++i) {
+    snprintf(&token[9 + i * 2], 3, "%02x", tag[i]);
+  }
+}
+
+// Check the session cookie of the current request, if it has one.
+static bool valid_session() {
+  const String &cookies = server.header("Cookie");
+  int start = 0;
+  if (!cookies.startsWith(SESSION_COOKIE)) {
+    start = cookies.indexOf("; " SESSION_COOKIE);
+    if (start < 0) {
+      return false;
+    }
+    start += 2;
+  }
+  const char *token = cookies.c_str() + start + strlen(SESSION_COOKIE);
+  if (strcspn(token, ";") != SESSION_TOKEN_LENGTH) {
+    return false;
+  }
+  uint32_t started = strtoul(token, nullptr, 16);
+  if (millis() - started >= SESSION_LIFETIME) {
+    return false;
+  }
+  char expected[SESSION_TOKEN_LENGTH + 1];
+  session_token(started, expected);
+  return constant_time_equal(token, expected, SESSION_TOKEN_LENGTH);
+}
+
+// Check that the current request is from the admin, and ask for authentication if not. After a successful digest
+// login, a session cookie lets later requests through without another challenge.
+bool authenticate_admin() {
+  if (admin_password.length() == 0) {
+    return true;
+  }
+  if (valid_session()) {
+    ++auth_stats.sessions;
+    return true;
+  }
+  if (!server.authenticate(ADMIN_USERNAME, admin_password.c_str())) {
+    ++auth_stats.challenges;
     server.requestAuthentication(DIGEST_AUTH, ADMIN_REALM);
+    return false;
+  }
+  ++auth_stats.logins;
+  char token[SESSION_TOKEN_LENGTH + 1];
+  session_token(millis(), token);
+  server.sendHeader("Set-Cookie", String(SESSION_COOKIE) + token + "; Path=/; Max-Age=" + (SESSION_LIFETIME / 1000) +
+    "; HttpOnly; SameSite=Strict");
+  return true;
+}
+
+static void set_admin_password(const String &password) {
+  admin_password = password;
+  rotate_session_key();
+}
+
+// Serve a compressed static file. The page links to it with its ETag in the URL, so browsers can cache it for as long as
+// they like, and still check the ETag if they are asked to reload it.
+static void handle_asset(const WebAsset &asset) {
+  if (server.header("If-None-Match") == asset.etag) {
+    ++page_stats.assets_not_modified;
+    server.send(304);
+    return;
+  }
+  ++page_stats.assets_sent;
+  server.sendHeader("ETag", asset.etag);
+  server.sendHeader("Cache-Control", "public, max-age=31536000, immutable");
+  server.sendHeader("Content-Encoding", "gzip");
+  server.send_P(200, asset.content_type, (PGM_P) asset.data, asset.length);
+}
+
+#if !ENV_MINIUPDATE
+// List background jobs, so that the results of tests and the like started from the page can be seen.
+static void render_jobs(HtmlWriter &html) {
+  bool any = false;
+  for (const Job &job : jobs) {
+    if (job.id == 0) {
+      continue;
+    }
+    if (!any) {
+      html.render("<h2>Background jobs</h2><ul>");
+      any = true;
+    }
+    html.render("<li>{} {}: {}</li>", job.id, job.name, job_state_name(job.state));
+  }
+  if (any) {
+    html.render("</ul>");
+  }
+}
+#endif
+
+void handle_root() {
+  if (!authenticate_admin()) {
     return;
   }
 
   LOGLN("Start handle_root");
+  unsigned long start_micros = micros();
+  uint32_t start_heap = ESP.getFreeHeap();
 
   // If a new SSID and password have been sent, save them.
   const String &new_admin_password = server.arg("admin_password");
@@ -66,7 +194,7 @@ void handle_root() {
   String error;
   if (new_admin_password.length() > 0) {
     if (write_line_to_file("/password.txt", new_admin_password.c_str())) {
-      admin_password = new_admin_password;
+      set_admin_password(new_admin_password);
     } else {
       LOGLN("Failed to save new admin password.");
       error = "Failed to save new admin password.";
@@ -96,73 +224,258 @@ void handle_root() {
   struct tm timeinfo;
   gmtime_r(&now, &timeinfo);
 
-  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
-  server.send(200, "text/html", "");
-  server.sendContent("<html><head><title>");
-  server.sendContent(MDNS_HOSTNAME);
-  server.sendContent(" config</title>"
-    "<style>"
-    "form > ul { list-style: none; padding: 0px }"
-    "form > ul > li { display: flex; flex-wrap: wrap; max-width: 800px }"
-    "form > ul > li > input[type=text] { flex-grow: 1 }"
-    "form > ul > li > span { margin-left: auto }"
-    "form > ul > li > span > input { height: 100% }"
-    "</style>"
+  HtmlWriter html(server);
+  html.begin();
+  html.render("<html><head><title>" MDNS_HOSTNAME " config</title>"
+    "<link rel=\"stylesheet\" href=\"/style.css?v=" STYLE_CSS_ETAG "\"/>"
+    "<script src=\"/app.js?v=" APP_JS_ETAG "\" defer></script>"
     "</head>"
     "<body>"
-    "<h1>");
-  server.sendContent(MDNS_HOSTNAME);
-  server.sendContent(" config</h1>");
+    "<h1>" MDNS_HOSTNAME " config</h1>");
   if (!error.isEmpty()) {
-    server.sendContent("<p style=\"color: red;\">");
-    server.sendContent(error);
-    server.sendContent("</p>");
+    html.render("<p class=\"error\">{}</p>", error);
   }
-  server.sendContent("<p>Device time: ");
-  server.sendContent(asctime(&timeinfo));
-  server.sendContent("UTC</p>"
+  html.render("<p>Device time: {}UTC</p>"
     "<h2>WiFi config</h2>"
     "<form method=\"post\" action=\"/\">"
-    "SSID: <input type=\"text\" name=\"ssid\" value=\"" + ssid + "\"/><br/>"
-    "Password: <input type=\"text\" name=\"password\" value=\"" + password + "\"/><br/>"
+    "SSID: <input type=\"text\" name=\"ssid\" value=\"{}\"/><br/>"
+    "Password: <input type=\"text\" name=\"password\" value=\"{}\"/><br/>"
     "<input type=\"submit\" value=\"Update WiFi config\"/>"
     "</form>"
     "<h2>Admin password</h2>"
     "<form method=\"post\" action=\"/\">"
-    "<input type=\"text\" name=\"admin_password\" value=\"" + admin_password + "\"/>"
+    "<input type=\"text\" name=\"admin_password\" value=\"{}\"/>"
     "<br/>"
     "<input type=\"submit\" value=\"Update admin password\"/>"
-    "</form>");
-  module_root_output(server);
-  server.sendContent("</body></html>");
-  // Finish the page.
-  server.sendContent("");
+    "</form>", asctime(&timeinfo), ssid, password, admin_password);
+#if !ENV_MINIUPDATE
+  render_jobs(html);
+#endif
+  module_root_output(html);
+#if !ENV_MINIUPDATE
+  html.render("<h2>Events</h2><ul id=\"events\"></ul>");
+#endif
+  html.render("</body></html>");
+  html.end();
+  ++page_stats.root_renders;
+  page_stats.root_render_micros += micros() - start_micros;
+  // The heap should be back where it started, so any difference is a leak or fragmentation.
+  page_stats.root_heap_change = (int32_t) ESP.getFreeHeap() - (int32_t) start_heap;
   LOGLN("Finish handle_root");
 }
 
+#if !ENV_MINIUPDATE
 void handle_metrics() {
+  if (!authenticate_admin()) {
+    return;
+  }
   LOGLN("handle_metrics");
-  String page = String() +
-    "# TYPE free_heap gauge\n"
-    "# UNIT free_heap bytes\n"
-    "free_heap " + ESP.getFreeHeap() + "\n"
-    "# TYPE max_free_block_size gauge\n"
-    "# UNIT max_free_block_size bytes\n"
-    "max_free_block_size " + ESP.getMaxFreeBlockSize() + "\n"
-    "# TYPE node_boot_time_seconds gauge\n"
-    "# UNIT node_boot_time_seconds seconds\n"
-    "node_boot_time_seconds " + boot_time + "\n";
+  MetricWriter writer(server);
+  writer.begin();
+  write_metrics(writer);
+  writer.end();
+}
+
+static int64_t free_heap() {
+  return ESP.getFreeHeap();
+}
+
+static int64_t max_free_block_size() {
+  return ESP.getMaxFreeBlockSize();
+}
+
+static int64_t boot_time_seconds() {
+  return boot_time;
+}
+
+static int64_t uptime_micros() {
+  return micros64();
+}
+
+static int64_t wifi_rssi() {
+  return WiFi.RSSI();
+}
+
+static int64_t spiffs_used() {
+  FSInfo info;
+  return SPIFFS.info(info) ? info.usedBytes : 0;
+}
+
+static int64_t spiffs_total() {
+  FSInfo info;
+  return SPIFFS.info(info) ? info.totalBytes : 0;
+}
+
+// Labels for the reason of the last reset, indexed by rst_info::reason.
+static const char *const reset_reason_labels[] = {
+  "reason=\"power_on\"",
+  "reason=\"hardware_watchdog\"",
+  "reason=\"exception\"",
+  "reason=\"software_watchdog\"",
+  "reason=\"software_restart\"",
+  "reason=\"deep_sleep_awake\"",
+  "reason=\"external_reset\"",
+};
+static const uint32_t one = 1;
+
+static void register_webserver_metrics() {
+  register_gauge("free_heap", free_heap).unit("bytes");
+  register_gauge("max_free_block_size", max_free_block_size).unit("bytes");
+  register_gauge("node_boot_time_seconds", boot_time_seconds).unit("seconds");
+  register_gauge("uptime_seconds", uptime_micros).unit("seconds").scale(6);
+  uint32_t reset_reason = ESP.getResetInfoPtr()->reason;
+  if (reset_reason < sizeof(reset_reason_labels) / sizeof(reset_reason_labels[0])) {
+    register_gauge("reset_reason", &one).labels(reset_reason_labels[reset_reason]);
+  }
+  register_gauge("wifi_rssi_dbm", wifi_rssi);
+  register_counter("wifi_disconnects_total", &wifi_stats.disconnects);
+  register_gauge("spiffs_used_bytes", spiffs_used).unit("bytes");
+  register_gauge("spiffs_total_bytes", spiffs_total).unit("bytes");
+  register_summary("http_root_render_seconds", &page_stats.root_render_micros, &page_stats.root_renders, 6);
+  register_gauge("http_root_heap_change", &page_stats.root_heap_change).unit("bytes");
+  register_counter("http_asset_requests_total", &page_stats.assets_sent).labels("result=\"sent\"");
+  register_counter("http_asset_requests_total", &page_stats.assets_not_modified).labels("result=\"not_modified\"");
+  register_counter("http_admin_auth_total", &auth_stats.sessions).labels("result=\"session\"");
+  register_counter("http_admin_auth_total", &auth_stats.logins).labels("result=\"login\"");
+  register_counter("http_admin_auth_total", &auth_stats.challenges).labels("result=\"challenge\"");
+  register_counter("background_jobs_total", &job_stats.succeeded).labels("result=\"succeeded\"");
+  register_counter("background_jobs_total", &job_stats.failed).labels("result=\"failed\"");
+  register_counter("background_jobs_total", &job_stats.rejected).labels("result=\"rejected\"");
+  register_gauge("background_job_max_step_seconds", &job_stats.max_step_micros).scale(6);
+  register_histogram("loop_duration_seconds", &loop_durations).scale(6);
+  register_gauge("loop_duration_max_seconds", &max_loop_micros).scale(6);
+}
+
+static void handle_api_status() {
+  if (!authenticate_admin()) {
+    return;
+  }
+  JsonWriter writer(server);
+  writer.begin();
+  writer.begin_object()
+    .field("hostname", MDNS_HOSTNAME)
+    .field("time", (long) time(nullptr))
+    .field("boot_time", (long) boot_time)
+    .field("free_heap", ESP.getFreeHeap())
+    .field("max_free_block_size", ESP.getMaxFreeBlockSize())
+    .end_object();
+  writer.end();
+}
 
-  server.send(200, "text/plain", page);
+static void write_job(JsonWriter &writer, const Job &job) {
+  writer.begin_object()
+    .field("id", job.id)
+    .field("name", job.name)
+    .field("state", job_state_name(job.state))
+    .field("age_ms", millis() - job.submitted_millis)
+    .field("run_us", job.run_micros)
+    .end_object();
 }
 
+// Get the status of the background job with the given ID, or of all of them.
+static void handle_api_jobs() {
+  if (!authenticate_admin()) {
+    return;
+  }
+  if (server.hasArg("id")) {
+    const Job *job = find_job(server.arg("id").toInt());
+    if (job == nullptr) {
+      api_error(404, "No such job");
+      return;
+    }
+    JsonWriter writer(server);
+    writer.begin();
+    write_job(writer, *job);
+    writer.end();
+    return;
+  }
+  JsonWriter writer(server);
+  writer.begin();
+  writer.begin_array();
+  for (const Job &job : jobs) {
+    if (job.id != 0) {
+      write_job(writer, job);
+    }
+  }
+  writer.end_array();
+  writer.end();
+}
+
+static void handle_api_get_wifi() {
+  if (!authenticate_admin()) {
+    return;
+  }
+  String ssid = read_line_from_file("/wifi.txt");
+  JsonWriter writer(server);
+  writer.begin();
+  writer.begin_object().field("ssid", ssid).end_object();
+  writer.end();
+}
+
+static void handle_api_put_wifi() {
+  if (!authenticate_admin()) {
+    return;
+  }
+  StaticJsonBuffer<API_JSON_BUFFER_SIZE> json_buffer;
+  JsonObject *json = api_parse_object(json_buffer);
+  if (json == nullptr) {
+    return;
+  }
+  const char *ssid = (*json)["ssid"];
+  const char *password = (*json)["password"];
+  if (ssid == nullptr || ssid[0] == '\0') {
+    api_error(400, "Missing ssid");
+  } else if (!write_wifi_config(ssid, password != nullptr ? password : "")) {
+    api_error(500, "Failed to write WiFi config");
+  } else {
+    server.send(204);
+  }
+}
+
+static void handle_api_put_admin_password() {
+  if (!authenticate_admin()) {
+    return;
+  }
+  StaticJsonBuffer<API_JSON_BUFFER_SIZE> json_buffer;
+  JsonObject *json = api_parse_object(json_buffer);
+  if (json == nullptr) {
+    return;
+  }
+  const char *password = (*json)["password"];
+  if (password == nullptr || password[0] == '\0') {
+    api_error(400, "Missing password");
+  } else if (!write_line_to_file("/password.txt", password)) {
+    api_error(500, "Failed to save new admin password");
+  } else {
+    set_admin_password(password);
+    server.send(204);
+  }
+}
+#endif
+
 // Run web server to let the user authenticate their account.
 void start_webserver() {
-  admin_password = read_line_from_file("/password.txt");
+  set_admin_password(read_line_from_file("/password.txt"));
   boot_time = time(nullptr);
 
   server.on("/", handle_root);
+#if !ENV_MINIUPDATE
   server.on("/metrics", handle_metrics);
+  server.on(API_PREFIX "/status", HTTP_GET, handle_api_status);
+  server.on(API_PREFIX "/wifi", HTTP_GET, handle_api_get_wifi);
+  server.on(API_PREFIX "/wifi", HTTP_PUT, handle_api_put_wifi);
+  server.on(API_PREFIX "/admin_password", HTTP_PUT, handle_api_put_admin_password);
+  server.on(API_PREFIX "/jobs", HTTP_GET, handle_api_jobs);
+  events_setup(server);
+  module_api_setup(server);
+  register_webserver_metrics();
+  module_register_metrics();
+#endif
+  for (const WebAsset &asset : web_assets) {
+    server.on(asset.path, [&asset]() { handle_asset(asset); });
+  }
+  static const char *headers[] = {"If-None-Match", "Cookie"};
+  server.collectHeaders(headers, 2);
 
   server.begin();
   LOGLN("HTTP server started");
@@ -170,4 +483,9 @@ void start_webserver() {
 
 void webserver_loop() {
   server.handleClient();
+#if !ENV_MINIUPDATE
+  // Slow work started by a request runs here, after the response has been sent.
+  jobs_loop();
+  events_loop();
+#endif
 }
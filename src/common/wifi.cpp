@@ -24,6 +24,13 @@ limitations under the License.
 #include <FS.h>
 #include <time.h>
 
+WifiStats wifi_stats;
+static WiFiEventHandler disconnected_handler;
+
+static void handle_disconnected(const WiFiEventStationModeDisconnected &event) {
+  ++wifi_stats.disconnects;
+}
+
 void sync_time() {
   const time_t min_time = 3600 * 48;
 
@@ -63,6 +70,7 @@ bool wifi_connect() {
   LOG(password.c_str());
   LOGLN("'");
   WiFi.mode(WIFI_STA);
+  disconnected_handler = WiFi.onStationModeDisconnected(handle_disconnected);
   // Use mDNS hostname for DHCP too
   WiFi.hostname(MDNS_HOSTNAME);
   WiFi.begin(ssid.c_str(), password.c_str());
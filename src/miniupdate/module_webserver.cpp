@@ -22,5 +22,5 @@ limitations under the License.
 void module_handle_root_args(ESP8266WebServer &server, String &error) {
 }
 
-void module_root_output(ESP8266WebServer &server) {
+void module_root_output(HtmlWriter &html) {
 }
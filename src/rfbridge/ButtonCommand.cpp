@@ -30,14 +30,35 @@ static uint8_t hex_char_to_nibble(char c) {
   }
 }
 
-RfCode RfCode::from_hex(const String &hex_string) {
+static uint8_t hex_to_byte(const char *hex_string) {
+  return (hex_char_to_nibble(hex_string[0]) << 4) + hex_char_to_nibble(hex_string[1]);
+}
+
+// Parse either just the data bytes, or the timings followed by the data bytes as written by to_hex.
+RfCode RfCode::from_hex(const char *hex_string) {
   RfCode result;
-  if (hex_string.length() != RF_CODE_LENGTH * 2) {
+  size_t length = strlen(hex_string);
+  if (length == RF_CODE_HEX_SIZE - 1) {
+    for (int i = 0; i < RF_TIMING_COUNT; ++i) {
+      result.timings[i] = (hex_to_byte(hex_string) << 8) + hex_to_byte(hex_string + 2);
+      hex_string += 4;
+    }
+  } else if (length != RF_CODE_LENGTH * 2) {
     return result;
   }
   for (int i = 0; i < RF_CODE_LENGTH; ++i) {
-    result.bytes[i] = (hex_char_to_nibble(hex_string.charAt(2 * i)) << 4) + hex_char_to_nibble(hex_string.charAt(2 * i + 1));
+    result.bytes[i] = hex_to_byte(hex_string + 2 * i);
+  }
+  return result;
+}
+
+// Parse the body of an 0xA3 or 0xA4 message from the RF module, starting after the 0xAA and message type.
+RfCode RfCode::from_message(const uint8_t *buffer) {
+  RfCode result;
+  for (int i = 0; i < RF_TIMING_COUNT; ++i) {
+    result.timings[i] = (buffer[2 * i] << 8) + buffer[2 * i + 1];
   }
+  result.copy_from(&buffer[RF_TIMING_COUNT * 2]);
   return result;
 }
 
@@ -45,13 +66,38 @@ void RfCode::copy_from(const uint8_t *buffer) {
   memcpy(bytes, buffer, RF_CODE_LENGTH);
 }
 
-String RfCode::to_hex() const {
-  String result;
-    for (int i = 0; i < RF_CODE_LENGTH; ++i) {
-      if (bytes[i] < 16) {
-        result += '0';
-      }
-      result += String(bytes[i], HEX);
+// Write the timings and data bytes in the same format as from_message reads them.
+void RfCode::to_message(uint8_t *buffer) const {
+  for (int i = 0; i < RF_TIMING_COUNT; ++i) {
+    buffer[2 * i] = timings[i] >> 8;
+    buffer[2 * i + 1] = timings[i] & 0xff;
   }
-  return result;
+  memcpy(&buffer[RF_TIMING_COUNT * 2], bytes, RF_CODE_LENGTH);
+}
+
+// Get the largest difference between the timings of this code and a received code, as a percentage of this code's
+// timings. Timings which are unknown for this code are ignored.
+uint8_t RfCode::timing_error(const RfCode &received) const {
+  uint32_t max_error = 0;
+  for (int i = 0; i < RF_TIMING_COUNT; ++i) {
+    if (timings[i] == 0) {
+      continue;
+    }
+    uint32_t difference = received.timings[i] > timings[i] ? received.timings[i] - timings[i] : timings[i] - received.timings[i];
+    uint32_t error = difference * 100 / timings[i];
+    if (error > max_error) {
+      max_error = error;
+    }
+  }
+  return max_error > 255 ? 255 : max_error;
+}
+
+// Format the timings and data bytes as hex into the given buffer, and return it.
+const char *RfCode::to_hex(char buffer[RF_CODE_HEX_SIZE]) const {
+  uint8_t message[RF_TIMING_COUNT * 2 + RF_CODE_LENGTH];
+  to_message(message);
+  for (size_t i = 0; i < sizeof(message); ++i) {
+    snprintf(&buffer[2 * i], 3, "%02x", message[i]);
+  }
+  return buffer;
 }
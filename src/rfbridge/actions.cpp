@@ -0,0 +1,290 @@
+/*
+Copyright 2018 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ */
+
+#include "actions.h"
+
+#include "assistant.h"
+#include "config.h"
+#include "events.h"
+#include "logging.h"
+#include "rf.h"
+#include "streamutils.h"
+#include "ButtonCommand.h"
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <WebSocketsClient.h>
+#include <WiFiClient.h>
+#include <WiFiUdp.h>
+
+const char *const action_names[ACTION_TYPE_COUNT] = {"assistant", "http", "udp", "websocket", "rf"};
+ActionStats action_stats[ACTION_TYPE_COUNT];
+
+#define MAX_HOST_LENGTH 64
+
+// A host, port and path parsed from a command's target.
+struct Target {
+  char host[MAX_HOST_LENGTH];
+  uint16_t port;
+  const char *path;
+};
+
+// An HTTP connection which is kept open after a request, to save connecting again for the next one.
+struct HttpConnection {
+  WiFiClient client;
+  char host[MAX_HOST_LENGTH];
+  uint16_t port;
+  unsigned long last_used;
+};
+
+static HttpConnection http_connections[LOCAL_HTTP_CONNECTIONS];
+static WiFiUDP udp;
+static WebSocketsClient websocket;
+static char websocket_target[MAX_COMMAND_LENGTH];
+static bool websocket_connected = false;
+
+// Parse a target of the form "host[:port][/path]", with an optional "http://" or "ws://" prefix.
+static bool parse_target(const char *target, uint16_t default_port, Target *result) {
+  const char *scheme_end = strstr(target, "://");
+  if (scheme_end != nullptr) {
+    target = scheme_end + 3;
+  }
+  size_t host_length = strcspn(target, ":/");
+  if (host_length == 0 || host_length >= MAX_HOST_LENGTH) {
+    return false;
+  }
+  memcpy(result->host, target, host_length);
+  result->host[host_length] = '\0';
+  const char *rest = target + host_length;
+  result->port = default_port;
+  if (*rest == ':') {
+    result->port = strtoul(rest + 1, const_cast<char **>(&rest), 10);
+  }
+  result->path = *rest == '/' ? rest : "/";
+  return result->port != 0;
+}
+
+// Get an open connection to the given host and port, reusing one if possible.
+static HttpConnection *get_http_connection(const Target &target, bool *reused) {
+  HttpConnection *oldest = &http_connections[0];
+  for (size_t i = 0; i < LOCAL_HTTP_CONNECTIONS; ++i) {
+    HttpConnection &connection = http_connections[i];
+    if (connection.port == target.port && strcmp(connection.host, target.host) == 0 && connection.client.connected()) {
+      *reused = true;
+      return &connection;
+    }
+    if (connection.last_used < oldest->last_used) {
+      oldest = &connection;
+    }
+  }
+  *reused = false;
+  oldest->client.stop();
+  oldest->port = 0;
+  oldest->client.setTimeout(LOCAL_ACTION_TIMEOUT);
+  if (!oldest->client.connect(target.host, target.port)) {
+    LOG("Failed to connect to ");
+    LOGLN(target.host);
+    return nullptr;
+  }
+  oldest->client.setNoDelay(true);
+  safe_copy(target.host, oldest->host);
+  oldest->port = target.port;
+  return oldest;
+}
+
+// Send one POST request on the given connection and read the response. Returns whether the server responded with
+// success. Sets responded to whether anything at all was received back, and keep_alive to whether the connection can be
+// used again.
+static bool send_http_request(WiFiClient &client, const Target &target, const char *body, bool *responded,
+    bool *keep_alive) {
+  *responded = false;
+  *keep_alive = false;
+  size_t body_length = strlen(body);
+  size_t header_length = client.printf("POST %s HTTP/1.1\r\n"
+    "Host: %s\r\n"
+    "User-Agent: qbutton\r\n"
+    "Content-Type: text/plain\r\n"
+    "Content-Length: %u\r\n"
+    "\r\n", target.path, target.host, (unsigned int) body_length);
+  if (header_length == 0 || client.write((const uint8_t *) body, body_length) != body_length) {
+    return false;
+  }
+
+  char line[64];
+  size_t length = client.readBytesUntil('\n', line, sizeof(line) - 1);
+  line[length] = '\0';
+  *responded = length > 0;
+  if (strncmp(line, "HTTP/1.", 7) != 0 || length < 12) {
+    return false;
+  }
+  bool success = line[9] == '2';
+
+  // Read headers to find out how much body to skip, and whether the server will keep the connection open.
+  long content_length = -1;
+  *keep_alive = line[7] == '1';
+  while (true) {
+    length = client.readBytesUntil('\n', line, sizeof(line) - 1);
+    line[length] = '\0';
+    if (length == 0 || strcmp(line, "\r") == 0) {
+      break;
+    }
+    if (strncasecmp(line, "Content-Length:", 15) == 0) {
+      content_length = atol(&line[15]);
+    } else if (strncasecmp(line, "Connection:", 11) == 0 && strstr(line, "close") != nullptr) {
+      *keep_alive = false;
+    }
+  }
+  if (content_length < 0) {
+    *keep_alive = false;
+  }
+  while (content_length > 0) {
+    length = client.readBytes((uint8_t *) line, min((long) sizeof(line), content_length));
+    if (length == 0) {
+      *keep_alive = false;
+      break;
+    }
+    content_length -= length;
+  }
+  return success;
+}
+
+static bool send_http(const char *target_string, const char *body) {
+  Target target;
+  if (!parse_target(target_string, 80, &target)) {
+    LOGLN("Invalid HTTP target");
+    return false;
+  }
+  bool reused;
+  HttpConnection *connection = get_http_connection(target, &reused);
+  if (connection == nullptr) {
+    return false;
+  }
+  bool responded;
+  bool keep_alive;
+  bool success = send_http_request(connection->client, target, body, &responded, &keep_alive);
+  if (!responded && reused) {
+    // The server may have closed the connection while it was idle, so try once more with a new one. Once the server has
+    // answered, even with an error, the request must not be sent again.
+    LOGLN("Request on reused connection failed, reconnecting");
+    connection->client.stop();
+    connection = get_http_connection(target, &reused);
+    if (connection == nullptr) {
+      return false;
+    }
+    success = send_http_request(connection->client, target, body, &responded, &keep_alive);
+  }
+  connection->last_used = millis();
+  if (!keep_alive) {
+    connection->client.stop();
+    connection->port = 0;
+  }
+  return success;
+}
+
+static bool send_udp(const char *target_string, const char *body) {
+  Target target;
+  if (!parse_target(target_string, 0, &target)) {
+    LOGLN("Invalid UDP target, port is required");
+    return false;
+  }
+  if (!udp.beginPacket(target.host, target.port)) {
+    LOG("Failed to resolve ");
+    LOGLN(target.host);
+    return false;
+  }
+  udp.write((const uint8_t *) body, strlen(body));
+  return udp.endPacket() == 1;
+}
+
+static void websocket_event(WStype_t type, uint8_t *payload, size_t length) {
+  switch (type) {
+    case WStype_DISCONNECTED:
+      websocket_connected = false;
+      break;
+    case WStype_CONNECTED:
+      websocket_connected = true;
+      break;
+    default:
+      break;
+  }
+}
+
+// Send a text message to the given websocket server. The connection is kept open for as long as commands keep being
+// sent to the same target.
+static bool send_websocket(const char *target_string, const char *body) {
+  if (strcmp(target_string, websocket_target) != 0) {
+    Target target;
+    if (!parse_target(target_string, 80, &target)) {
+      LOGLN("Invalid websocket target");
+      return false;
+    }
+    websocket.disconnect();
+    websocket_connected = false;
+    websocket.onEvent(websocket_event);
+    websocket.begin(target.host, target.port, target.path);
+    websocket.setReconnectInterval(LOCAL_ACTION_TIMEOUT);
+    safe_copy(target_string, websocket_target);
+  }
+  unsigned long start_time = millis();
+  while (!websocket_connected && millis() - start_time < LOCAL_ACTION_TIMEOUT) {
+    websocket.loop();
+    yield();
+  }
+  if (!websocket_connected) {
+    LOGLN("Failed to connect to websocket");
+    return false;
+  }
+  return websocket.sendTXT(body);
+}
+
+// Send the given command to its target. Returns true on success.
+bool run_action(const ButtonCommand &button_command) {
+  switch (button_command.action) {
+    case ACTION_ASSISTANT:
+      return auth_and_send_request(button_command.command());
+    case ACTION_HTTP:
+      return send_http(button_command.target(), button_command.command());
+    case ACTION_UDP:
+      return send_udp(button_command.target(), button_command.command());
+    case ACTION_WEBSOCKET:
+      return send_websocket(button_command.target(), button_command.command());
+    case ACTION_RF:
+      return queue_transmit(button_command.target());
+    default:
+      return false;
+  }
+}
+
+void record_action_result(ActionType action, bool success, uint32_t latency) {
+  publish_event("action", "{\"action\":\"%s\",\"success\":%s,\"latency_ms\":%lu}", action_names[action],
+    success ? "true" : "false", (unsigned long) latency);
+  ActionStats &stats = action_stats[action];
+  if (success) {
+    ++stats.successes;
+    stats.latency_sum += latency;
+    if (latency > stats.max_latency) {
+      stats.max_latency = latency;
+    }
+  } else {
+    ++stats.failures;
+  }
+}
+
+void actions_loop() {
+  if (websocket_target[0] != '\0') {
+    websocket.loop();
+  }
+}
@@ -0,0 +1,102 @@
+/*
+Copyright 2018 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ */
+
+#include "command_arena.h"
+
+#include "config.h"
+#include "logging.h"
+#include "rf.h"
+#include "ButtonCommand.h"
+
+#include <Arduino.h>
+
+// The text and targets of all commands, stored one after another with NUL terminators. Text which is replaced or
+// removed is left where it is until the arena is full, when the remaining text is compacted to the start.
+static char arena[COMMAND_ARENA_SIZE];
+static size_t arena_end = 0;
+
+const char *arena_text(uint16_t offset) {
+  if (offset == NO_TEXT) {
+    return "";
+  }
+  return &arena[offset];
+}
+
+// Copy the given text to the end of the arena, and set offset to point to it. Text too long to send as a command is
+// truncated. Returns false if there isn't room for it even after compacting.
+bool arena_store(const char *text, uint16_t *offset) {
+  size_t length = strnlen(text, MAX_COMMAND_LENGTH - 1);
+  char copy[MAX_COMMAND_LENGTH];
+  if (arena_end + length + 1 > COMMAND_ARENA_SIZE) {
+    // The text may be in the arena itself, such as a command's current target, which compacting would move.
+    memcpy(copy, text, length);
+    text = copy;
+    compact_arena();
+    if (arena_end + length + 1 > COMMAND_ARENA_SIZE) {
+      LOGLN("Command arena is full.");
+      return false;
+    }
+  }
+  memcpy(&arena[arena_end], text, length);
+  arena[arena_end + length] = '\0';
+  *offset = arena_end;
+  arena_end += length + 1;
+  return true;
+}
+
+void arena_clear() {
+  arena_end = 0;
+}
+
+// Move the text of all commands to the start of the arena, in the same order, dropping any text which is no longer used.
+void compact_arena() {
+  // Find all live text, sorted by offset.
+  uint16_t *references[MAX_COMMANDS * 2];
+  size_t reference_count = 0;
+  for (size_t i = 0; i < button_commands.size() * 2; ++i) {
+    uint16_t *reference = i % 2 == 0 ? &button_commands[i / 2].command_offset : &button_commands[i / 2].target_offset;
+    if (*reference == NO_TEXT) {
+      continue;
+    }
+    size_t j = reference_count++;
+    while (j > 0 && *references[j - 1] > *reference) {
+      references[j] = references[j - 1];
+      --j;
+    }
+    references[j] = reference;
+  }
+
+  // Slide each one down over any unused space before it.
+  size_t new_end = 0;
+  for (size_t i = 0; i < reference_count; ++i) {
+    uint16_t offset = *references[i];
+    size_t length = strlen(&arena[offset]) + 1;
+    if (offset != new_end) {
+      memmove(&arena[new_end], &arena[offset], length);
+      *references[i] = new_end;
+    }
+    new_end += length;
+  }
+  LOG("Compacted command arena from ");
+  LOG(arena_end);
+  LOG(" to ");
+  LOGLN(new_end);
+  arena_end = new_end;
+}
+
+size_t arena_used() {
+  return arena_end;
+}
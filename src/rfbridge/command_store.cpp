@@ -0,0 +1,499 @@
+/*
+Copyright 2018 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ */
+
+#include "command_store.h"
+
+#include "command_arena.h"
+#include "config.h"
+#include "logging.h"
+#include "rf.h"
+#include "streamutils.h"
+#include "ButtonCommand.h"
+
+#include <Arduino.h>
+#include <FS.h>
+
+// The command table is stored as a log of changes. Each record is a type byte, a 2 byte payload length, the payload,
+// and a CRC-32 of everything before it. Replaying the log from the start rebuilds the table. A record which is cut
+// short or fails its CRC, such as when power was lost while writing it, ends the log. An intact record which can't be
+// applied, such as one referring to a command index which doesn't exist, is skipped.
+//
+// To compact the log, a new log with one add record per command is written and then renamed over the old one. If power
+// is lost part way through, load_commands can tell from which files exist which of the two logs is complete.
+static const char *log_path = "/commands.log";
+static const char *new_log_path = "/commands.new";
+// The old text format, which is converted to a log on first boot.
+static const char *legacy_path = "/commands.txt";
+// Statistics for each command, saved periodically. These are less important than the commands themselves so are just
+// rewritten each time, with a CRC to detect if that was interrupted.
+static const char *stats_path = "/command_stats.bin";
+
+enum RecordType {
+  // Payload: code in the format of an RF module message, followed by the command. For actions other than the
+  // Assistant, the command is followed by a NUL, the action type byte and the target.
+  RECORD_ADD = 1,
+  // Payload: 2 byte index, followed by the new command.
+  RECORD_UPDATE = 2,
+  // Payload: 2 byte index.
+  RECORD_REMOVE = 3,
+  // Payload: 2 byte index, action type byte, followed by the new target.
+  RECORD_SET_ACTION = 4,
+};
+
+#define RECORD_HEADER_SIZE 3
+#define RECORD_CRC_SIZE 4
+#define RECORD_CODE_SIZE (RF_TIMING_COUNT * 2 + RF_CODE_LENGTH)
+#define RECORD_INDEX_SIZE 2
+#define RECORD_ACTION_SIZE (RECORD_INDEX_SIZE + 1)
+#define MAX_RECORD_PAYLOAD_SIZE (RECORD_CODE_SIZE + MAX_COMMAND_LENGTH * 2 + 1)
+#define MAX_RECORD_SIZE (RECORD_HEADER_SIZE + MAX_RECORD_PAYLOAD_SIZE + RECORD_CRC_SIZE)
+
+static uint8_t record_buffer[MAX_RECORD_SIZE];
+static uint8_t *const record_payload = &record_buffer[RECORD_HEADER_SIZE];
+// Set if the log ends in a damaged record, after which nothing can be appended until it is compacted.
+static bool log_damaged = false;
+static size_t log_record_count = 0;
+static unsigned long stats_saved_time = 0;
+// Total matches and rejects of all commands when their statistics were last saved or loaded.
+static uint32_t saved_stats_activity = 0;
+
+static void put_uint16(uint8_t *buffer, uint16_t value) {
+  buffer[0] = value & 0xff;
+  buffer[1] = value >> 8;
+}
+
+static uint16_t get_uint16(const uint8_t *buffer) {
+  return buffer[0] | (buffer[1] << 8);
+}
+
+static void put_uint32(uint8_t *buffer, uint32_t value) {
+  put_uint16(buffer, value & 0xffff);
+  put_uint16(buffer + 2, value >> 16);
+}
+
+static uint32_t get_uint32(const uint8_t *buffer) {
+  return get_uint16(buffer) | ((uint32_t) get_uint16(buffer + 2) << 16);
+}
+
+// Whether the text fits in MAX_COMMAND_LENGTH with its NUL. Longer commands and targets are rejected rather than
+// truncated, so that the log and the arena always hold the same text.
+static bool command_fits(const char *text) {
+  if (strnlen(text, MAX_COMMAND_LENGTH) < MAX_COMMAND_LENGTH) {
+    return true;
+  }
+  LOGLN("Command is too long.");
+  return false;
+}
+
+// Copy the command into a record, without the terminating NUL, and return the length copied.
+static size_t put_command(uint8_t *buffer, const char *command) {
+  size_t length = strlen(command);
+  memcpy(buffer, command, length);
+  return length;
+}
+
+// Fill in the header and CRC of the record whose payload has already been written after RECORD_HEADER_SIZE bytes, and
+// return the total length of the record.
+static size_t finish_record(uint8_t *record, RecordType type, size_t payload_length) {
+  record[0] = type;
+  put_uint16(&record[1], payload_length);
+  uint32_t crc = crc32_update(0, record, RECORD_HEADER_SIZE + payload_length);
+  put_uint32(&record[RECORD_HEADER_SIZE + payload_length], crc);
+  return RECORD_HEADER_SIZE + payload_length + RECORD_CRC_SIZE;
+}
+
+// Build the record to add the command at the given index, and return its length.
+static size_t build_add_record(size_t i) {
+  const ButtonCommand &button_command = button_commands[i];
+  button_command.code.to_message(record_payload);
+  size_t payload_length = RECORD_CODE_SIZE;
+  payload_length += put_command(&record_payload[payload_length], button_command.command());
+  if (button_command.action != ACTION_ASSISTANT) {
+    record_payload[payload_length++] = '\0';
+    record_payload[payload_length++] = button_command.action;
+    payload_length += put_command(&record_payload[payload_length], button_command.target());
+  }
+  return finish_record(record_buffer, RECORD_ADD, payload_length);
+}
+
+// Add a command to the end of button_commands. The command is added before its text is stored, so that the text is
+// kept if storing it compacts the arena.
+static bool push_command(const RfCode &code, const char *command, ActionType action, const char *target) {
+  if (button_commands.size() >= MAX_COMMANDS || !command_fits(command) ||
+      (action != ACTION_ASSISTANT && !command_fits(target))) {
+    return false;
+  }
+  ButtonCommand button_command;
+  button_command.code = code;
+  button_command.action = action;
+  button_commands.push_back(button_command);
+  ButtonCommand &added = button_commands[button_commands.size() - 1];
+  if (!arena_store(command, &added.command_offset) ||
+      (action != ACTION_ASSISTANT && !arena_store(target, &added.target_offset))) {
+    button_commands.remove(button_commands.size() - 1);
+    return false;
+  }
+  return true;
+}
+
+// Read the next record into record_buffer, and return whether it is complete and intact.
+static bool read_record(File &file, size_t *payload_length) {
+  if (file.read(record_buffer, RECORD_HEADER_SIZE) != RECORD_HEADER_SIZE) {
+    return false;
+  }
+  *payload_length = get_uint16(&record_buffer[1]);
+  if (*payload_length > MAX_RECORD_PAYLOAD_SIZE) {
+    return false;
+  }
+  size_t remaining_length = *payload_length + RECORD_CRC_SIZE;
+  if (file.read(record_payload, remaining_length) != remaining_length) {
+    return false;
+  }
+  uint32_t crc = crc32_update(0, record_buffer, RECORD_HEADER_SIZE + *payload_length);
+  return get_uint32(&record_payload[*payload_length]) == crc;
+}
+
+// Apply the record in record_buffer to button_commands.
+static bool apply_record(size_t payload_length) {
+  switch (record_buffer[0]) {
+    case RECORD_ADD: {
+      if (payload_length < RECORD_CODE_SIZE) {
+        return false;
+      }
+      // The CRC has already been checked, so it can be overwritten to terminate the command.
+      record_payload[payload_length] = '\0';
+      const char *command = (const char *) &record_payload[RECORD_CODE_SIZE];
+      size_t command_end = RECORD_CODE_SIZE + strlen(command);
+      ActionType action = ACTION_ASSISTANT;
+      const char *target = "";
+      if (command_end < payload_length) {
+        if (command_end + 1 >= payload_length || record_payload[command_end + 1] >= ACTION_TYPE_COUNT) {
+          return false;
+        }
+        action = (ActionType) record_payload[command_end + 1];
+        target = (const char *) &record_payload[command_end + 2];
+      }
+      return push_command(RfCode::from_message(record_payload), command, action, target);
+    }
+    case RECORD_UPDATE: {
+      if (payload_length < RECORD_INDEX_SIZE) {
+        return false;
+      }
+      size_t i = get_uint16(record_payload);
+      if (i >= button_commands.size()) {
+        return false;
+      }
+      record_payload[payload_length] = '\0';
+      return arena_store((const char *) &record_payload[RECORD_INDEX_SIZE], &button_commands[i].command_offset);
+    }
+    case RECORD_REMOVE: {
+      if (payload_length != RECORD_INDEX_SIZE) {
+        return false;
+      }
+      size_t i = get_uint16(record_payload);
+      if (i >= button_commands.size()) {
+        return false;
+      }
+      button_commands.remove(i);
+      return true;
+    }
+    case RECORD_SET_ACTION: {
+      if (payload_length < RECORD_ACTION_SIZE) {
+        return false;
+      }
+      size_t i = get_uint16(record_payload);
+      if (i >= button_commands.size() || record_payload[RECORD_INDEX_SIZE] >= ACTION_TYPE_COUNT) {
+        return false;
+      }
+      button_commands[i].action = (ActionType) record_payload[RECORD_INDEX_SIZE];
+      record_payload[payload_length] = '\0';
+      return arena_store((const char *) &record_payload[RECORD_ACTION_SIZE], &button_commands[i].target_offset);
+    }
+    default:
+      return false;
+  }
+}
+
+// Append the record in record_buffer to the log, compacting it if necessary.
+static bool append_record(size_t length) {
+  if (log_damaged) {
+    // Compacting writes out the whole table, including this change.
+    return compact_commands();
+  }
+  File file = SPIFFS.open(log_path, "a");
+  if (!file) {
+    LOGLN("Failed to open /commands.log for appending.");
+    return false;
+  }
+  size_t written = file.write(record_buffer, length);
+  file.close();
+  if (written != length) {
+    LOGLN("Failed to append to /commands.log.");
+    log_damaged = true;
+    return compact_commands();
+  }
+  ++log_record_count;
+  if (log_record_count > button_commands.size() + COMMAND_LOG_SLACK) {
+    return compact_commands();
+  }
+  return true;
+}
+
+// Load commands from the old text format.
+static bool load_legacy_commands() {
+  File file = SPIFFS.open(legacy_path, "r");
+  if (!file) {
+    LOGLN("Failed to open /commands.txt for reading.");
+    return false;
+  }
+  while (file.available() > 0 && button_commands.size() < MAX_COMMANDS) {
+    String code_hex = file.readStringUntil(' ');
+    String command = file.readStringUntil('\n');
+    if (code_hex.length() == 0 || command.length() == 0) {
+      break;
+    }
+    if (command.length() >= MAX_COMMAND_LENGTH) {
+      LOGLN("Skipping command in /commands.txt which is too long.");
+      continue;
+    }
+    if (!push_command(RfCode::from_hex(code_hex.c_str()), command.c_str(), ACTION_ASSISTANT, "")) {
+      break;
+    }
+  }
+  file.close();
+  return true;
+}
+
+// Rewrite the log with a single record for each command.
+bool compact_commands() {
+  LOGLN("Compacting /commands.log");
+  File file = SPIFFS.open(new_log_path, "w");
+  if (!file) {
+    LOGLN("Failed to open /commands.new for writing.");
+    return false;
+  }
+  for (size_t i = 0; i < button_commands.size(); ++i) {
+    size_t length = build_add_record(i);
+    if (file.write(record_buffer, length) != length) {
+      LOGLN("Failed to write /commands.new.");
+      file.close();
+      SPIFFS.remove(new_log_path);
+      return false;
+    }
+  }
+  file.close();
+
+  // SPIFFS can't rename over an existing file, so there is a moment when only the new log exists.
+  SPIFFS.remove(log_path);
+  if (!SPIFFS.rename(new_log_path, log_path)) {
+    LOGLN("Failed to rename /commands.new.");
+    return false;
+  }
+  log_damaged = false;
+  log_record_count = button_commands.size();
+  return true;
+}
+
+bool load_commands() {
+  button_commands.clear();
+  arena_clear();
+  log_damaged = false;
+  log_record_count = 0;
+
+  // Finish or roll back any compaction which was interrupted.
+  if (SPIFFS.exists(new_log_path)) {
+    if (SPIFFS.exists(log_path) || SPIFFS.exists(legacy_path)) {
+      // The old log hadn't been removed yet, so the new one may be incomplete.
+      SPIFFS.remove(new_log_path);
+    } else {
+      SPIFFS.rename(new_log_path, log_path);
+    }
+  }
+
+  if (!SPIFFS.exists(log_path) && SPIFFS.exists(legacy_path)) {
+    LOGLN("Converting /commands.txt to /commands.log");
+    bool success = load_legacy_commands() && compact_commands();
+    if (success) {
+      SPIFFS.remove(legacy_path);
+    }
+    rebuild_code_index();
+    return success;
+  }
+
+  File file = SPIFFS.open(log_path, "r");
+  if (!file) {
+    LOGLN("Failed to open /commands.log for reading.");
+    rebuild_code_index();
+    return false;
+  }
+  size_t payload_length;
+  while (file.available() > 0) {
+    if (!read_record(file, &payload_length)) {
+      log_damaged = true;
+      break;
+    }
+    if (!apply_record(payload_length)) {
+      LOG("Skipping /commands.log record which couldn't be applied, type ");
+      LOGLN(record_buffer[0]);
+    }
+    ++log_record_count;
+  }
+  file.close();
+  rebuild_code_index();
+
+  if (log_damaged) {
+    LOGLN("/commands.log ends with a damaged record.");
+    compact_commands();
+  }
+  return true;
+}
+
+bool add_command(const RfCode &code, const char *command, ActionType action, const char *target) {
+  if (!push_command(code, command, action, target)) {
+    return false;
+  }
+  rebuild_code_index();
+  return append_record(build_add_record(button_commands.size() - 1));
+}
+
+bool update_command(size_t i, const char *command) {
+  if (i >= button_commands.size() || !command_fits(command) ||
+      !arena_store(command, &button_commands[i].command_offset)) {
+    return false;
+  }
+  put_uint16(record_payload, i);
+  size_t command_length = put_command(&record_payload[RECORD_INDEX_SIZE], button_commands[i].command());
+  return append_record(finish_record(record_buffer, RECORD_UPDATE, RECORD_INDEX_SIZE + command_length));
+}
+
+bool set_command_action(size_t i, ActionType action, const char *target) {
+  if (i >= button_commands.size() || !command_fits(target) || !arena_store(target, &button_commands[i].target_offset)) {
+    return false;
+  }
+  button_commands[i].action = action;
+  put_uint16(record_payload, i);
+  record_payload[RECORD_INDEX_SIZE] = action;
+  size_t target_length = put_command(&record_payload[RECORD_ACTION_SIZE], button_commands[i].target());
+  return append_record(finish_record(record_buffer, RECORD_SET_ACTION, RECORD_ACTION_SIZE + target_length));
+}
+
+bool remove_command(size_t i) {
+  if (i >= button_commands.size()) {
+    return false;
+  }
+  button_commands.remove(i);
+  rebuild_code_index();
+  put_uint16(record_payload, i);
+  return append_record(finish_record(record_buffer, RECORD_REMOVE, RECORD_INDEX_SIZE));
+}
+
+static uint32_t stats_activity() {
+  uint32_t activity = 0;
+  for (size_t i = 0; i < button_commands.size(); ++i) {
+    activity += button_commands[i].stats.matches + button_commands[i].stats.timing_rejects;
+  }
+  return activity;
+}
+
+// Write the statistics for all commands. The file is a header of the number of commands and the size of each
+// statistics entry, then each command's code followed by its statistics, then a CRC-32 of everything before it.
+bool save_command_stats() {
+  File file = SPIFFS.open(stats_path, "w");
+  if (!file) {
+    LOGLN("Failed to open /command_stats.bin for writing.");
+    return false;
+  }
+  uint8_t header[4];
+  put_uint16(header, button_commands.size());
+  put_uint16(&header[2], sizeof(CommandStats));
+  file.write(header, sizeof(header));
+  uint32_t crc = crc32_update(0, header, sizeof(header));
+  for (size_t i = 0; i < button_commands.size(); ++i) {
+    uint8_t code[RECORD_CODE_SIZE];
+    button_commands[i].code.to_message(code);
+    file.write(code, sizeof(code));
+    crc = crc32_update(crc, code, sizeof(code));
+    const uint8_t *stats = (const uint8_t *) &button_commands[i].stats;
+    file.write(stats, sizeof(CommandStats));
+    crc = crc32_update(crc, stats, sizeof(CommandStats));
+  }
+  uint8_t trailer[RECORD_CRC_SIZE];
+  put_uint32(trailer, crc);
+  size_t written = file.write(trailer, sizeof(trailer));
+  file.close();
+  return written == sizeof(trailer);
+}
+
+// Load saved statistics for any commands which are still at the same index with the same code.
+bool load_command_stats() {
+  saved_stats_activity = stats_activity();
+  File file = SPIFFS.open(stats_path, "r");
+  if (!file) {
+    LOGLN("Failed to open /command_stats.bin for reading.");
+    return false;
+  }
+  uint8_t header[4];
+  if (file.read(header, sizeof(header)) != sizeof(header) || get_uint16(&header[2]) != sizeof(CommandStats)) {
+    file.close();
+    return false;
+  }
+  size_t count = get_uint16(header);
+  size_t entry_size = RECORD_CODE_SIZE + sizeof(CommandStats);
+  if (file.size() != sizeof(header) + count * entry_size + RECORD_CRC_SIZE) {
+    LOGLN("/command_stats.bin is the wrong size.");
+    file.close();
+    return false;
+  }
+
+  // Check the CRC before using any of it.
+  uint32_t crc = crc32_update(0, header, sizeof(header));
+  for (size_t i = 0; i < count * entry_size; i += sizeof(record_buffer)) {
+    size_t length = min(sizeof(record_buffer), count * entry_size - i);
+    file.read(record_buffer, length);
+    crc = crc32_update(crc, record_buffer, length);
+  }
+  file.read(record_buffer, RECORD_CRC_SIZE);
+  if (get_uint32(record_buffer) != crc) {
+    LOGLN("/command_stats.bin failed CRC check.");
+    file.close();
+    return false;
+  }
+
+  file.seek(sizeof(header));
+  for (size_t i = 0; i < count && i < button_commands.size(); ++i) {
+    uint8_t code[RECORD_CODE_SIZE];
+    button_commands[i].code.to_message(code);
+    file.read(record_buffer, entry_size);
+    if (memcmp(code, record_buffer, RECORD_CODE_SIZE) == 0) {
+      memcpy(&button_commands[i].stats, &record_buffer[RECORD_CODE_SIZE], sizeof(CommandStats));
+    }
+  }
+  file.close();
+  saved_stats_activity = stats_activity();
+  return true;
+}
+
+// Save command statistics if they have changed and it has been long enough since they were last saved.
+void save_command_stats_periodically() {
+  if (millis() - stats_saved_time < COMMAND_STATS_SAVE_INTERVAL) {
+    return;
+  }
+  stats_saved_time = millis();
+  uint32_t activity = stats_activity();
+  if (activity != saved_stats_activity && save_command_stats()) {
+    saved_stats_activity = activity;
+  }
+}
@@ -14,7 +14,9 @@ See the License for the specific language governing permissions and
 limitations under the License.
  */
 
+#include "actions.h"
 #include "assistant.h"
+#include "command_store.h"
 #include "config.h"
 #include "logging.h"
 #include "rf.h"
@@ -50,7 +52,9 @@ void setup() {
   }
 
   load_commands();
+  load_command_stats();
   assistant_init();
+  rf_init();
   start_webserver();
   #if OTA_UPDATE
   ArduinoOTA.setHostname(MDNS_HOSTNAME);
@@ -64,8 +68,8 @@ void loop() {
   ArduinoOTA.handle();
   #endif
 
-  size_t available = Serial.available();
-  if (available >= 3) {
-    handle_message();
-  }
+  rf_loop();
+  actions_loop();
+
+  save_command_stats_periodically();
 }
@@ -16,55 +16,139 @@ limitations under the License.
 
 #include "module_webserver.h"
 
+#include "actions.h"
+#include "api.h"
 #include "assistant.h"
+#include "command_arena.h"
+#include "command_store.h"
 #include "config.h"
+#include "jobs.h"
 #include "logging.h"
+#include "metrics.h"
 #include "rf.h"
+#include "rf_capture.h"
 #include "streamutils.h"
+#include "webserver.h"
 #include "ButtonCommand.h"
 
 #include <Arduino.h>
 #include <ESP8266WebServer.h>
 #include <Vector.h>
+#include <time.h>
+
+// Find the action type with the given name, or return ACTION_TYPE_COUNT if there is none.
+static ActionType find_action(const char *name) {
+  uint i = 0;
+  while (i < ACTION_TYPE_COUNT && strcmp(name, action_names[i]) != 0) {
+    ++i;
+  }
+  return (ActionType) i;
+}
+
+// Find the action type with the given name, defaulting to the Assistant.
+static ActionType parse_action(const String &name) {
+  ActionType action = find_action(name.c_str());
+  return action == ACTION_TYPE_COUNT ? ACTION_ASSISTANT : action;
+}
+
+// Output a select element for choosing an action type, with the given one selected.
+static void render_action_select(HtmlWriter &html, const char *name, ActionType selected) {
+  html.render("<select name=\"{}\">", name);
+  for (uint i = 0; i < ACTION_TYPE_COUNT; ++i) {
+    html.render("<option{}>{}</option>", RawHtml{i == selected ? " selected" : ""}, action_names[i]);
+  }
+  html.render("</select>");
+}
+
+// Background job which runs the action of a command, as long as it hasn't been changed since the job was submitted.
+struct TestJob {
+  uint index;
+  String command;
+
+  JobState operator()() const {
+    if (index >= button_commands.size() || command != button_commands[index].command()) {
+      LOGLN("Command changed before it could be tested");
+      return JOB_FAILED;
+    }
+    return run_action(button_commands[index]) ? JOB_SUCCEEDED : JOB_FAILED;
+  }
+};
+
+// Background job which waits for the RF module to learn a code, then adds a command for it.
+struct LearnJob {
+  String command;
+  ActionType action;
+  String target;
+  bool started;
+
+  JobState operator()() {
+    if (!started) {
+      started = true;
+      return start_learning() ? JOB_RUNNING : JOB_FAILED;
+    }
+    RfCode code;
+    switch (learn_result(&code)) {
+      case LEARN_WAITING:
+        return JOB_RUNNING;
+      case LEARN_SUCCEEDED:
+        return add_command(code, command.c_str(), action, target.c_str()) ? JOB_SUCCEEDED : JOB_FAILED;
+      default:
+        return JOB_FAILED;
+    }
+  }
+};
 
 void module_handle_root_args(ESP8266WebServer &server, String &error) {
   // Delete and update commands
-  bool updated_commands = false;
   for (uint i = 0; i < button_commands.size(); ++i) {
     if (server.hasArg(String("delete") + i)) {
-      button_commands.remove(i);
-      updated_commands = true;
+      remove_command(i);
       break;
     } else if (server.hasArg("update") && server.hasArg(String("command") + i)) {
-      button_commands[i].command = server.arg(String("command") + i);
-      updated_commands = true;
+      const String &command = server.arg(String("command") + i);
+      // Only log commands which have actually changed.
+      if (strcmp(command.c_str(), button_commands[i].command()) != 0) {
+        update_command(i, command.c_str());
+      }
+      ActionType action = parse_action(server.arg(String("action") + i));
+      const String &target = server.arg(String("target") + i);
+      if (action != button_commands[i].action || strcmp(target.c_str(), button_commands[i].target()) != 0) {
+        set_command_action(i, action, target.c_str());
+      }
     } else if (server.hasArg(String("test") + i)) {
-      // Test running the command
-      auth_and_send_request(button_commands[i].command);
+      // Test running the command, after the page has been sent.
+      if (submit_job("test", TestJob{i, button_commands[i].command()}) == 0) {
+        error = "Too many background jobs.";
+      }
+    } else if (server.hasArg(String("transmit") + i)) {
+      if (!queue_transmit(button_commands[i].code, 1)) {
+        error = "Failed to transmit code.";
+      }
     }
   }
-  if (updated_commands) {
-    save_commands();
-  }
 
   const String &new_command = server.arg("new_command");
+  const String &new_code = server.arg("new_code");
   if (new_command.length() > 0 && button_commands.size() < MAX_COMMANDS) {
-    // Add a new command: first wait for the button to be pressed
-    RfCode code;
-    if (learn_code(&code)) {
-      button_commands.push_back(ButtonCommand(code, new_command));
-      save_commands();
-    } else {
-      error = "Failed to learn code.";
+    // Add a new command: use the code given, such as the signature of a raw frame, or else wait in the background for
+    // the button to be pressed.
+    ActionType action = parse_action(server.arg("new_action"));
+    if (new_code.length() > 0) {
+      RfCode code = RfCode::from_hex(new_code.c_str());
+      if (!add_command(code, new_command.c_str(), action, server.arg("new_target").c_str())) {
+        error = "Failed to store command.";
+      }
+    } else if (submit_job("learn", LearnJob{new_command, action, server.arg("new_target"), false}) == 0) {
+      error = "Too many background jobs.";
     }
   }
 }
 
-void module_root_output(ESP8266WebServer &server) {
+void module_root_output(HtmlWriter &html) {
   LOGLN("Start module_root_output");
-  server.sendContent("<h2>Google account</h2>");
-  server.sendContent(String("<a href=\"https://accounts.google.com/o/oauth2/v2/auth?client_id=") + client_id);
-  server.sendContent("&scope=https%3A%2F%2Fwww.googleapis.com%2Fauth%2Fassistant-sdk-prototype&access_type=offline"
+  html.render("<h2>Google account</h2>"
+    "<a href=\"https://accounts.google.com/o/oauth2/v2/auth?client_id={}"
+    "&scope=https%3A%2F%2Fwww.googleapis.com%2Fauth%2Fassistant-sdk-prototype&access_type=offline"
     "&response_type=code&redirect_uri=urn:ietf:wg:oauth:2.0:oob"
     "&device_id=device_id&device_name=device_name\" target=\"_blank\">Get auth token</a><br/>"
     "<form method=\"post\" action=\"/oauth\">"
@@ -73,24 +157,274 @@ void module_root_output(ESP8266WebServer &server) {
     "</form>"
     "<h2>Commands</h2>"
     "<form method=\"post\" action=\"/\">"
-    "<ul>");
+    "<ul>", client_id);
+  char code_hex[RF_CODE_HEX_SIZE];
+  char last_seen[20];
+  char name[16];
   for (uint i = 0; i < button_commands.size(); ++i) {
-    server.sendContent(String("<li>") +
-      "<label for=\"command" + i + "\">" + button_commands[i].code.to_hex() + "</label>"
-      "<input type=\"text\" id=\"command" + i + "\" name=\"command" + i + "\" value=\"" + button_commands[i].command + "\"/>"
+    const CommandStats &stats = button_commands[i].stats;
+    uint32_t average_latency = stats.successes > 0 ? stats.latency_sum / stats.successes : 0;
+    if (stats.last_seen > 0) {
+      struct tm timeinfo;
+      gmtime_r(&stats.last_seen, &timeinfo);
+      strftime(last_seen, sizeof(last_seen), "%Y-%m-%d %H:%M", &timeinfo);
+    } else {
+      safe_copy("never", last_seen);
+    }
+    html.render("<li>"
+      "<label for=\"command{}\">{}</label>"
+      "<input type=\"text\" id=\"command{}\" name=\"command{}\" value=\"{}\"/>",
+      i, button_commands[i].code.to_hex(code_hex), i, i, button_commands[i].command());
+    snprintf(name, sizeof(name), "action%u", i);
+    render_action_select(html, name, button_commands[i].action);
+    html.render("<input type=\"text\" name=\"target{}\" placeholder=\"target\" value=\"{}\"/>"
+      "<small>{} presses, {} OK, {} failed, {} ms average, last seen {}</small>"
       "<span>"
-      "<input type=\"submit\" name=\"delete" + i + "\" value=\"Delete\"/>"
-      "<input type=\"submit\" name=\"test" + i + "\" value=\"Test command\"/>"
+      "<input type=\"submit\" name=\"delete{}\" value=\"Delete\"/>"
+      "<input type=\"submit\" name=\"test{}\" value=\"Test command\"/>"
+      "<input type=\"submit\" name=\"transmit{}\" value=\"Transmit code\"/>"
       "</span>"
-      "</li>");
+      "</li>",
+      i, button_commands[i].target(), stats.matches, stats.successes, stats.failures, average_latency, last_seen, i, i,
+      i);
   }
-  server.sendContent("</ul>"
+  html.render("</ul>"
      "<input type=\"submit\" name=\"update\" value=\"Update commands\"/>"
      "</form>");
   if (button_commands.size() < MAX_COMMANDS) {
-    server.sendContent("<form method=\"post\" action=\"/\">"
-      "<input type=\"text\" name=\"new_command\"/>"
+    html.render("<form method=\"post\" action=\"/\">"
+      "<input type=\"text\" name=\"new_command\"/>");
+    render_action_select(html, "new_action", ACTION_ASSISTANT);
+    html.render("<input type=\"text\" name=\"new_target\" placeholder=\"target\"/>"
+      "<input type=\"text\" name=\"new_code\" placeholder=\"code, or blank to learn\"/>"
       "<input type=\"submit\" value=\"Add command\"/>"
       "</form>");
   }
+  html.render("<h2>Raw capture</h2>"
+    "<p>Raw mode is {}. <a href=\"/capture\">Download captured frames</a>.</p>"
+    "<form method=\"post\" action=\"/capture\">"
+    "<input type=\"hidden\" name=\"raw\" value=\"{}\"/>"
+    "<input type=\"submit\" value=\"Turn raw mode {}\"/>"
+    "</form>"
+    "<form method=\"post\" action=\"/capture\">"
+    "<input type=\"hidden\" name=\"clear\" value=\"1\"/>"
+    "<input type=\"submit\" value=\"Download and clear\"/>"
+    "</form>",
+    raw_mode ? "on" : "off", raw_mode ? "0" : "1", raw_mode ? "off" : "on");
+}
+
+// Start a sample of a metric labelled with the index and code of the given command.
+static MetricWriter &command_sample(MetricWriter &writer, const char *name, const char *suffix, uint i) {
+  char code_hex[RF_CODE_HEX_SIZE];
+  return writer.sample(name, suffix).label("index", i).label("code", button_commands[i].code.to_hex(code_hex));
+}
+
+// Write a metric family with one sample for each command, from the given field of its stats.
+static void write_command_family(MetricWriter &writer, const char *name, MetricType type,
+    uint32_t CommandStats::*field) {
+  writer.family(name, type);
+  for (uint i = 0; i < button_commands.size(); ++i) {
+    command_sample(writer, name, "", i).value(button_commands[i].stats.*field);
+  }
+}
+
+static void write_command_metrics(MetricWriter &writer) {
+  write_command_family(writer, "rf_code_matches_total", METRIC_COUNTER, &CommandStats::matches);
+  write_command_family(writer, "rf_code_timing_rejects_total", METRIC_COUNTER, &CommandStats::timing_rejects);
+  write_command_family(writer, "rf_code_timing_error_percent_total", METRIC_COUNTER, &CommandStats::timing_error_sum);
+  writer.family("rf_code_max_timing_error_percent", METRIC_GAUGE);
+  for (uint i = 0; i < button_commands.size(); ++i) {
+    command_sample(writer, "rf_code_max_timing_error_percent", "", i).value(button_commands[i].stats.max_timing_error);
+  }
+  write_command_family(writer, "rf_code_successes_total", METRIC_COUNTER, &CommandStats::successes);
+  write_command_family(writer, "rf_code_failures_total", METRIC_COUNTER, &CommandStats::failures);
+  writer.family("rf_code_last_seen_seconds", METRIC_GAUGE, "seconds");
+  for (uint i = 0; i < button_commands.size(); ++i) {
+    command_sample(writer, "rf_code_last_seen_seconds", "", i).value(button_commands[i].stats.last_seen);
+  }
+  writer.family("rf_code_latency_milliseconds", METRIC_SUMMARY, "milliseconds");
+  for (uint i = 0; i < button_commands.size(); ++i) {
+    command_sample(writer, "rf_code_latency_milliseconds", "_sum", i).value(button_commands[i].stats.latency_sum);
+    command_sample(writer, "rf_code_latency_milliseconds", "_count", i).value(button_commands[i].stats.successes);
+  }
+  write_command_family(writer, "rf_code_max_latency_milliseconds", METRIC_GAUGE, &CommandStats::max_latency);
+}
+
+static void write_action_metrics(MetricWriter &writer) {
+  writer.family("action_successes_total", METRIC_COUNTER);
+  for (uint i = 0; i < ACTION_TYPE_COUNT; ++i) {
+    writer.sample("action_successes_total").label("type", action_names[i]).value(action_stats[i].successes);
+  }
+  writer.family("action_failures_total", METRIC_COUNTER);
+  for (uint i = 0; i < ACTION_TYPE_COUNT; ++i) {
+    writer.sample("action_failures_total").label("type", action_names[i]).value(action_stats[i].failures);
+  }
+  writer.family("action_latency_milliseconds", METRIC_SUMMARY, "milliseconds");
+  for (uint i = 0; i < ACTION_TYPE_COUNT; ++i) {
+    writer.sample("action_latency_milliseconds", "_sum").label("type", action_names[i])
+      .value(action_stats[i].latency_sum);
+    writer.sample("action_latency_milliseconds", "_count").label("type", action_names[i])
+      .value(action_stats[i].successes);
+  }
+  writer.family("action_max_latency_milliseconds", METRIC_GAUGE, "milliseconds");
+  for (uint i = 0; i < ACTION_TYPE_COUNT; ++i) {
+    writer.sample("action_max_latency_milliseconds").label("type", action_names[i]).value(action_stats[i].max_latency);
+  }
+}
+
+static int64_t capture_used_bytes() {
+  return capture_used();
+}
+
+static int64_t arena_used_bytes() {
+  return arena_used();
+}
+
+void module_register_metrics() {
+  register_counter("rf_transmits_total", &transmit_stats.transmits);
+  register_counter("rf_transmit_ack_timeouts_total", &transmit_stats.ack_timeouts);
+  register_counter("rf_transmit_failures_total", &transmit_stats.failures);
+  register_counter("rf_transmit_dropped_total", &transmit_stats.dropped);
+  register_counter("rf_raw_frames_total", &capture_stats.frames);
+  register_counter("rf_raw_bytes_total", &capture_stats.bytes).unit("bytes");
+  register_counter("rf_capture_dropped_total", &capture_stats.dropped);
+  register_counter("rf_message_overflows_total", &capture_stats.overflows);
+  register_gauge("rf_capture_used", capture_used_bytes).unit("bytes");
+  register_gauge("command_arena_used", arena_used_bytes).unit("bytes");
+  register_collector(write_action_metrics);
+  register_collector(write_command_metrics);
+}
+
+// Get a string from a JSON object, or the given default if it is missing or not a string.
+static const char *json_string(JsonVariant value, const char *default_value = "") {
+  const char *string = value.as<const char *>();
+  return string != nullptr ? string : default_value;
+}
+
+static void handle_api_get_commands() {
+  if (!authenticate_admin()) {
+    return;
+  }
+  char code_hex[RF_CODE_HEX_SIZE];
+  JsonWriter writer(server);
+  writer.begin();
+  writer.begin_array();
+  for (uint i = 0; i < button_commands.size(); ++i) {
+    const ButtonCommand &command = button_commands[i];
+    writer.begin_object()
+      .field("index", i)
+      .field("code", command.code.to_hex(code_hex))
+      .field("command", command.command())
+      .field("action", action_names[command.action])
+      .field("target", command.target())
+      .field("matches", command.stats.matches)
+      .field("successes", command.stats.successes)
+      .field("failures", command.stats.failures)
+      .field("last_seen", (long) command.stats.last_seen)
+      .end_object();
+  }
+  writer.end_array();
+  writer.end();
+}
+
+// Add commands from an array of objects with a code, a command, and optionally an action and target.
+static void handle_api_add_commands() {
+  if (!authenticate_admin()) {
+    return;
+  }
+  api_bulk([](JsonVariant element) -> const char * {
+    const char *code = json_string(element["code"]);
+    const char *command = json_string(element["command"]);
+    ActionType action = find_action(json_string(element["action"], action_names[ACTION_ASSISTANT]));
+    if (strlen(code) == 0 || strlen(command) == 0) {
+      return "Missing code or command";
+    } else if (action == ACTION_TYPE_COUNT) {
+      return "Unknown action";
+    } else if (button_commands.size() >= MAX_COMMANDS) {
+      return "Too many commands";
+    } else if (!add_command(RfCode::from_hex(code), command, action, json_string(element["target"]))) {
+      return "Failed to store command";
+    }
+    return nullptr;
+  });
+}
+
+// Change commands from an array of objects with an index, and any of a command, action and target.
+static void handle_api_update_commands() {
+  if (!authenticate_admin()) {
+    return;
+  }
+  api_bulk([](JsonVariant element) -> const char * {
+    if (!element["index"].is<int>() || element["index"].as<int>() < 0 ||
+        element["index"].as<uint>() >= button_commands.size()) {
+      return "Invalid index";
+    }
+    uint i = element["index"].as<uint>();
+    const ButtonCommand &existing = button_commands[i];
+    const char *command = json_string(element["command"], existing.command());
+    ActionType action = find_action(json_string(element["action"], action_names[existing.action]));
+    const char *target = json_string(element["target"], existing.target());
+    if (action == ACTION_TYPE_COUNT) {
+      return "Unknown action";
+    }
+    if (strcmp(command, existing.command()) != 0 && !update_command(i, command)) {
+      return "Failed to store command";
+    }
+    // Storing the command may have moved the existing target in the arena.
+    target = json_string(element["target"], existing.target());
+    if ((action != existing.action || strcmp(target, existing.target()) != 0) && !set_command_action(i, action, target)) {
+      return "Failed to store action";
+    }
+    return nullptr;
+  });
+}
+
+// Remove commands given an array of their indices, as they were before any of them were removed.
+static void handle_api_remove_commands() {
+  if (!authenticate_admin()) {
+    return;
+  }
+  bool removed[MAX_COMMANDS] = {false};
+  api_bulk([&removed](JsonVariant element) -> const char * {
+    if (!element.is<int>() || element.as<int>() < 0 || element.as<int>() >= MAX_COMMANDS || removed[element.as<int>()]) {
+      return "Invalid index";
+    }
+    uint original = element.as<int>();
+    uint i = original;
+    for (uint j = 0; j < original; ++j) {
+      i -= removed[j];
+    }
+    if (i >= button_commands.size() || !remove_command(i)) {
+      return "Failed to remove command";
+    }
+    removed[original] = true;
+    return nullptr;
+  });
+}
+
+// Run the action of the command with the given index in the background, as if its code had been received.
+static void handle_api_test() {
+  if (!authenticate_admin()) {
+    return;
+  }
+  StaticJsonBuffer<API_JSON_BUFFER_SIZE> json_buffer;
+  JsonObject *json = api_parse_object(json_buffer);
+  if (json == nullptr) {
+    return;
+  }
+  if (!(*json)["index"].is<int>() || (*json)["index"].as<int>() < 0 ||
+      (*json)["index"].as<uint>() >= button_commands.size()) {
+    api_error(400, "Invalid index");
+  } else {
+    uint index = (*json)["index"].as<uint>();
+    api_submit_job("test", TestJob{index, button_commands[index].command()});
+  }
+}
+
+void module_api_setup(ESP8266WebServer &server) {
+  server.on(API_PREFIX "/commands", HTTP_GET, handle_api_get_commands);
+  server.on(API_PREFIX "/commands", HTTP_POST, handle_api_add_commands);
+  server.on(API_PREFIX "/commands", HTTP_PUT, handle_api_update_commands);
+  server.on(API_PREFIX "/commands", HTTP_DELETE, handle_api_remove_commands);
+  server.on(API_PREFIX "/test", HTTP_POST, handle_api_test);
 }
@@ -16,54 +16,65 @@ limitations under the License.
 
 #include "rf.h"
 
-#include "assistant.h"
+#include "actions.h"
+#include "rf_capture.h"
 #include "config.h"
+#include "events.h"
 #include "logging.h"
+#include "webserver.h"
 #include "ButtonCommand.h"
 
 #include <Arduino.h>
-#include <FS.h>
+#include <ESP8266WebServer.h>
 #include <Vector.h>
+#include <time.h>
 
 static ButtonCommand storage_array[MAX_COMMANDS];
 Vector<ButtonCommand> button_commands(storage_array);
 
-// Save all commands to a file.
-bool save_commands() {
-  File file = SPIFFS.open("/commands.txt", "w");
-  if (!file) {
-    LOGLN("Failed to open /commands.txt for writing.");
-    return false;
-  }
-  for (uint i = 0; i < button_commands.size(); ++i) {
-    file.print(button_commands[i].code.to_hex());
-    file.print(' ');
-    file.print(button_commands[i].command);
-    // Don't use println, because it adds '\r' characters which we don't want.
-    file.print('\n');
-  }
-  file.close();
-  return true;
-}
+TransmitStats transmit_stats;
 
-bool load_commands() {
-  File file = SPIFFS.open("/commands.txt", "r");
-  if (!file) {
-    LOGLN("Failed to open /commands.txt for reading.");
-    return false;
-  }
-  button_commands.clear();
-  while (file.available() > 0) {
-    String code_hex = file.readStringUntil(' ');
-    String command = file.readStringUntil('\n');
-    if (code_hex.length() == 0 || command.length() == 0) {
-      break;
+// A code waiting to be transmitted, and how many more times to transmit it.
+struct TransmitRequest {
+  RfCode code;
+  uint8_t repeats;
+};
+
+// Codes to transmit, in order, as a ring buffer. The first one stays at the head until it has been acknowledged by the
+// RF module as many times as it is repeated.
+static TransmitRequest transmit_queue[RF_TRANSMIT_QUEUE_SIZE];
+static size_t transmit_queue_head = 0;
+static size_t transmit_queue_length = 0;
+static bool awaiting_transmit_ack = false;
+static uint8_t transmit_attempts = 0;
+static unsigned long last_transmit_time = 0;
+
+// The message currently being received from the RF module, starting with its 0xAA start byte.
+static uint8_t message[RF_MAX_MESSAGE_SIZE];
+static size_t message_length = 0;
+static unsigned long message_start_time = 0;
+
+// Whether the RF module has been asked to learn a code, and what happened.
+static LearnState learn_state = LEARN_IDLE;
+static bool learn_message_sent = false;
+static unsigned long learn_start_time = 0;
+static RfCode learned_code;
+
+// Indices into button_commands, sorted by the key of their code, so that received codes can be looked up by binary
+// search.
+static uint16_t code_index[MAX_COMMANDS];
+
+void rebuild_code_index() {
+  // Insertion sort, as the table is small and usually already sorted.
+  for (size_t i = 0; i < button_commands.size(); ++i) {
+    uint32_t key = button_commands[i].code.key();
+    size_t j = i;
+    while (j > 0 && button_commands[code_index[j - 1]].code.key() > key) {
+      code_index[j] = code_index[j - 1];
+      --j;
     }
-    RfCode code = RfCode::from_hex(code_hex);
-    button_commands.push_back(ButtonCommand(code, command));
+    code_index[j] = i;
   }
-  file.close();
-  return true;
 }
 
 /////////////////////////
@@ -77,73 +88,370 @@ void send_ack() {
   Serial.flush();
 }
 
-bool learn_code(RfCode *code) {
-  LOGLN("Going into learning mode");
-  Serial.write(0xaa);
-  Serial.write(0xa1);
-  Serial.write(0x55);
-  Serial.flush();
-  uint8_t buffer[12];
-  size_t length = Serial.readBytesUntil(0x55, buffer, 3);
-  if (length != 2 || buffer[0] != 0xaa || buffer[1] != 0xa0) {
-    LOGLN("Didn't get expected ack, length was ");
-    LOGLN(length);
+// Ask for the next code the RF module receives to be learned, once it has finished transmitting. Returns false if it
+// can't learn codes now. Check on it with learn_result.
+bool start_learning() {
+  if (raw_mode) {
+    LOGLN("Can't learn codes in raw mode");
     return false;
   }
-  LOGLN("Waiting");
-  while (Serial.available() == 0) {
-  }
-  length = Serial.readBytesUntil(0x55, buffer, 12);
-  if (length == 2 && buffer[0] == 0xaa && buffer[1] == 0xa2) {
-    LOGLN("Learning timed out");
-    send_ack();
+  if (learn_state == LEARN_WAITING) {
+    LOGLN("Already learning");
     return false;
-  } else if (length == 11 && buffer[0] == 0xaa && buffer[1] == 0xa3) {
-    LOG("Learned code:");
-    for (int i = 2; i < 11; ++i) {
-      LOG(" 0x");
-      LOGH(buffer[i]);
+  }
+  learn_state = LEARN_WAITING;
+  learn_message_sent = false;
+  return true;
+}
+
+// Get the state of learning, and the learned code once it has succeeded. Learning goes back to idle once its result has
+// been taken.
+LearnState learn_result(RfCode *code) {
+  LearnState state = learn_state;
+  if (state == LEARN_SUCCEEDED) {
+    *code = learned_code;
+  }
+  if (state != LEARN_WAITING) {
+    learn_state = LEARN_IDLE;
+  }
+  return state;
+}
+
+// Put the RF module into learning mode when it isn't busy transmitting, and give up if it never answers.
+static void learn_loop() {
+  if (learn_state != LEARN_WAITING) {
+    return;
+  }
+  if (!learn_message_sent) {
+    if (awaiting_transmit_ack) {
+      return;
     }
-    LOGLN("");
-    // Ignore Tsyn, Tlow, Thigh
-    code->copy_from(&buffer[8]);
-    send_ack();
-    return true;
-  } else {
-    LOG("Got unexpected response to learn, of length ");
-    LOGLN(length);
-    return false;
+    LOGLN("Going into learning mode");
+    Serial.write(0xaa);
+    Serial.write(0xa1);
+    Serial.write(0x55);
+    Serial.flush();
+    learn_message_sent = true;
+    learn_start_time = millis();
+  } else if (millis() - learn_start_time > RF_LEARN_TIMEOUT) {
+    LOGLN("RF module didn't finish learning");
+    learn_state = LEARN_FAILED;
   }
 }
 
-void handle_button(const RfCode &code) {
+// Find the position in code_index of the first command whose code has the given key, or of where it would be.
+static size_t find_first_code(uint32_t key) {
+  size_t low = 0;
+  size_t high = button_commands.size();
+  while (low < high) {
+    size_t middle = (low + high) / 2;
+    if (button_commands[code_index[middle]].code.key() < key) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return low;
+}
+
+// Run the commands matching a code received from the RF module at the given time, as returned by millis().
+void handle_button(const RfCode &code, unsigned long received_time) {
+  char code_hex[RF_CODE_HEX_SIZE];
+  code.to_hex(code_hex);
   LOG("Got code ");
-  LOGLN(code.to_hex());
+  LOGLN(code_hex);
+  publish_event("rf", "{\"code\":\"%s\"}", code_hex);
   digitalWrite(LED_PIN, LOW);
 
   // Find any matching commands and run them.
-  for (size_t i = 0; i < button_commands.size(); ++i) {
-    if (button_commands[i].code == code) {
-      LOG("Code matched, sending request: ");
-      LOGLN(button_commands[i].command);
-      auth_and_send_request(button_commands[i].command);
+  uint32_t key = code.key();
+  for (size_t i = find_first_code(key); i < button_commands.size(); ++i) {
+    ButtonCommand &button_command = button_commands[code_index[i]];
+    if (button_command.code.key() != key) {
+      break;
+    }
+    CommandStats &stats = button_command.stats;
+    uint8_t error = button_command.code.timing_error(code);
+    if (error > RF_TIMING_TOLERANCE) {
+      LOG("Code matched but timing was off by ");
+      LOG(error);
+      LOGLN("%");
+      ++stats.timing_rejects;
+      continue;
+    }
+    ++stats.matches;
+    stats.last_seen = time(nullptr);
+    stats.timing_error_sum += error;
+    if (error > stats.max_timing_error) {
+      stats.max_timing_error = error;
+    }
+    LOG("Code matched, sending ");
+    LOG(action_names[button_command.action]);
+    LOG(" request: ");
+    LOGLN(button_command.command());
+    bool success = run_action(button_command);
+    uint32_t latency = millis() - received_time;
+    record_action_result(button_command.action, success, latency);
+    if (success) {
+      ++stats.successes;
+      stats.latency_sum += latency;
+      if (latency > stats.max_latency) {
+        stats.max_latency = latency;
+      }
+    } else {
+      ++stats.failures;
     }
   }
 
   digitalWrite(LED_PIN, HIGH);
 }
 
-void handle_message() {
-  uint8_t buffer[12];
-  size_t length = Serial.readBytesUntil(0x55, buffer, 12);
-  if (length == 11 && buffer[0] == 0xaa && buffer[1] == 0xa4) {
-    send_ack();
-    RfCode code;
-    // Ignore Tsyn, Tlow, Thigh
-    code.copy_from(&buffer[8]);
-    handle_button(code);
-  } else {
-    LOG("Got unexpected message of length ");
-    LOGLN(length);
+// Remove the request at the head of the transmit queue.
+static void pop_transmit_request() {
+  transmit_queue_head = (transmit_queue_head + 1) % RF_TRANSMIT_QUEUE_SIZE;
+  --transmit_queue_length;
+  transmit_attempts = 0;
+}
+
+static void handle_transmit_ack() {
+  if (!awaiting_transmit_ack) {
+    // While learning, this acknowledges the request to learn.
+    if (learn_state != LEARN_WAITING) {
+      LOGLN("Got unexpected ack");
+    }
+    return;
+  }
+  awaiting_transmit_ack = false;
+  transmit_attempts = 0;
+  ++transmit_stats.transmits;
+  if (--transmit_queue[transmit_queue_head].repeats == 0) {
+    pop_transmit_request();
+  }
+}
+
+static void send_transmit_message(const RfCode &code) {
+  uint8_t buffer[RF_TIMING_COUNT * 2 + RF_CODE_LENGTH];
+  code.to_message(buffer);
+  Serial.write(0xaa);
+  Serial.write(0xa5);
+  Serial.write(buffer, sizeof(buffer));
+  Serial.write(0x55);
+  Serial.flush();
+}
+
+// Send the next queued code if the RF module is ready for it, or try again if it didn't acknowledge the last one.
+static void transmit_loop() {
+  unsigned long now = millis();
+  if (awaiting_transmit_ack) {
+    if (now - last_transmit_time < RF_ACK_TIMEOUT) {
+      return;
+    }
+    awaiting_transmit_ack = false;
+    ++transmit_stats.ack_timeouts;
+    if (transmit_attempts > RF_TRANSMIT_RETRIES) {
+      LOGLN("RF module didn't acknowledge transmission, giving up");
+      ++transmit_stats.failures;
+      pop_transmit_request();
+    }
+  }
+  // The RF module can't transmit while it is learning.
+  if (learn_state == LEARN_WAITING || transmit_queue_length == 0 || now - last_transmit_time < RF_TRANSMIT_GAP) {
+    return;
+  }
+  send_transmit_message(transmit_queue[transmit_queue_head].code);
+  awaiting_transmit_ack = true;
+  ++transmit_attempts;
+  last_transmit_time = now;
+}
+
+// Add a code to the transmit queue, to be sent the given number of times. Returns false if it can't be transmitted.
+bool queue_transmit(const RfCode &code, uint8_t repeats) {
+  if (code.timings[0] == 0) {
+    LOGLN("Can't transmit a code without timings");
+    return false;
+  }
+  if (transmit_queue_length == RF_TRANSMIT_QUEUE_SIZE) {
+    LOGLN("Transmit queue is full");
+    ++transmit_stats.dropped;
+    return false;
+  }
+  TransmitRequest &request = transmit_queue[(transmit_queue_head + transmit_queue_length) % RF_TRANSMIT_QUEUE_SIZE];
+  request.code = code;
+  request.repeats = constrain(repeats, 1, RF_MAX_REPEATS);
+  ++transmit_queue_length;
+  return true;
+}
+
+// Parse a number of times to transmit a code, which must be a whole number from 1 to RF_MAX_REPEATS.
+static bool parse_repeats(const char *text, uint8_t *repeats) {
+  char *end;
+  long value = strtol(text, &end, 10);
+  if (end == text || *end != '\0' || value < 1 || value > RF_MAX_REPEATS) {
+    LOGLN("Invalid number of repeats");
+    return false;
+  }
+  *repeats = value;
+  return true;
+}
+
+// Parse a code in hex, optionally followed by '*' and the number of times to transmit it, and queue it.
+bool queue_transmit(const char *target) {
+  char code_hex[RF_CODE_HEX_SIZE];
+  size_t length = strcspn(target, "*");
+  if (length >= sizeof(code_hex)) {
+    return false;
+  }
+  memcpy(code_hex, target, length);
+  code_hex[length] = '\0';
+  uint8_t repeats = 1;
+  if (target[length] == '*' && !parse_repeats(&target[length + 1], &repeats)) {
+    return false;
+  }
+  return queue_transmit(RfCode::from_hex(code_hex), repeats);
+}
+
+static void handle_transmit() {
+  if (!authenticate_admin()) {
+    return;
+  }
+  const String &code = server.arg("code");
+  const String &repeats_arg = server.arg("repeats");
+  if (code.length() != RF_CODE_HEX_SIZE - 1) {
+    server.send(400, "text/plain", "code must be 18 hex digits of timings and data");
+    return;
+  }
+  uint8_t repeats = 1;
+  if (repeats_arg.length() > 0 && !parse_repeats(repeats_arg.c_str(), &repeats)) {
+    server.send(400, "text/plain", "repeats must be a number from 1 to " + String(RF_MAX_REPEATS));
+    return;
+  }
+  if (!queue_transmit(RfCode::from_hex(code.c_str()), repeats)) {
+    server.send(503, "text/plain", "Failed to queue code");
+    return;
+  }
+  server.send(200, "text/plain", "Queued");
+}
+
+// Get the total length of a message of the given type from the RF module, including the start and end bytes, or 0 if
+// its length varies.
+static size_t message_size(uint8_t type) {
+  switch (type) {
+    case 0xa0:
+    case 0xa2:
+      return 3;
+    case 0xa3:
+    case 0xa4:
+      return 12;
+    default:
+      return 0;
+  }
+}
+
+// Check whether a message whose length varies has been completely received, given that the last byte received was the
+// end byte.
+static bool variable_message_complete() {
+  if (message[1] != 0xb1) {
+    return true;
+  }
+  // A raw frame has a count of buckets, 2 bytes for each bucket, then at least one byte of data before the end byte,
+  // so an end byte before then is part of a bucket.
+  return message_length >= 3 + (size_t) message[2] * 2 + 2;
+}
+
+static void handle_message() {
+  switch (message[1]) {
+    case 0xa4:
+      send_ack();
+      handle_button(RfCode::from_message(&message[2]), message_start_time);
+      break;
+    case 0xa0:
+      handle_transmit_ack();
+      break;
+    case 0xa2:
+      send_ack();
+      if (learn_state == LEARN_WAITING) {
+        LOGLN("Learning timed out");
+        learn_state = LEARN_FAILED;
+      }
+      break;
+    case 0xa3:
+      send_ack();
+      if (learn_state == LEARN_WAITING) {
+        learned_code = RfCode::from_message(&message[2]);
+        LOGLN("Learned code");
+        learn_state = LEARN_SUCCEEDED;
+      }
+      break;
+    case 0xb1:
+      capture_frame(message, message_length);
+      handle_button(raw_signature(message, message_length), message_start_time);
+      break;
+    default:
+      LOG("Got unexpected message of type ");
+      LOGH(message[1]);
+      LOGLN("");
+  }
+}
+
+// Add a byte received from the RF module to the current message, and handle the message if it is complete.
+static void receive_byte(uint8_t byte) {
+  if (message_length == 0) {
+    if (byte != 0xaa) {
+      // Not the start of a message, so ignore it.
+      return;
+    }
+    message_start_time = millis();
+  } else if (message_length == RF_MAX_MESSAGE_SIZE) {
+    LOGLN("Message from RF module too long");
+    ++capture_stats.overflows;
+    message_length = 0;
+    return;
+  }
+  message[message_length++] = byte;
+  if (message_length < 3) {
+    return;
+  }
+  size_t size = message_size(message[1]);
+  if (size != 0 && message_length < size) {
+    return;
+  }
+  if (byte == 0x55 && (size != 0 || variable_message_complete())) {
+    handle_message();
+    message_length = 0;
+  } else if (size != 0) {
+    LOG("Message from RF module didn't end as expected, type ");
+    LOGH(message[1]);
+    LOGLN("");
+    message_length = 0;
+  }
+}
+
+// Switch the RF module between decoding codes itself and sending raw frames of pulse timings. Raw frames need the
+// Portisch firmware on the RF module.
+void set_raw_mode(bool enabled) {
+  LOG("Setting raw mode ");
+  LOGLN(enabled);
+  raw_mode = enabled;
+  Serial.write(0xaa);
+  // Start bucket sniffing, or stop sniffing and go back to decoding.
+  Serial.write(enabled ? 0xb1 : 0xa7);
+  Serial.write(0x55);
+  Serial.flush();
+}
+
+void rf_init() {
+  server.on("/transmit", HTTP_POST, handle_transmit);
+  capture_init();
+  if (raw_mode) {
+    set_raw_mode(true);
+  }
+}
+
+void rf_loop() {
+  // Only read what has already arrived, so that waiting for the rest of a message doesn't hold up the loop.
+  for (size_t available = Serial.available(); available > 0; --available) {
+    receive_byte(Serial.read());
   }
+  learn_loop();
+  transmit_loop();
 }
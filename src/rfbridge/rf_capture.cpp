@@ -0,0 +1,146 @@
+/*
+Copyright 2018 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ */
+
+#include "rf_capture.h"
+
+#include "config.h"
+#include "logging.h"
+#include "rf.h"
+#include "streamutils.h"
+#include "webserver.h"
+#include "ButtonCommand.h"
+
+#include <Arduino.h>
+#include <ESP8266WebServer.h>
+
+CaptureStats capture_stats;
+bool raw_mode = false;
+
+#if RF_MAX_MESSAGE_SIZE > 255 || RF_MAX_MESSAGE_SIZE >= RF_CAPTURE_BUFFER_SIZE
+#error "Captured frames must fit in the capture buffer with a 1 byte length"
+#endif
+
+// Raw frames from the RF module, oldest first, each preceded by a byte of its length. The buffer wraps around, so a
+// frame may be split between the end and the start.
+static uint8_t capture_buffer[RF_CAPTURE_BUFFER_SIZE];
+static size_t capture_start = 0;
+static size_t capture_length = 0;
+
+// Number of bytes before the data of a raw frame: start byte, type, bucket count and the buckets.
+static size_t raw_header_size(const uint8_t *frame) {
+  return 3 + frame[2] * 2;
+}
+
+static uint8_t capture_byte(size_t position) {
+  return capture_buffer[(capture_start + position) % RF_CAPTURE_BUFFER_SIZE];
+}
+
+// Copy a raw frame into the capture buffer, dropping the oldest frames if there isn't room for it.
+void capture_frame(const uint8_t *frame, size_t length) {
+  ++capture_stats.frames;
+  capture_stats.bytes += length;
+  while (capture_length + length + 1 > RF_CAPTURE_BUFFER_SIZE) {
+    size_t oldest_length = capture_byte(0) + 1;
+    capture_start = (capture_start + oldest_length) % RF_CAPTURE_BUFFER_SIZE;
+    capture_length -= oldest_length;
+    ++capture_stats.dropped;
+  }
+  size_t end = (capture_start + capture_length) % RF_CAPTURE_BUFFER_SIZE;
+  capture_buffer[end] = length;
+  for (size_t i = 0; i < length; ++i) {
+    capture_buffer[(end + 1 + i) % RF_CAPTURE_BUFFER_SIZE] = frame[i];
+  }
+  capture_length += length + 1;
+}
+
+size_t capture_used() {
+  return capture_length;
+}
+
+// Make a code to identify a raw frame, so that it can be matched like a decoded one. The timings are those of the first
+// buckets, and the data bytes are a hash of which bucket each pulse falls in, which doesn't depend on exact timings.
+RfCode raw_signature(const uint8_t *frame, size_t length) {
+  RfCode code;
+  size_t header_size = raw_header_size(frame);
+  for (size_t i = 0; i < RF_TIMING_COUNT && i < frame[2]; ++i) {
+    code.timings[i] = (frame[3 + i * 2] << 8) | frame[4 + i * 2];
+  }
+  // FNV-1a, folded to the size of a code.
+  uint32_t hash = 2166136261;
+  for (size_t i = header_size; i < length - 1; ++i) {
+    hash = (hash ^ frame[i]) * 16777619;
+  }
+  hash = (hash >> 24) ^ (hash & 0xffffff);
+  code.bytes[0] = hash >> 16;
+  code.bytes[1] = hash >> 8;
+  code.bytes[2] = hash;
+  return code;
+}
+
+// List captured frames, one per line, as the code they match followed by the whole frame in hex. A POST can also switch
+// raw mode on or off with raw=1 or raw=0, and clear the captured frames after listing them with clear=1.
+static void handle_capture() {
+  if (!authenticate_admin()) {
+    return;
+  }
+  if (server.method() != HTTP_POST && (server.hasArg("raw") || server.hasArg("clear"))) {
+    server.send(405, "text/plain", "Use POST to change raw mode or clear captured frames");
+    return;
+  }
+  if (server.hasArg("raw")) {
+    bool enabled = server.arg("raw") == "1";
+    if (enabled != raw_mode) {
+      set_raw_mode(enabled);
+      write_line_to_file("/raw_mode.txt", enabled ? "1" : "0");
+    }
+  }
+
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "text/plain", "");
+  uint8_t frame[RF_MAX_MESSAGE_SIZE];
+  // The code, a space, the frame, a newline and a NUL.
+  char line[RF_CODE_HEX_SIZE + RF_MAX_MESSAGE_SIZE * 2 + 2];
+  size_t position = 0;
+  while (position < capture_length) {
+    size_t length = capture_byte(position);
+    for (size_t i = 0; i < length; ++i) {
+      frame[i] = capture_byte(position + 1 + i);
+    }
+    position += length + 1;
+    raw_signature(frame, length).to_hex(line);
+    char *end = &line[RF_CODE_HEX_SIZE - 1];
+    *end++ = ' ';
+    for (size_t i = 0; i < length; ++i) {
+      snprintf(end, 3, "%02x", frame[i]);
+      end += 2;
+    }
+    *end++ = '\n';
+    *end = '\0';
+    server.sendContent(line);
+  }
+  server.sendContent("");
+
+  if (server.arg("clear") == "1") {
+    capture_start = 0;
+    capture_length = 0;
+  }
+}
+
+void capture_init() {
+  raw_mode = read_line_from_file("/raw_mode.txt") == "1";
+  server.on("/capture", HTTP_GET, handle_capture);
+  server.on("/capture", HTTP_POST, handle_capture);
+}
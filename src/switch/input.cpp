@@ -0,0 +1,217 @@
+/*
+Copyright 2018 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ */
+
+#include "input.h"
+
+#include "config.h"
+#include "logging.h"
+#include "scene.h"
+#include "sinric.h"
+#include "streamutils.h"
+
+#include <Arduino.h>
+
+// Buttons connect their pin to ground when pressed. The interrupt handler only timestamps each edge and puts it on a
+// queue, and the loop debounces them using those timestamps, so a press isn't lost or mistimed if the loop is held up
+// by the websocket or the web server.
+
+const uint8_t input_pins[] = INPUT_PINS;
+const size_t num_inputs = sizeof(input_pins);
+
+static const char *input_actions_path = "/input_actions.txt";
+const char *const input_action_names[] = {"none", "toggle", "dim", "scene"};
+
+InputAction input_actions[NUM_INPUTS][INPUT_PRESS_COUNT];
+InputStats input_stats;
+
+struct InputEvent {
+  uint32_t time;
+  uint8_t input;
+  bool level;
+};
+
+static_assert((INPUT_QUEUE_SIZE & (INPUT_QUEUE_SIZE - 1)) == 0, "INPUT_QUEUE_SIZE must be a power of 2");
+// Written only by the interrupt handler at queue_head, and read only by the loop at queue_tail.
+static volatile InputEvent input_queue[INPUT_QUEUE_SIZE];
+static volatile uint8_t queue_head = 0;
+static volatile uint8_t queue_tail = 0;
+static volatile uint32_t queue_overflows = 0;
+
+struct InputState {
+  // Debounced state.
+  bool pressed;
+  bool long_press_run;
+  uint32_t press_time;
+  // The last edge seen, which is accepted once the level has been stable for INPUT_DEBOUNCE_TIME.
+  bool edge_pending;
+  bool edge_level;
+  uint32_t edge_time;
+};
+
+static InputState input_states[NUM_INPUTS];
+
+static void ICACHE_RAM_ATTR input_interrupt(void *arg) {
+  size_t input = (size_t) arg;
+  uint8_t head = queue_head;
+  uint8_t next = (head + 1) & (INPUT_QUEUE_SIZE - 1);
+  if (next == queue_tail) {
+    ++queue_overflows;
+    return;
+  }
+  input_queue[head].time = millis();
+  input_queue[head].input = input;
+  input_queue[head].level = digitalRead(input_pins[input]);
+  queue_head = next;
+}
+
+static String format_input_action(const InputAction &action) {
+  return action.type == INPUT_NONE ? String() :
+    String(input_action_names[action.type]) + " " + action.target;
+}
+
+static void parse_input_action(const String &line, InputAction *action) {
+  int space = line.indexOf(' ');
+  action->type = INPUT_NONE;
+  for (uint8_t type = 0; type < INPUT_ACTION_COUNT; ++type) {
+    if (line.substring(0, space) == input_action_names[type]) {
+      action->type = type;
+    }
+  }
+  action->target = space < 0 ? 0 : line.substring(space + 1).toInt();
+}
+
+// Store the actions as a line for each press of each input, such as "toggle 2", or an empty line for none.
+bool save_input_actions() {
+  String lines[NUM_INPUTS * INPUT_PRESS_COUNT];
+  for (size_t input = 0; input < num_inputs; ++input) {
+    for (size_t press = 0; press < INPUT_PRESS_COUNT; ++press) {
+      lines[input * INPUT_PRESS_COUNT + press] = format_input_action(input_actions[input][press]);
+    }
+  }
+  return write_strings_to_file(input_actions_path, lines, num_inputs * INPUT_PRESS_COUNT);
+}
+
+static bool load_input_actions() {
+  String lines[NUM_INPUTS * INPUT_PRESS_COUNT];
+  bool success = read_strings_from_file(input_actions_path, lines, num_inputs * INPUT_PRESS_COUNT);
+  for (size_t input = 0; input < num_inputs; ++input) {
+    for (size_t press = 0; press < INPUT_PRESS_COUNT; ++press) {
+      parse_input_action(lines[input * INPUT_PRESS_COUNT + press], &input_actions[input][press]);
+    }
+  }
+  return success;
+}
+
+static void run_input_action(size_t input, InputPress press) {
+  ++input_stats.presses[press];
+  const InputAction &action = input_actions[input][press];
+  LOG("Input ");
+  LOG(input);
+  LOG(press == LONG_PRESS ? " long press: " : " short press: ");
+  LOGLN(format_input_action(action));
+  switch (action.type) {
+    case INPUT_TOGGLE:
+      if (action.target < num_switches) {
+        switch_state[action.target] = !switch_state[action.target];
+        update_switch(action.target);
+        report_switch_state(action.target);
+      }
+      break;
+    case INPUT_DIM:
+      if (action.target < num_switches) {
+        int brightness = switch_brightness[action.target] - INPUT_DIM_STEP;
+        switch_brightness[action.target] = switch_state[action.target] && brightness > 0 ? brightness : 100;
+        switch_state[action.target] = true;
+        update_switch(action.target);
+        report_switch_state(action.target);
+      }
+      break;
+    case INPUT_SCENE:
+      apply_scene(action.target);
+      break;
+    default:
+      break;
+  }
+  // Someone is standing at the switch, so don't wait to batch up more changes.
+  flush_switch_reports();
+}
+
+// Accept a debounced edge which happened at the given time.
+static void accept_edge(size_t input, bool level, uint32_t time) {
+  InputState &state = input_states[input];
+  bool pressed = level == LOW;
+  if (pressed == state.pressed) {
+    return;
+  }
+  state.pressed = pressed;
+  if (pressed) {
+    state.press_time = time;
+    state.long_press_run = false;
+  } else if (!state.long_press_run) {
+    run_input_action(input, time - state.press_time >= INPUT_LONG_PRESS_TIME ? LONG_PRESS : SHORT_PRESS);
+  }
+}
+
+void input_setup() {
+  load_input_actions();
+  for (size_t input = 0; input < num_inputs; ++input) {
+    pinMode(input_pins[input], INPUT_PULLUP);
+    input_states[input].pressed = digitalRead(input_pins[input]) == LOW;
+    // Don't treat a button held down since startup as a press.
+    input_states[input].long_press_run = true;
+    attachInterruptArg(digitalPinToInterrupt(input_pins[input]), input_interrupt, (void *) input, CHANGE);
+  }
+}
+
+void input_loop() {
+  while (queue_tail != queue_head) {
+    const volatile InputEvent &event = input_queue[queue_tail];
+    InputState &state = input_states[event.input];
+    // An edge followed by another within the debounce time was a bounce, so only the later one counts.
+    if (state.edge_pending && event.time - state.edge_time >= INPUT_DEBOUNCE_TIME) {
+      accept_edge(event.input, state.edge_level, state.edge_time);
+    }
+    state.edge_pending = true;
+    state.edge_level = event.level;
+    state.edge_time = event.time;
+    queue_tail = (queue_tail + 1) & (INPUT_QUEUE_SIZE - 1);
+  }
+
+  if (queue_overflows != input_stats.overflows) {
+    // Some edges were lost, so resynchronise with the pins.
+    input_stats.overflows = queue_overflows;
+    for (size_t input = 0; input < num_inputs; ++input) {
+      input_states[input].edge_pending = true;
+      input_states[input].edge_level = digitalRead(input_pins[input]);
+      input_states[input].edge_time = millis();
+    }
+  }
+
+  uint32_t now = millis();
+  for (size_t input = 0; input < num_inputs; ++input) {
+    InputState &state = input_states[input];
+    if (state.edge_pending && now - state.edge_time >= INPUT_DEBOUNCE_TIME) {
+      state.edge_pending = false;
+      accept_edge(input, state.edge_level, state.edge_time);
+    }
+    // Run the long press action as soon as the button has been held long enough, rather than waiting for it to be
+    // released.
+    if (state.pressed && !state.long_press_run && now - state.press_time >= INPUT_LONG_PRESS_TIME) {
+      state.long_press_run = true;
+      run_input_action(input, LONG_PRESS);
+    }
+  }
+}
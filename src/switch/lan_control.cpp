@@ -0,0 +1,222 @@
+/*
+Copyright 2018 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ */
+
+#include "lan_control.h"
+
+#include "config.h"
+#include "crypto.h"
+#include "logging.h"
+#include "scene.h"
+#include "sinric.h"
+#include "state_store.h"
+#include "streamutils.h"
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <WiFiUdp.h>
+#include <time.h>
+
+// Switches can be controlled over the LAN with UDP datagrams, without going through Sinric. All integers are little
+// endian. A request is:
+//
+//   "QS", version (1), type (1 = request), 8 byte counter, operation count, operations, authentication code
+//
+// where each operation is a 2 byte switch index, an op code and a value, and the authentication code is the first 16
+// bytes of the HMAC-SHA256 of everything before it, keyed with lan_key. The counter must increase with every request,
+// and should be the client's time in milliseconds since the Unix epoch. The highest counter accepted is kept across
+// restarts by the state store, so that old requests can't be replayed, and once the clock is set the counter is also
+// checked against it. The reply has the same layout with type 2, the counter from the request, and the state and
+// brightness of each switch operated on in place of the op code and value, after all the operations.
+//
+// tools/lan_client.py can send requests and measure the time taken.
+
+#define LAN_MAGIC_0 'Q'
+#define LAN_MAGIC_1 'S'
+#define LAN_VERSION 1
+#define LAN_HEADER_SIZE 13
+#define LAN_OPERATION_SIZE 4
+#define LAN_TAG_SIZE 16
+#define LAN_MAX_OPERATIONS 32
+#define LAN_MAX_PACKET_SIZE (LAN_HEADER_SIZE + LAN_MAX_OPERATIONS * LAN_OPERATION_SIZE + LAN_TAG_SIZE)
+// Times before this mean the clock hasn't been set yet.
+#define MIN_VALID_TIME (3600 * 48)
+
+enum LanMessageType {
+  LAN_REQUEST = 1,
+  LAN_REPLY = 2,
+};
+
+enum LanOperation {
+  // Turn the switch off, ignoring the value.
+  LAN_OFF = 0,
+  // Turn the switch on, ignoring the value.
+  LAN_ON = 1,
+  // Set the brightness to the value, in percent, without turning the switch on or off.
+  LAN_BRIGHTNESS = 2,
+  // Just get the state.
+  LAN_QUERY = 3,
+  // Apply the scene with the value as its index, ignoring the switch index. The reply has the state of the switch.
+  LAN_SCENE = 4,
+};
+
+String lan_key;
+LanStats lan_stats;
+
+static WiFiUDP lan_udp;
+static uint8_t packet[LAN_MAX_PACKET_SIZE];
+
+static uint16_t get_uint16(const uint8_t *buffer) {
+  return buffer[0] | (buffer[1] << 8);
+}
+
+static uint64_t get_uint64(const uint8_t *buffer) {
+  uint64_t value = 0;
+  for (int i = 7; i >= 0; --i) {
+    value = (value << 8) | buffer[i];
+  }
+  return value;
+}
+
+static void compute_tag(size_t length, uint8_t tag[HMAC_SHA256_SIZE]) {
+  hmac_sha256(lan_key.c_str(), lan_key.length(), packet, length, tag);
+}
+
+// Check that the request in packet is well formed, authentic and new. Returns the number of operations, or -1 if it
+// should be ignored.
+static int check_request(size_t length) {
+  if (length < LAN_HEADER_SIZE + LAN_TAG_SIZE || packet[0] != LAN_MAGIC_0 || packet[1] != LAN_MAGIC_1 ||
+      packet[2] != LAN_VERSION || packet[3] != LAN_REQUEST) {
+    ++lan_stats.invalid;
+    return -1;
+  }
+  size_t operation_count = packet[12];
+  size_t signed_length = LAN_HEADER_SIZE + operation_count * LAN_OPERATION_SIZE;
+  if (operation_count > LAN_MAX_OPERATIONS || length != signed_length + LAN_TAG_SIZE) {
+    ++lan_stats.invalid;
+    return -1;
+  }
+  uint8_t tag[HMAC_SHA256_SIZE];
+  compute_tag(signed_length, tag);
+  if (!constant_time_equal(tag, &packet[signed_length], LAN_TAG_SIZE)) {
+    LOGLN("LAN request has wrong authentication code");
+    ++lan_stats.invalid;
+    return -1;
+  }
+  uint64_t counter = get_uint64(&packet[4]);
+  time_t now = time(nullptr);
+  int64_t skew = (int64_t) (counter / 1000) - now;
+  if (counter <= last_lan_counter() ||
+      (now > MIN_VALID_TIME && (skew > LAN_MAX_CLOCK_SKEW || skew < -LAN_MAX_CLOCK_SKEW))) {
+    LOGLN("LAN request is stale");
+    ++lan_stats.stale;
+    return -1;
+  }
+  save_lan_counter(counter);
+  return operation_count;
+}
+
+// Apply the operations in the request in packet, and replace each with the resulting state of the switch. The switches
+// are all updated together once every operation has been applied, the same way as for a scene.
+static void apply_operations(size_t operation_count) {
+  bool selected[NUM_SWITCHES] = {false};
+  for (size_t operation = 0; operation < operation_count; ++operation) {
+    uint8_t *fields = &packet[LAN_HEADER_SIZE + operation * LAN_OPERATION_SIZE];
+    size_t i = get_uint16(fields);
+    if (fields[2] == LAN_SCENE) {
+      set_scene_levels(fields[3], selected);
+      continue;
+    }
+    if (i >= num_switches) {
+      continue;
+    }
+    switch (fields[2]) {
+      case LAN_OFF:
+      case LAN_ON:
+        switch_state[i] = fields[2] == LAN_ON;
+        selected[i] = true;
+        break;
+      case LAN_BRIGHTNESS:
+        switch_brightness[i] = constrain(fields[3], 0, 100);
+        selected[i] = true;
+        break;
+      default:
+        break;
+    }
+  }
+
+  bool any_selected = false;
+  for (size_t i = 0; i < num_switches; ++i) {
+    any_selected |= selected[i];
+  }
+  if (any_selected) {
+    update_switches(selected);
+    for (size_t i = 0; i < num_switches; ++i) {
+      if (selected[i]) {
+        report_switch_state(i);
+      }
+    }
+  }
+
+  for (size_t operation = 0; operation < operation_count; ++operation) {
+    uint8_t *fields = &packet[LAN_HEADER_SIZE + operation * LAN_OPERATION_SIZE];
+    size_t i = get_uint16(fields);
+    fields[2] = i < num_switches ? switch_state[i] : 0;
+    fields[3] = i < num_switches ? switch_brightness[i] : 0;
+  }
+}
+
+static void handle_lan_packet(size_t length) {
+  ++lan_stats.requests;
+  int operation_count = check_request(length);
+  if (operation_count < 0) {
+    return;
+  }
+  apply_operations(operation_count);
+
+  packet[3] = LAN_REPLY;
+  size_t signed_length = LAN_HEADER_SIZE + operation_count * LAN_OPERATION_SIZE;
+  uint8_t tag[HMAC_SHA256_SIZE];
+  compute_tag(signed_length, tag);
+  memcpy(&packet[signed_length], tag, LAN_TAG_SIZE);
+  lan_udp.beginPacket(lan_udp.remoteIP(), lan_udp.remotePort());
+  lan_udp.write(packet, signed_length + LAN_TAG_SIZE);
+  lan_udp.endPacket();
+}
+
+void lan_control_setup() {
+  lan_key = read_line_from_file("/lan_key.txt");
+  if (lan_key.length() == 0) {
+    LOGLN("No LAN key, so LAN control is disabled");
+    return;
+  }
+  // Modem sleep can delay received packets by a whole beacon interval.
+  WiFi.setSleepMode(WIFI_NONE_SLEEP);
+  lan_udp.begin(LAN_CONTROL_PORT);
+}
+
+void lan_control_loop() {
+  if (lan_key.length() == 0) {
+    return;
+  }
+  for (int length = lan_udp.parsePacket(); length > 0; length = lan_udp.parsePacket()) {
+    if (length > LAN_MAX_PACKET_SIZE) {
+      ++lan_stats.requests;
+      ++lan_stats.invalid;
+      continue;
+    }
+    handle_lan_packet(lan_udp.read(packet, sizeof(packet)));
+  }
+}
@@ -15,8 +15,12 @@ limitations under the License.
  */
 
 #include "config.h"
+#include "input.h"
+#include "lan_control.h"
 #include "logging.h"
+#include "schedule.h"
 #include "sinric.h"
+#include "state_store.h"
 #include "streamutils.h"
 #include "webserver.h"
 #include "wifi.h"
@@ -39,10 +43,13 @@ void setup() {
   SPIFFS.begin();
 
   sinric_setup();
+  input_setup();
 
   if (wifi_setup()) {
     sinric_connect();
   }
+  lan_control_setup();
+  schedule_setup();
 
   if (!MDNS.begin(MDNS_HOSTNAME)) {
     LOGLN("Error starting mDNS");
@@ -56,8 +63,12 @@ void setup() {
 }
 
 void loop() {
+  input_loop();
+  lan_control_loop();
   webserver_loop();
   sinric_loop();
+  state_store_loop();
+  schedule_loop();
 
   #if OTA_UPDATE
   ArduinoOTA.handle();
@@ -16,13 +16,109 @@ limitations under the License.
 
 #include "module_webserver.h"
 
+#include "api.h"
+#include "input.h"
+#include "lan_control.h"
 #include "logging.h"
+#include "metrics.h"
+#include "scene.h"
+#include "schedule.h"
 #include "sinric.h"
+#include "state_store.h"
 #include "streamutils.h"
+#include "webserver.h"
 
 #include <Arduino.h>
 #include <ESP8266WebServer.h>
 
+static const char *const day_names[] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+static const char *const schedule_type_names[] = {"time", "sunrise", "sunset", "once"};
+static const char *const schedule_action_names[] = {"off", "on", "brightness"};
+static const char *const input_press_names[] = {"short", "long"};
+
+// Find the index of the given name in a list of names, or return count if it isn't there.
+static uint8_t find_name(const String &name, const char *const names[], uint8_t count) {
+  uint8_t i = 0;
+  while (i < count && name != names[i]) {
+    ++i;
+  }
+  return i;
+}
+
+// Add a schedule entry from the fields of the form in module_root_output.
+static bool add_schedule_entry_from_args(ESP8266WebServer &server) {
+  ScheduleEntry entry;
+  memset(&entry, 0, sizeof(entry));
+  entry.switch_index = server.arg("schedule_switch").toInt();
+  entry.type = find_name(server.arg("schedule_type"), schedule_type_names, SCHEDULE_TYPE_COUNT);
+  entry.action = find_name(server.arg("schedule_action"), schedule_action_names, SCHEDULE_ACTION_COUNT);
+  entry.value = constrain(server.arg("schedule_value").toInt(), 0, 100);
+  for (int day = 0; day < 7; ++day) {
+    if (server.hasArg(String("schedule_day") + day)) {
+      entry.days |= 1 << day;
+    }
+  }
+  // Time of day, offset from sunrise or sunset in minutes, or date and time, depending on the type.
+  const String &time = server.arg("schedule_time");
+  struct tm date;
+  memset(&date, 0, sizeof(date));
+  switch (entry.type) {
+    case SCHEDULE_TIME:
+      if (sscanf(time.c_str(), "%d:%d", &date.tm_hour, &date.tm_min) != 2) {
+        return false;
+      }
+      entry.minutes = date.tm_hour * 60 + date.tm_min;
+      break;
+    case SCHEDULE_SUNRISE:
+    case SCHEDULE_SUNSET:
+      entry.minutes = time.toInt();
+      break;
+    case SCHEDULE_ONCE:
+      if (sscanf(time.c_str(), "%d-%d-%dT%d:%d", &date.tm_year, &date.tm_mon, &date.tm_mday, &date.tm_hour,
+          &date.tm_min) != 5) {
+        return false;
+      }
+      date.tm_year -= 1900;
+      date.tm_mon -= 1;
+      date.tm_isdst = -1;
+      entry.once_time = mktime(&date);
+      break;
+  }
+  return entry.switch_index < num_switches && add_schedule_entry(entry);
+}
+
+static void render_schedule_entry(HtmlWriter &html, const ScheduleEntry &entry) {
+  html.render("{} {}", switch_names[entry.switch_index], schedule_action_names[entry.action]);
+  if (entry.action == SCHEDULE_BRIGHTNESS) {
+    html.render(" {}%", entry.value);
+  }
+  char time[20];
+  switch (entry.type) {
+    case SCHEDULE_TIME:
+      snprintf(time, sizeof(time), "%02d:%02d", entry.minutes / 60, entry.minutes % 60);
+      html.render(" at {}", time);
+      break;
+    case SCHEDULE_SUNRISE:
+    case SCHEDULE_SUNSET:
+      html.render(" {} minutes after {}", entry.minutes, schedule_type_names[entry.type]);
+      break;
+    case SCHEDULE_ONCE: {
+        time_t once_time = entry.once_time;
+        struct tm date;
+        localtime_r(&once_time, &date);
+        strftime(time, sizeof(time), "%Y-%m-%d %H:%M", &date);
+        html.render(" once at {}", time);
+        return;
+      }
+  }
+  html.render(" on");
+  for (int day = 0; day < 7; ++day) {
+    if (entry.days & (1 << day)) {
+      html.render(" {}", day_names[day]);
+    }
+  }
+}
+
 void module_handle_root_args(ESP8266WebServer &server, String &error) {
   const String &new_sinric_api_key = server.arg("sinric_api_key");
   if (new_sinric_api_key.length() > 0) {
@@ -35,17 +131,78 @@ void module_handle_root_args(ESP8266WebServer &server, String &error) {
     }
   }
 
+  const String &new_lan_key = server.arg("lan_key");
+  if (new_lan_key.length() > 0) {
+    if (write_line_to_file("/lan_key.txt", new_lan_key.c_str())) {
+      lan_control_setup();
+    } else {
+      LOGLN("Failed to save new LAN key.");
+      error = "Failed to save new LAN key.";
+    }
+  }
+
+  // Add and remove schedule entries
+  if (server.hasArg("add_schedule") && !add_schedule_entry_from_args(server)) {
+    error = "Failed to add schedule entry.";
+  }
+  for (size_t i = 0; i < schedule_length; ++i) {
+    if (server.hasArg(String("delete_schedule") + i)) {
+      remove_schedule_entry(i);
+      break;
+    }
+  }
+
+  // Save, apply and remove scenes
+  if (server.hasArg("add_scene") && !add_scene_from_current_state(server.arg("scene_name"))) {
+    error = "Failed to add scene.";
+  }
+  for (size_t i = 0; i < scene_count; ++i) {
+    if (server.hasArg(String("apply_scene") + i)) {
+      apply_scene(i);
+      break;
+    } else if (server.hasArg(String("delete_scene") + i)) {
+      remove_scene(i);
+      break;
+    }
+  }
+  if (server.hasArg("update_scenes")) {
+    for (size_t i = 0; i < scene_count; ++i) {
+      scenes[i].sinric_id = server.arg(String("scene_id") + i);
+    }
+    if (!save_scenes()) {
+      error = "Failed to save scenes.";
+    }
+  }
+
+  // Update button actions
+  if (server.hasArg("update_inputs")) {
+    for (size_t input = 0; input < num_inputs; ++input) {
+      for (size_t press = 0; press < INPUT_PRESS_COUNT; ++press) {
+        String field = String("input") + input + input_press_names[press];
+        InputAction &action = input_actions[input][press];
+        action.type = find_name(server.arg(field + "_action"), input_action_names, INPUT_ACTION_COUNT);
+        if (action.type == INPUT_ACTION_COUNT) {
+          action.type = INPUT_NONE;
+        }
+        action.target = server.arg(field + "_target").toInt();
+      }
+    }
+    if (!save_input_actions()) {
+      error = "Failed to save button actions.";
+    }
+  }
+
   // Toggle switches
   for (size_t i = 0; i < num_switches; ++i) {
     if (server.hasArg(String("on") + i)) {
       switch_state[i] = true;
       update_switch(i);
-      send_switch_state(i);
+      report_switch_state(i);
       break;
     } else if (server.hasArg(String("off") + i)) {
       switch_state[i] = false;
       update_switch(i);
-      send_switch_state(i);
+      report_switch_state(i);
       break;
     }
   }
@@ -62,6 +219,7 @@ void module_handle_root_args(ESP8266WebServer &server, String &error) {
       switch_inverted[i] = server.hasArg(String("switch_inverted") + i);
       update_switch(i);
     }
+    restore_last_state = server.hasArg("restore_last_state");
     save_switch_config();
     if (updated_switch_ids) {
       save_switch_ids();
@@ -69,22 +227,219 @@ void module_handle_root_args(ESP8266WebServer &server, String &error) {
   }
 }
 
-void module_root_output(ESP8266WebServer &server) {
-  server.sendContent(String("<h2>Sinric</h2>") +
-    "<form method=\"post\" action=\"/\">" +
-    "API key: <input type=\"text\" name=\"sinric_api_key\" value=\"" + sinric_api_key + "\"/><br/>"
+void module_root_output(HtmlWriter &html) {
+  html.render("<h2>Sinric</h2>"
+    "<form method=\"post\" action=\"/\">"
+    "API key: <input type=\"text\" name=\"sinric_api_key\" value=\"{}\"/><br/>"
     "<input type=\"submit\" value=\"Update API key\"/>"
     "</form>"
+    "<h2>LAN control</h2>"
+    "<form method=\"post\" action=\"/\">"
+    "Key: <input type=\"text\" name=\"lan_key\" value=\"{}\"/><br/>"
+    "<input type=\"submit\" value=\"Update LAN key\"/>"
+    "</form>"
     "<h2>Switch IDs</h2>"
     "<form method=\"post\" action=\"/\"><table>"
-    "<tr><th>Pin</th><th>Sinric ID</th><th>Initial</th><th>Inverted</th><th>State</th><th>Toggle</th></tr>");
+    "<tr><th>Pin</th><th>Sinric ID</th><th>Initial</th><th>Inverted</th><th>State</th><th>Toggle</th></tr>",
+    sinric_api_key, lan_key);
   for (size_t i = 0; i < num_switches; ++i) {
-    server.sendContent(String("<tr><td>") + switch_names[i] + " (pin" + switch_pins[i] + ")</td>"
-      "<td><input type=\"text\" name=\"switch_id" + i + "\" value=\"" + switch_ids[i] + "\"/></td>"
-      "<td><input type=\"checkbox\" name=\"switch_initial" + i + "\" value=\"1\"" + (switch_initial_state[i] ? " checked" : "") + "/></td>"
-      "<td><input type=\"checkbox\" name=\"switch_inverted" + i + "\" value=\"1\"" + (switch_inverted[i] ? " checked" : "") + "/></td>"
-      "<td>" + (switch_state[i] ? "on" : "off") + " (" + switch_brightness[i] + "%)</td>"
-      "<td><input type=\"submit\" name=\"" + (switch_state[i] ? "off" : "on") + i + "\" value=\"Switch " + (switch_state[i] ? "off" : "on") + "\"/></td></tr>");
-  }
-  server.sendContent("</table><input type=\"submit\" name=\"update\" value=\"Update switches\"/></form>");
+    const char *toggle = switch_state[i] ? "off" : "on";
+    html.render("<tr><td>{} (pin{})</td>"
+      "<td><input type=\"text\" name=\"switch_id{}\" value=\"{}\"/></td>"
+      "<td><input type=\"checkbox\" name=\"switch_initial{}\" value=\"1\"{}/></td>"
+      "<td><input type=\"checkbox\" name=\"switch_inverted{}\" value=\"1\"{}/></td>"
+      "<td>{} ({}%)</td>"
+      "<td><input type=\"submit\" name=\"{}{}\" value=\"Switch {}\"/></td></tr>",
+      switch_names[i], switch_pins[i], i, switch_ids[i], i, RawHtml{switch_initial_state[i] ? " checked" : ""}, i,
+      RawHtml{switch_inverted[i] ? " checked" : ""}, switch_state[i] ? "on" : "off", switch_brightness[i], toggle, i,
+      toggle);
+  }
+  html.render("</table>"
+    "<input type=\"checkbox\" id=\"restore_last_state\" name=\"restore_last_state\" value=\"1\"{}/>"
+    "<label for=\"restore_last_state\">Restore last state on restart, instead of initial state</label><br/>"
+    "<input type=\"submit\" name=\"update\" value=\"Update switches\"/></form>",
+    RawHtml{restore_last_state ? " checked" : ""});
+
+  html.render("<h2>Scenes</h2>"
+    "<form method=\"post\" action=\"/\"><table>"
+    "<tr><th>Name</th><th>Sinric ID</th><th></th></tr>");
+  for (size_t i = 0; i < scene_count; ++i) {
+    html.render("<tr><td>{}</td>"
+      "<td><input type=\"text\" name=\"scene_id{}\" value=\"{}\"/></td>"
+      "<td><input type=\"submit\" name=\"apply_scene{}\" value=\"Apply\"/>"
+      "<input type=\"submit\" name=\"delete_scene{}\" value=\"Delete\"/></td></tr>",
+      scenes[i].name, i, scenes[i].sinric_id, i, i);
+  }
+  html.render("</table><input type=\"submit\" name=\"update_scenes\" value=\"Update scene IDs\"/></form>");
+  if (scene_count < MAX_SCENES) {
+    html.render("<form method=\"post\" action=\"/\">"
+      "<input type=\"text\" name=\"scene_name\" placeholder=\"name\"/>"
+      "<input type=\"submit\" name=\"add_scene\" value=\"Save current state as scene\"/></form>");
+  }
+
+  html.render("<h2>Buttons</h2>"
+    "<form method=\"post\" action=\"/\"><table>"
+    "<tr><th>Pin</th><th>Short press</th><th>Long press</th></tr>");
+  for (size_t input = 0; input < num_inputs; ++input) {
+    html.render("<tr><td>pin{}</td>", input_pins[input]);
+    for (size_t press = 0; press < INPUT_PRESS_COUNT; ++press) {
+      const InputAction &action = input_actions[input][press];
+      html.render("<td><select name=\"input{}{}_action\">", input, input_press_names[press]);
+      for (uint8_t type = 0; type < INPUT_ACTION_COUNT; ++type) {
+        html.render("<option{}>{}</option>", RawHtml{type == action.type ? " selected" : ""}, input_action_names[type]);
+      }
+      html.render("</select><input type=\"number\" name=\"input{}{}_target\" min=\"0\" value=\"{}\" "
+        "placeholder=\"switch or scene\"/></td>", input, input_press_names[press], action.target);
+    }
+    html.render("</tr>");
+  }
+  html.render("</table><input type=\"submit\" name=\"update_inputs\" value=\"Update buttons\"/></form>");
+
+  html.render("<h2>Schedule</h2>"
+    "<form method=\"post\" action=\"/\"><ul>");
+  for (size_t i = 0; i < schedule_length; ++i) {
+    html.render("<li>");
+    render_schedule_entry(html, schedule[i]);
+    html.render(" <input type=\"submit\" name=\"delete_schedule{}\" value=\"Delete\"/></li>", i);
+  }
+  html.render("</ul></form>");
+  if (schedule_length < MAX_SCHEDULES) {
+    html.render("<form method=\"post\" action=\"/\"><select name=\"schedule_switch\">");
+    for (size_t i = 0; i < num_switches; ++i) {
+      html.render("<option value=\"{}\">{}</option>", i, switch_names[i]);
+    }
+    html.render("</select><select name=\"schedule_action\">");
+    for (int action = 0; action < SCHEDULE_ACTION_COUNT; ++action) {
+      html.render("<option>{}</option>", schedule_action_names[action]);
+    }
+    html.render("</select><input type=\"number\" name=\"schedule_value\" min=\"0\" max=\"100\" placeholder=\"brightness\"/>"
+      "<select name=\"schedule_type\">");
+    for (int type = 0; type < SCHEDULE_TYPE_COUNT; ++type) {
+      html.render("<option>{}</option>", schedule_type_names[type]);
+    }
+    html.render("</select><input type=\"text\" name=\"schedule_time\" placeholder=\"HH:MM, minutes, or YYYY-MM-DDTHH:MM\"/>");
+    for (int day = 0; day < 7; ++day) {
+      html.render("<label><input type=\"checkbox\" name=\"schedule_day{}\" checked/>{}</label>", day, day_names[day]);
+    }
+    html.render("<input type=\"submit\" name=\"add_schedule\" value=\"Add to schedule\"/></form>");
+  }
+}
+
+static int64_t connection_uptime_millis() {
+  return sinric_connection_uptime();
+}
+
+static int64_t connected_millis() {
+  return connection_stats.connected_millis + sinric_connection_uptime();
+}
+
+static int64_t heartbeat_interval_millis() {
+  return heartbeat_interval;
+}
+
+void module_register_metrics() {
+  register_counter("sinric_reports_sent_total", &report_stats.sent);
+  register_counter("sinric_reports_saved_total", &report_stats.coalesced).labels("reason=\"coalesced\"");
+  register_counter("sinric_reports_saved_total", &report_stats.unchanged).labels("reason=\"unchanged\"");
+  register_counter("lan_requests_total", &lan_stats.requests);
+  register_counter("lan_rejected_requests_total", &lan_stats.invalid).labels("reason=\"invalid\"");
+  register_counter("lan_rejected_requests_total", &lan_stats.stale).labels("reason=\"stale\"");
+  register_counter("sinric_commands_total", &command_stats.handled).labels("result=\"handled\"");
+  register_counter("sinric_commands_total", &command_stats.unknown).labels("result=\"unknown\"");
+  register_counter("input_presses_total", &input_stats.presses[SHORT_PRESS]).labels("press=\"short\"");
+  register_counter("input_presses_total", &input_stats.presses[LONG_PRESS]).labels("press=\"long\"");
+  register_counter("input_queue_overflows_total", &input_stats.overflows);
+  register_gauge("sinric_connection_uptime_seconds", connection_uptime_millis).scale(3);
+  register_counter("sinric_connected_seconds_total", connected_millis).scale(3);
+  register_counter("sinric_reconnects_total", &connection_stats.reconnects);
+  register_counter("sinric_failed_reconnects_total", &connection_stats.reconnect_attempts);
+  register_counter("sinric_idle_disconnects_total", &connection_stats.idle_disconnects);
+  register_gauge("sinric_heartbeat_interval_seconds", heartbeat_interval_millis).scale(3);
+  register_counter("sinric_probes_total", &connection_stats.probes_sent);
+  register_counter("sinric_lost_probes_total", &connection_stats.probes_lost);
+  register_summary("sinric_heartbeat_rtt_seconds", &connection_stats.rtt_sum, &connection_stats.rtt_count, 3);
+  register_gauge("sinric_last_heartbeat_rtt_seconds", &connection_stats.last_rtt).scale(3);
+  register_summary("sinric_command_latency_seconds", &connection_stats.command_micros_sum,
+    &connection_stats.command_count, 6);
+  register_gauge("sinric_max_command_latency_seconds", &connection_stats.command_micros_max).scale(6);
+}
+
+static void handle_api_get_switches() {
+  if (!authenticate_admin()) {
+    return;
+  }
+  JsonWriter writer(server);
+  writer.begin();
+  writer.begin_array();
+  for (size_t i = 0; i < num_switches; ++i) {
+    writer.begin_object()
+      .field("index", i)
+      .field("name", switch_names[i])
+      .field("pin", switch_pins[i])
+      .field("id", switch_ids[i])
+      .field("state", switch_state[i])
+      .field("brightness", switch_brightness[i])
+      .field("initial", switch_initial_state[i])
+      .field("inverted", switch_inverted[i])
+      .end_object();
+  }
+  writer.end_array();
+  writer.end();
+}
+
+// Change switches from an array of objects with an index, and any of an ID, state, brightness, initial state and
+// inverted flag. All the changes are applied together once the whole request has been read.
+static void handle_api_update_switches() {
+  if (!authenticate_admin()) {
+    return;
+  }
+  bool selected[NUM_SWITCHES] = {false};
+  bool config_changed = false;
+  bool ids_changed = false;
+  api_bulk([&](JsonVariant element) -> const char * {
+    if (!element["index"].is<int>() || element["index"].as<int>() < 0 ||
+        element["index"].as<size_t>() >= num_switches) {
+      return "Invalid index";
+    }
+    size_t i = element["index"].as<size_t>();
+    if (element["id"].is<const char *>()) {
+      switch_ids[i] = element["id"].as<const char *>();
+      ids_changed = true;
+    }
+    if (element["state"].is<bool>()) {
+      switch_state[i] = element["state"].as<bool>();
+      selected[i] = true;
+    }
+    if (element["brightness"].is<int>()) {
+      switch_brightness[i] = constrain(element["brightness"].as<int>(), 0, 100);
+      selected[i] = true;
+    }
+    if (element["initial"].is<bool>()) {
+      switch_initial_state[i] = element["initial"].as<bool>();
+      config_changed = true;
+    }
+    if (element["inverted"].is<bool>()) {
+      switch_inverted[i] = element["inverted"].as<bool>();
+      selected[i] = true;
+      config_changed = true;
+    }
+    return nullptr;
+  });
+  update_switches(selected);
+  for (size_t i = 0; i < num_switches; ++i) {
+    if (selected[i]) {
+      report_switch_state(i);
+    }
+  }
+  if (config_changed) {
+    save_switch_config();
+  }
+  if (ids_changed) {
+    save_switch_ids();
+  }
+}
+
+void module_api_setup(ESP8266WebServer &server) {
+  server.on(API_PREFIX "/switches", HTTP_GET, handle_api_get_switches);
+  server.on(API_PREFIX "/switches", HTTP_PUT, handle_api_update_switches);
 }
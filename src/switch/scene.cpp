@@ -0,0 +1,166 @@
+/*
+Copyright 2018 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ */
+
+#include "scene.h"
+
+#include "config.h"
+#include "logging.h"
+#include "sinric.h"
+
+#include <Arduino.h>
+#include <FS.h>
+
+// Scenes are stored in /scenes.txt as three lines each: the name, the Sinric ID, and two hex digits per switch for its
+// level, or "--" if the scene leaves it unchanged.
+
+static const char *scenes_path = "/scenes.txt";
+
+Scene scenes[MAX_SCENES];
+size_t scene_count = 0;
+
+static int hex_digit(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  } else if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  } else if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+static void parse_levels(const String &line, uint8_t levels[]) {
+  for (size_t i = 0; i < num_switches; ++i) {
+    int high = 2 * i + 1 < line.length() ? hex_digit(line[2 * i]) : -1;
+    int low = 2 * i + 1 < line.length() ? hex_digit(line[2 * i + 1]) : -1;
+    levels[i] = high < 0 || low < 0 ? SCENE_UNCHANGED : (high << 4) | low;
+  }
+}
+
+static String format_levels(const uint8_t levels[]) {
+  String line;
+  char digits[3];
+  for (size_t i = 0; i < num_switches; ++i) {
+    if (levels[i] == SCENE_UNCHANGED) {
+      line += "--";
+    } else {
+      snprintf(digits, sizeof(digits), "%02x", levels[i]);
+      line += digits;
+    }
+  }
+  return line;
+}
+
+bool load_scenes() {
+  scene_count = 0;
+  File file = SPIFFS.open(scenes_path, "r");
+  if (!file) {
+    LOGLN("Failed to open /scenes.txt for reading.");
+    return false;
+  }
+  while (scene_count < MAX_SCENES && file.available()) {
+    Scene &scene = scenes[scene_count];
+    scene.name = file.readStringUntil('\n');
+    scene.sinric_id = file.readStringUntil('\n');
+    parse_levels(file.readStringUntil('\n'), scene.levels);
+    if (scene.name.length() > 0) {
+      ++scene_count;
+    }
+  }
+  file.close();
+  return true;
+}
+
+bool save_scenes() {
+  File file = SPIFFS.open(scenes_path, "w");
+  if (!file) {
+    LOGLN("Failed to open /scenes.txt for writing.");
+    return false;
+  }
+  for (size_t i = 0; i < scene_count; ++i) {
+    file.print(scenes[i].name);
+    file.print('\n');
+    file.print(scenes[i].sinric_id);
+    file.print('\n');
+    file.print(format_levels(scenes[i].levels));
+    file.print('\n');
+  }
+  file.close();
+  return true;
+}
+
+bool add_scene_from_current_state(const String &name) {
+  if (scene_count >= MAX_SCENES || name.length() == 0 || name.indexOf('\n') >= 0) {
+    return false;
+  }
+  Scene &scene = scenes[scene_count];
+  scene.name = name;
+  scene.sinric_id = String();
+  for (size_t i = 0; i < num_switches; ++i) {
+    scene.levels[i] = (switch_state[i] ? SCENE_ON_BIT : 0) | switch_brightness[i];
+  }
+  ++scene_count;
+  return save_scenes();
+}
+
+bool remove_scene(size_t i) {
+  if (i >= scene_count) {
+    return false;
+  }
+  for (size_t j = i + 1; j < scene_count; ++j) {
+    scenes[j - 1] = scenes[j];
+  }
+  --scene_count;
+  return save_scenes();
+}
+
+int find_scene_by_id(const char *sinric_id) {
+  for (size_t i = 0; i < scene_count; ++i) {
+    if (scenes[i].sinric_id.length() > 0 && scenes[i].sinric_id == sinric_id) {
+      return i;
+    }
+  }
+  return NO_SCENE;
+}
+
+// Set all the switches in the scene together, and report them to Sinric in one batch.
+// Set the state and brightness of the switches in the scene, and mark them in selected, without updating the pins.
+void set_scene_levels(size_t i, bool selected[]) {
+  if (i >= scene_count) {
+    return;
+  }
+  const Scene &scene = scenes[i];
+  LOG("Applying scene ");
+  LOGLN(scene.name);
+  for (size_t j = 0; j < num_switches; ++j) {
+    if (scene.levels[j] != SCENE_UNCHANGED) {
+      selected[j] = true;
+      switch_state[j] = scene.levels[j] & SCENE_ON_BIT;
+      switch_brightness[j] = constrain(scene.levels[j] & ~SCENE_ON_BIT, 0, 100);
+    }
+  }
+}
+
+void apply_scene(size_t i) {
+  bool selected[NUM_SWITCHES] = {false};
+  set_scene_levels(i, selected);
+  update_switches(selected);
+  for (size_t j = 0; j < num_switches; ++j) {
+    if (selected[j]) {
+      report_switch_state(j);
+    }
+  }
+}
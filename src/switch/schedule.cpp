@@ -0,0 +1,255 @@
+/*
+Copyright 2018 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ */
+
+#include "schedule.h"
+
+#include "config.h"
+#include "logging.h"
+#include "sinric.h"
+#include "streamutils.h"
+
+#include <Arduino.h>
+#include <FS.h>
+#include <math.h>
+#include <time.h>
+
+// The schedule is evaluated only when the next entry is due, rather than on every loop. Times are worked out from the
+// system clock, which keeps running from the last SNTP sync if the internet goes down.
+
+// Times before this mean the clock hasn't been set yet.
+#define MIN_VALID_TIME (3600 * 48)
+#define NEVER ((time_t) -1)
+// Check the clock at least this often even if nothing is due, in case it has been changed.
+#define MAX_SCHEDULE_SLEEP 3600000 // 1 hour
+
+static const char *schedule_path = "/schedules.bin";
+
+ScheduleEntry schedule[MAX_SCHEDULES];
+size_t schedule_length = 0;
+
+// When the schedule was last checked, so entries which fell due since then can be run.
+static time_t last_check_time = 0;
+// When the schedule was last checked as returned by millis(), and how long to wait before checking it again.
+static unsigned long last_check_millis = 0;
+static unsigned long sleep_millis = 0;
+
+// Write the whole schedule: a 2 byte count of entries, the entries, then a CRC-32 of everything before it.
+static bool save_schedule() {
+  File file = SPIFFS.open(schedule_path, "w");
+  if (!file) {
+    LOGLN("Failed to open /schedules.bin for writing.");
+    return false;
+  }
+  uint16_t count = schedule_length;
+  uint32_t crc = crc32_update(0, &count, sizeof(count));
+  crc = crc32_update(crc, schedule, sizeof(ScheduleEntry) * schedule_length);
+  bool success = file.write((const uint8_t *) &count, sizeof(count)) == sizeof(count) &&
+    file.write((const uint8_t *) schedule, sizeof(ScheduleEntry) * schedule_length) == sizeof(ScheduleEntry) * schedule_length &&
+    file.write((const uint8_t *) &crc, sizeof(crc)) == sizeof(crc);
+  file.close();
+  return success;
+}
+
+static bool load_schedule() {
+  schedule_length = 0;
+  File file = SPIFFS.open(schedule_path, "r");
+  if (!file) {
+    LOGLN("Failed to open /schedules.bin for reading.");
+    return false;
+  }
+  uint16_t count;
+  uint32_t crc;
+  bool success = file.read((uint8_t *) &count, sizeof(count)) == sizeof(count) && count <= MAX_SCHEDULES &&
+    file.read((uint8_t *) schedule, sizeof(ScheduleEntry) * count) == sizeof(ScheduleEntry) * count &&
+    file.read((uint8_t *) &crc, sizeof(crc)) == sizeof(crc) &&
+    crc == crc32_update(crc32_update(0, &count, sizeof(count)), schedule, sizeof(ScheduleEntry) * count);
+  file.close();
+  if (!success) {
+    LOGLN("/schedules.bin is damaged.");
+    return false;
+  }
+  schedule_length = count;
+  return true;
+}
+
+// Days since 1970-01-01 of the given date, from Howard Hinnant's days_from_civil.
+static int32_t days_from_civil(int year, unsigned month, unsigned day) {
+  year -= month <= 2;
+  int era = (year >= 0 ? year : year - 399) / 400;
+  unsigned year_of_era = year - era * 400;
+  unsigned day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+  unsigned day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+  return era * 146097 + (int32_t) day_of_era - 719468;
+}
+
+// Work out the time of sunrise or sunset at SCHEDULE_LATITUDE and SCHEDULE_LONGITUDE on the given date, with the
+// NOAA approximation. Returns NEVER if the sun doesn't rise or set that day.
+static time_t sun_event_time(const struct tm &date, bool sunrise) {
+  float gamma = 2 * M_PI / 365 * date.tm_yday;
+  float equation_of_time = 229.18 * (0.000075 + 0.001868 * cos(gamma) - 0.032077 * sin(gamma) -
+    0.014615 * cos(2 * gamma) - 0.040849 * sin(2 * gamma));
+  float declination = 0.006918 - 0.399912 * cos(gamma) + 0.070257 * sin(gamma) - 0.006758 * cos(2 * gamma) +
+    0.000907 * sin(2 * gamma) - 0.002697 * cos(3 * gamma) + 0.00148 * sin(3 * gamma);
+  float latitude = SCHEDULE_LATITUDE * M_PI / 180;
+  // 90.833 degrees allows for refraction and the size of the sun's disc.
+  float cos_hour_angle = cos(90.833 * M_PI / 180) / (cos(latitude) * cos(declination)) - tan(latitude) * tan(declination);
+  if (cos_hour_angle < -1 || cos_hour_angle > 1) {
+    return NEVER;
+  }
+  float hour_angle = acos(cos_hour_angle) * 180 / M_PI;
+  float utc_minutes = 720 - 4 * (SCHEDULE_LONGITUDE + (sunrise ? hour_angle : -hour_angle)) - equation_of_time;
+  time_t utc_midnight = (time_t) days_from_civil(date.tm_year + 1900, date.tm_mon + 1, date.tm_mday) * 86400;
+  return utc_midnight + (time_t) (utc_minutes * 60);
+}
+
+// Get the first time after the given one that the entry should run, or NEVER.
+time_t next_occurrence(const ScheduleEntry &entry, time_t after) {
+  if (entry.type == SCHEDULE_ONCE) {
+    return entry.once_time > after ? entry.once_time : NEVER;
+  }
+  // Sunrise and sunset offsets can move an event to the previous day, so start from yesterday. A week and a day later
+  // covers every day of the week.
+  for (int day = -1; day < 8; ++day) {
+    struct tm date;
+    localtime_r(&after, &date);
+    date.tm_mday += day;
+    date.tm_hour = 0;
+    date.tm_min = 0;
+    date.tm_sec = 0;
+    date.tm_isdst = -1;
+    // Normalise the date and work out the day of the week.
+    mktime(&date);
+    if (!(entry.days & (1 << date.tm_wday))) {
+      continue;
+    }
+    time_t event;
+    if (entry.type == SCHEDULE_TIME) {
+      date.tm_min = entry.minutes;
+      date.tm_isdst = -1;
+      event = mktime(&date);
+    } else {
+      event = sun_event_time(date, entry.type == SCHEDULE_SUNRISE);
+      if (event == NEVER) {
+        continue;
+      }
+      event += entry.minutes * 60;
+    }
+    if (event > after) {
+      return event;
+    }
+  }
+  return NEVER;
+}
+
+static void run_schedule_entry(const ScheduleEntry &entry) {
+  size_t i = entry.switch_index;
+  if (i >= num_switches) {
+    return;
+  }
+  LOG("Running schedule for switch ");
+  LOGLN(i);
+  switch (entry.action) {
+    case SCHEDULE_OFF:
+    case SCHEDULE_ON:
+      switch_state[i] = entry.action == SCHEDULE_ON;
+      break;
+    case SCHEDULE_BRIGHTNESS:
+      switch_brightness[i] = entry.value;
+      break;
+  }
+  update_switch(i);
+  report_switch_state(i);
+}
+
+// Remove an entry, keeping the rest in order.
+static void erase_schedule_entry(size_t i) {
+  memmove(&schedule[i], &schedule[i + 1], sizeof(ScheduleEntry) * (schedule_length - i - 1));
+  --schedule_length;
+}
+
+// Run any entries which have fallen due, and work out when the next one is.
+static void check_schedule() {
+  time_t now = time(nullptr);
+  time_t next = NEVER;
+  if (now >= MIN_VALID_TIME) {
+    if (last_check_time == 0) {
+      // Don't run entries from before the clock was set.
+      last_check_time = now;
+    }
+    bool removed = false;
+    for (size_t i = 0; i < schedule_length;) {
+      const ScheduleEntry &entry = schedule[i];
+      time_t due = next_occurrence(entry, last_check_time);
+      if (due != NEVER && due <= now) {
+        run_schedule_entry(entry);
+      }
+      if (entry.type == SCHEDULE_ONCE && entry.once_time <= now) {
+        erase_schedule_entry(i);
+        removed = true;
+        continue;
+      }
+      time_t entry_next = next_occurrence(entry, now);
+      if (entry_next != NEVER && (next == NEVER || entry_next < next)) {
+        next = entry_next;
+      }
+      ++i;
+    }
+    if (removed) {
+      save_schedule();
+    }
+    last_check_time = now;
+  }
+
+  sleep_millis = MAX_SCHEDULE_SLEEP;
+  if (now < MIN_VALID_TIME) {
+    // Check again soon in case the clock has been set.
+    sleep_millis = 1000;
+  } else if (next != NEVER && (unsigned long) (next - now) * 1000 < MAX_SCHEDULE_SLEEP) {
+    sleep_millis = (next - now) * 1000;
+  }
+  last_check_millis = millis();
+}
+
+bool add_schedule_entry(const ScheduleEntry &entry) {
+  if (schedule_length >= MAX_SCHEDULES || entry.type >= SCHEDULE_TYPE_COUNT || entry.action >= SCHEDULE_ACTION_COUNT) {
+    return false;
+  }
+  schedule[schedule_length++] = entry;
+  check_schedule();
+  return save_schedule();
+}
+
+bool remove_schedule_entry(size_t i) {
+  if (i >= schedule_length) {
+    return false;
+  }
+  erase_schedule_entry(i);
+  check_schedule();
+  return save_schedule();
+}
+
+void schedule_setup() {
+  setenv("TZ", SCHEDULE_TIMEZONE, 1);
+  tzset();
+  load_schedule();
+  check_schedule();
+}
+
+void schedule_loop() {
+  if (millis() - last_check_millis >= sleep_millis) {
+    check_schedule();
+  }
+}
@@ -17,13 +17,15 @@ limitations under the License.
 #include "sinric.h"
 
 #include "config.h"
+#include "events.h"
 #include "logging.h"
+#include "scene.h"
+#include "state_store.h"
 #include "streamutils.h"
+#include "transition.h"
 
 #include <Arduino.h>
-#include <ArduinoJson.h>
 #include <FS.h>
-#include <StreamString.h>
 #include <WebSocketsClient.h>
 
 const char *host = "iot.sinric.com";
@@ -38,137 +40,459 @@ bool switch_initial_state[num_switches];
 String switch_ids[num_switches];
 bool switch_state[num_switches];
 int switch_brightness[num_switches];
+uint8_t switch_colour[num_switches];
+
+// Marks an empty entry in the switch ID table, or the end of a chain of switches with the same ID.
+#define NO_SWITCH 0xffff
+
+// An entry in the table of Sinric device IDs.
+struct SwitchIdEntry {
+  uint32_t hash;
+  // Index of the first switch with this ID, or NO_SWITCH if the entry is empty.
+  uint16_t first_switch;
+};
+
+static_assert(num_switches < NO_SWITCH, "Too many switches");
+static const size_t switch_id_table_size = id_table_size(num_switches);
+// Device IDs interned in a hash table with open addressing, so that commands can be dispatched without comparing the ID
+// with that of every switch.
+static SwitchIdEntry switch_id_table[switch_id_table_size];
+// For each switch, the next switch with the same ID, or NO_SWITCH.
+static uint16_t next_switch_with_id[num_switches];
+
+// Longest message sent to Sinric, with room for a long device ID.
+#define SINRIC_MESSAGE_SIZE 160
+
+ReportStats report_stats;
+
+// Switches whose state has changed since it was last reported to Sinric, one bit each.
+static uint32_t dirty_switches[(num_switches + 31) / 32];
+// When the oldest unreported change was made, as returned by millis().
+static unsigned long first_dirty_time = 0;
+// The state last reported to Sinric for each switch, if reported_state_known is set.
+static bool reported_state[num_switches];
+static bool reported_state_known[num_switches];
 
 static WebSocketsClient websocket;
+// Messages to Sinric are formatted here rather than allocating a new buffer each time.
+static char message_buffer[SINRIC_MESSAGE_SIZE];
 static bool websocket_connected = false;
-static uint64_t heartbeat_timestamp = 0;
+static unsigned long heartbeat_timestamp = 0;
+
+ConnectionStats connection_stats;
+
+// The reconnect interval starts at SINRIC_MIN_RECONNECT_INTERVAL and grows with random jitter after each failed attempt,
+// so that many devices which lost their connection at the same time don't all retry together.
+static unsigned long reconnect_interval = SINRIC_MIN_RECONNECT_INTERVAL;
+// When the websocket library was last expected to try to connect, as returned by millis().
+static unsigned long reconnect_time = 0;
+static bool ever_connected = false;
+static unsigned long connected_time = 0;
+// When a message or pong was last received from Sinric, to tell whether a disconnection was from being idle.
+static unsigned long last_received_time = 0;
+// How often to send heartbeats, lowered when the connection is dropped for being idle and raised again while it isn't.
+unsigned long heartbeat_interval = HEARTBEAT_INTERVAL;
+// Pings answered since the heartbeat interval was last changed.
+static uint32_t answered_probes = 0;
+// When the outstanding ping was sent, as returned by millis(), if probe_outstanding is set.
+static uint32_t probe_time = 0;
+static bool probe_outstanding = false;
 
 bool save_switch_config() {
   bool status1 = write_bools_to_file("/switch_inverted.txt", switch_inverted, num_switches);
   bool status2 = write_bools_to_file("/switch_initial_state.txt", switch_initial_state, num_switches);
-  return status1 && status2;
+  bool status3 = write_line_to_file("/restore_last_state.txt", restore_last_state ? "1" : "0");
+  return status1 && status2 && status3;
 }
 
 bool load_switch_config() {
   bool status1 = read_bools_from_file("/switch_inverted.txt", switch_inverted, num_switches);
   bool status2 = read_bools_from_file("/switch_initial_state.txt", switch_initial_state, num_switches);
+  restore_last_state = read_line_from_file("/restore_last_state.txt") == "1";
   return status1 && status2;
 }
 
+// Find the entry in the switch ID table for the given ID, or the empty entry where it should go.
+static SwitchIdEntry &find_switch_id_entry(const char *id, uint32_t hash) {
+  size_t slot = hash & (switch_id_table_size - 1);
+  while (true) {
+    SwitchIdEntry &entry = switch_id_table[slot];
+    if (entry.first_switch == NO_SWITCH ||
+        (entry.hash == hash && strcmp(switch_ids[entry.first_switch].c_str(), id) == 0)) {
+      return entry;
+    }
+    slot = (slot + 1) & (switch_id_table_size - 1);
+  }
+}
+
+// Get the index of the first switch with the given ID, or NO_SWITCH if there is none. The rest can be found through
+// next_switch_with_id.
+static uint16_t find_switch(const char *id) {
+  return find_switch_id_entry(id, hash_sinric_id(id)).first_switch;
+}
+
+static void rebuild_switch_id_table() {
+  for (size_t slot = 0; slot < switch_id_table_size; ++slot) {
+    switch_id_table[slot].first_switch = NO_SWITCH;
+  }
+  // Go backwards, so that each chain of switches with the same ID ends up in order.
+  for (size_t i = num_switches; i-- > 0;) {
+    next_switch_with_id[i] = NO_SWITCH;
+    if (switch_ids[i].length() == 0) {
+      continue;
+    }
+    uint32_t hash = hash_sinric_id(switch_ids[i].c_str());
+    SwitchIdEntry &entry = find_switch_id_entry(switch_ids[i].c_str(), hash);
+    next_switch_with_id[i] = entry.first_switch;
+    entry.hash = hash;
+    entry.first_switch = i;
+  }
+}
+
 bool load_switch_ids() {
-  return read_strings_from_file("/switch_ids.txt", switch_ids, num_switches);
+  bool success = read_strings_from_file("/switch_ids.txt", switch_ids, num_switches);
+  rebuild_switch_id_table();
+  return success;
 }
 
 bool save_switch_ids() {
+  rebuild_switch_id_table();
   return write_strings_to_file("/switch_ids.txt", switch_ids, num_switches);
 }
 
+// Get the brightness level the switch at the given index should be at, from `switch_state` and `switch_brightness`.
+static uint8_t switch_level(size_t i) {
+  return switch_state[i] ? (uint32_t) switch_brightness[i] * switch_colour[i] * MAX_LEVEL / (100 * 255) : 0;
+}
+
+static void publish_switch_event(size_t i) {
+  publish_event("switch", "{\"index\":%u,\"state\":%s,\"brightness\":%d}", (unsigned int) i,
+    switch_state[i] ? "true" : "false", switch_brightness[i]);
+}
+
 /**
  * Update the physical state of the switch at the given index to match the current values from `switch_state` and `switch_brightness`.
  */
 void update_switch(size_t i) {
-  if (switch_state[i]) {
-    if (switch_brightness[i] == 100) {
-      digitalWrite(switch_pins[i], switch_inverted[i] ? LOW : HIGH);
-    } else {
-      // ESP8266 uses a 0-1023 range for PWM rather than the standard Arduino 0-255.
-      int scaled_value = 1023 * switch_brightness[i] / 100;
-      if (switch_inverted[i]) {
-        scaled_value = 1023 - scaled_value;
-      }
-      analogWrite(switch_pins[i], scaled_value);
+  start_transition(i, switch_level(i));
+  switch_states_changed();
+  publish_switch_event(i);
+}
+
+/**
+ * Update the physical state of all the selected switches together, without any skew between them.
+ */
+void update_switches(const bool selected[]) {
+  uint8_t levels[NUM_SWITCHES];
+  for (size_t i = 0; i < num_switches; ++i) {
+    levels[i] = switch_level(i);
+  }
+  start_transitions(levels, selected);
+  switch_states_changed();
+  for (size_t i = 0; i < num_switches; ++i) {
+    if (selected[i]) {
+      publish_switch_event(i);
     }
-  } else {
-    digitalWrite(switch_pins[i], switch_inverted[i] ? HIGH : LOW);
   }
 }
 
 void init_switches() {
+  bool restored = restore_switch_states();
   for (size_t i = 0; i < num_switches; ++i) {
     pinMode(switch_pins[i], OUTPUT);
-    switch_state[i] = switch_initial_state[i];
-    switch_brightness[i] = 100;
+    switch_colour[i] = 255;
+    if (!restored) {
+      switch_state[i] = switch_initial_state[i];
+      switch_brightness[i] = 100;
+    }
     update_switch(i);
   }
 }
 
-void switch_switch(const String &device_id, bool state) {
-  for (size_t i = 0; i < num_switches; ++i) {
-    if (device_id == switch_ids[i]) {
-      switch_state[i] = state;
-      update_switch(i);
-    }
+// Select all the switches with the given Sinric ID. Returns whether there were any.
+static bool select_device(const char *device_id, bool selected[]) {
+  memset(selected, 0, sizeof(bool) * num_switches);
+  uint16_t first = find_switch(device_id);
+  for (uint16_t i = first; i != NO_SWITCH; i = next_switch_with_id[i]) {
+    selected[i] = true;
   }
+  return first != NO_SWITCH;
 }
 
-void set_brightness(const String &device_id, int brightness) {
-  for (size_t i = 0; i < num_switches; ++i) {
-    if (device_id == switch_ids[i]) {
-      switch_brightness[i] = brightness;
-      update_switch(i);
-    }
+void switch_switch(const char *device_id, bool state) {
+  bool selected[NUM_SWITCHES];
+  if (!select_device(device_id, selected)) {
+    return;
+  }
+  for (uint16_t i = find_switch(device_id); i != NO_SWITCH; i = next_switch_with_id[i]) {
+    switch_state[i] = state;
+    // Sinric sent this state, so doesn't need to be told about it.
+    reported_state[i] = state;
+    reported_state_known[i] = true;
+  }
+  update_switches(selected);
+}
+
+void set_brightness(const char *device_id, int brightness) {
+  bool selected[NUM_SWITCHES];
+  if (!select_device(device_id, selected)) {
+    return;
+  }
+  for (uint16_t i = find_switch(device_id); i != NO_SWITCH; i = next_switch_with_id[i]) {
+    switch_brightness[i] = constrain(brightness, 0, 100);
+  }
+  update_switches(selected);
+}
+
+// Change the brightness of all the switches with the given ID by the given number of percentage points.
+void adjust_brightness(const char *device_id, int delta) {
+  uint16_t first = find_switch(device_id);
+  if (first != NO_SWITCH) {
+    set_brightness(device_id, switch_brightness[first] + delta);
+  }
+}
+
+// Set the colour channels of a device made of several switches with the same ID, in the order of their pins.
+static void set_colour_channels(const char *device_id, const uint8_t channels[], size_t channel_count) {
+  bool selected[NUM_SWITCHES];
+  if (!select_device(device_id, selected)) {
+    return;
+  }
+  size_t channel = 0;
+  for (uint16_t i = find_switch(device_id); i != NO_SWITCH && channel < channel_count; i = next_switch_with_id[i]) {
+    switch_colour[i] = channels[channel++];
+  }
+  update_switches(selected);
+}
+
+static size_t device_channel_count(const char *device_id) {
+  size_t count = 0;
+  for (uint16_t i = find_switch(device_id); i != NO_SWITCH; i = next_switch_with_id[i]) {
+    ++count;
   }
+  return count;
 }
 
-void set_power_state_on_server(String device_id, bool state) {
-  DynamicJsonBuffer jsonBuffer;
-  JsonObject& root = jsonBuffer.createObject();
-  root["deviceId"] = device_id;
-  root["action"] = "setPowerState";
-  root["value"] = state ? "ON" : "OFF";
-  StreamString databuf;
-  root.printTo(databuf);
+// Set a device with a red, a green and a blue switch to the given colour, as 0xRRGGBB.
+void set_colour_rgb(const char *device_id, uint32_t rgb) {
+  if (device_channel_count(device_id) < 3) {
+    LOGLN("Device doesn't have RGB channels");
+    return;
+  }
+  uint8_t channels[] = {(uint8_t) (rgb >> 16), (uint8_t) (rgb >> 8), (uint8_t) rgb};
+  set_colour_channels(device_id, channels, 3);
+}
+
+// Set a device with a warm white and a cool white switch to the given colour temperature, mixing them so that the
+// stronger channel is always at full brightness.
+void set_colour_temperature(const char *device_id, int kelvin) {
+  if (device_channel_count(device_id) != 2) {
+    LOGLN("Device doesn't have warm and cool channels");
+    return;
+  }
+  long cool = map(kelvin, COLOUR_TEMPERATURE_WARM, COLOUR_TEMPERATURE_COOL, 0, 510);
+  cool = constrain(cool, 0, 510);
+  uint8_t channels[] = {(uint8_t) min(510 - cool, 255L), (uint8_t) min(cool, 255L)};
+  set_colour_channels(device_id, channels, 2);
+}
 
-  websocket.sendTXT(databuf);
+void set_power_state_on_server(const char *device_id, bool state) {
+  size_t length = format_power_state(message_buffer, sizeof(message_buffer), device_id, state);
+  if (length >= sizeof(message_buffer)) {
+    LOG("Device ID too long: ");
+    LOGLN(device_id);
+    return;
+  }
+
+  websocket.sendTXT(message_buffer, length);
   LOG("Sending state for ");
   LOG(device_id);
   LOG(": ");
   LOGLN(state);
 }
 
-void send_switch_state(size_t i) {
-  if (switch_ids[i].length() > 0) {
-    set_power_state_on_server(switch_ids[i], (digitalRead(switch_pins[i]) == HIGH) ^ switch_inverted[i]);
+static bool is_dirty(size_t i) {
+  return dirty_switches[i / 32] & (1UL << (i % 32));
+}
+
+// Mark the switch at the given index to have its state reported to Sinric. Changes within SINRIC_REPORT_WINDOW of each
+// other are sent together, and only the latest state of each switch is sent.
+void report_switch_state(size_t i) {
+  if (is_dirty(i)) {
+    ++report_stats.coalesced;
+    return;
+  }
+  bool any_dirty = false;
+  for (size_t word = 0; word < sizeof(dirty_switches) / sizeof(dirty_switches[0]); ++word) {
+    any_dirty |= dirty_switches[word] != 0;
+  }
+  if (!any_dirty) {
+    first_dirty_time = millis();
   }
+  dirty_switches[i / 32] |= 1UL << (i % 32);
 }
 
-void send_switch_states() {
+// Send the state of each dirty switch, unless Sinric already has it.
+static void send_dirty_switch_states() {
+  for (size_t word = 0; word < sizeof(dirty_switches) / sizeof(dirty_switches[0]); ++word) {
+    while (dirty_switches[word] != 0) {
+      size_t bit = __builtin_ctz(dirty_switches[word]);
+      dirty_switches[word] &= ~(1UL << bit);
+      size_t i = word * 32 + bit;
+      if (switch_ids[i].length() == 0) {
+        continue;
+      }
+      // Use the logical state rather than reading the pin, which doesn't work for dimmed switches.
+      if (reported_state_known[i] && reported_state[i] == switch_state[i]) {
+        ++report_stats.unchanged;
+        continue;
+      }
+      set_power_state_on_server(switch_ids[i].c_str(), switch_state[i]);
+      reported_state[i] = switch_state[i];
+      reported_state_known[i] = true;
+      ++report_stats.sent;
+    }
+  }
+}
+
+// Send any changes waiting to be reported straight away, rather than at the end of SINRIC_REPORT_WINDOW.
+void flush_switch_reports() {
+  if (websocket_connected) {
+    send_dirty_switch_states();
+  }
+}
+
+// Mark all switches to be reported, such as after reconnecting when Sinric may have lost track of them.
+static void report_switch_states() {
   for (size_t i = 0; i < num_switches; ++i) {
-    send_switch_state(i);
+    reported_state_known[i] = false;
+    report_switch_state(i);
+  }
+}
+
+static void set_reconnect_interval(unsigned long interval) {
+  reconnect_interval = interval;
+  reconnect_time = millis();
+  websocket.setReconnectInterval(interval);
+}
+
+static void handle_disconnect() {
+  websocket_connected = false;
+  unsigned long now = millis();
+  connection_stats.connected_millis += now - connected_time;
+  // If nothing at all came back after the last ping, the connection was probably dropped by something between here and
+  // Sinric for being idle since whatever was received before it, so send heartbeats more often to stop it happening
+  // again. A disconnection while pings are being answered is for some other reason.
+  if (probe_outstanding && (long) (last_received_time - probe_time) < 0) {
+    unsigned long idle_time = probe_time - last_received_time;
+    ++connection_stats.idle_disconnects;
+    heartbeat_interval = max(min(heartbeat_interval, idle_time / 2), (unsigned long) MIN_HEARTBEAT_INTERVAL);
+    answered_probes = 0;
+    LOG("Idle disconnection, heartbeat interval now ");
+    LOGLN(heartbeat_interval);
+  }
+  probe_outstanding = false;
+  set_reconnect_interval(SINRIC_MIN_RECONNECT_INTERVAL);
+}
+
+static void handle_pong(const uint8_t *payload, size_t length) {
+  last_received_time = millis();
+  uint32_t sent_time;
+  if (!probe_outstanding || length != sizeof(sent_time)) {
+    return;
+  }
+  memcpy(&sent_time, payload, sizeof(sent_time));
+  if (sent_time != probe_time) {
+    return;
+  }
+  probe_outstanding = false;
+  uint32_t rtt = millis() - sent_time;
+  connection_stats.last_rtt = rtt;
+  connection_stats.rtt_sum += rtt;
+  ++connection_stats.rtt_count;
+  // The connection is staying up, so try a longer heartbeat interval again.
+  if (heartbeat_interval < HEARTBEAT_INTERVAL && ++answered_probes >= HEARTBEAT_RECOVERY_PROBES) {
+    heartbeat_interval = min(heartbeat_interval + heartbeat_interval / 4, (unsigned long) HEARTBEAT_INTERVAL);
+    answered_probes = 0;
+    LOG("Heartbeat interval raised to ");
+    LOGLN(heartbeat_interval);
+  }
+}
+
+// Send a heartbeat, with a ping to measure the round trip time to Sinric.
+static void send_heartbeat() {
+  unsigned long now = millis();
+  heartbeat_timestamp = now;
+  websocket.sendTXT("H");
+  probe_time = now;
+  probe_outstanding = true;
+  uint8_t payload[sizeof(probe_time)];
+  memcpy(payload, &probe_time, sizeof(probe_time));
+  websocket.sendPing(payload, sizeof(payload));
+  ++connection_stats.probes_sent;
+}
+
+// Record how long a command took from arriving to being applied to the pins.
+static void record_command_latency(unsigned long start_micros) {
+  unsigned long latency = micros() - start_micros;
+  connection_stats.command_micros_sum += latency;
+  ++connection_stats.command_count;
+  connection_stats.command_micros_max = max(connection_stats.command_micros_max, (uint32_t) latency);
+}
+
+unsigned long sinric_connection_uptime() {
+  return websocket_connected ? millis() - connected_time : 0;
+}
+
+// Switch a device on or off, or apply a scene if the ID is for a scene. Switches are looked up first, in the hash table,
+// so that scenes' linear search is only paid for IDs which aren't switches.
+void switch_device(const char *device_id, bool on) {
+  LOGLN(on);
+  if (find_switch(device_id) != NO_SWITCH) {
+    switch_switch(device_id, on);
+    return;
+  }
+  int scene = find_scene_by_id(device_id);
+  // Scenes can only be applied, not unapplied.
+  if (scene != NO_SCENE && on) {
+    apply_scene(scene);
   }
 }
 
 void websocket_event(WStype_t type, uint8_t *payload, size_t length) {
   switch(type) {
     case WStype_DISCONNECTED:
-      websocket_connected = false;
       LOGLN("Websocket disconnected");
+      if (websocket_connected) {
+        handle_disconnect();
+      }
       break;
     case WStype_CONNECTED: {
         websocket_connected = true;
+        connected_time = millis();
+        last_received_time = connected_time;
+        heartbeat_timestamp = connected_time;
+        if (ever_connected) {
+          ++connection_stats.reconnects;
+        }
+        ever_connected = true;
+        set_reconnect_interval(SINRIC_MIN_RECONNECT_INTERVAL);
         LOG("Websocket connected: ");
         LOGLN((const char *) payload);
-        send_switch_states();
+        report_switch_states();
       }
       break;
+    case WStype_PONG:
+      handle_pong(payload, length);
+      break;
     case WStype_TEXT: {
+        unsigned long start_micros = micros();
+        last_received_time = millis();
         LOG("Websocket got: ");
         LOGLN((const char *) payload);
 
-        DynamicJsonBuffer json_buffer;
-        JsonObject& json = json_buffer.parseObject((char*)payload);
-        String device_id = json["deviceId"];
-        String action = json["action"];
-
-        if (action == "action.devices.commands.OnOff") {
-          String value = json["value"]["on"];
-          LOGLN(value);
-          switch_switch(device_id, value == "true");
-        } else if (action == "action.devices.commands.BrightnessAbsolute") {
-          String value = json["value"]["brightness"];
-          set_brightness(device_id, value.toInt());
-        } else if (action == "test") {
-          LOGLN("Websocket got test command");
+        if (handle_sinric_message((char *) payload)) {
+          record_command_latency(start_micros);
         }
       }
       break;
@@ -182,6 +506,8 @@ void sinric_setup() {
   sinric_api_key = read_line_from_file("/sinric_api_key.txt");
   load_switch_config();
   load_switch_ids();
+  load_scenes();
+  build_action_table();
   init_switches();
 }
 
@@ -189,19 +515,38 @@ void sinric_connect() {
   websocket.begin(host, 80, "/");
   websocket.onEvent(websocket_event);
   websocket.setAuthorization("apikey", sinric_api_key.c_str());
-  websocket.setReconnectInterval(5000);
+  set_reconnect_interval(SINRIC_MIN_RECONNECT_INTERVAL);
 }
 
 void sinric_loop() {
   websocket.loop();
 
   if (websocket_connected) {
-    uint64_t now = millis();
+    // The same width as millis(), so that the intervals below are still right when it wraps around.
+    unsigned long now = millis();
+
+    if (millis() - first_dirty_time >= SINRIC_REPORT_WINDOW) {
+      send_dirty_switch_states();
+    }
+
+    // If a ping goes unanswered the connection is probably dead even though the TCP connection hasn't timed out yet, so
+    // drop it and reconnect.
+    if (probe_outstanding && now - probe_time > SINRIC_PROBE_TIMEOUT) {
+      LOGLN("Sinric didn't answer ping, reconnecting");
+      ++connection_stats.probes_lost;
+      websocket.disconnect();
+      return;
+    }
 
     // Send heartbeat in order to avoid disconnections.
-    if ((now - heartbeat_timestamp) > HEARTBEAT_INTERVAL) {
-      heartbeat_timestamp = now;
-      websocket.sendTXT("H");
+    if ((now - heartbeat_timestamp) > heartbeat_interval) {
+      send_heartbeat();
     }
+  } else if (sinric_api_key.length() > 0 && millis() - reconnect_time >= reconnect_interval) {
+    // The websocket library has tried to connect again and failed, so wait longer before the next attempt, with
+    // decorrelated jitter.
+    ++connection_stats.reconnect_attempts;
+    set_reconnect_interval(min((unsigned long) random(SINRIC_MIN_RECONNECT_INTERVAL, reconnect_interval * 3 + 1),
+      (unsigned long) SINRIC_MAX_RECONNECT_INTERVAL));
   }
 }
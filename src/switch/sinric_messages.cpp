@@ -0,0 +1,173 @@
+/*
+Copyright 2018 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ */
+
+#include "sinric_messages.h"
+
+#include "logging.h"
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+// Room for a message from Sinric with a few more fields than those we use, including a colour object nested in the
+// value, parsed in place.
+#define SINRIC_JSON_BUFFER_SIZE (JSON_OBJECT_SIZE(8) + 2 * JSON_OBJECT_SIZE(4))
+
+// FNV-1a hash of a device ID.
+uint32_t hash_sinric_id(const char *id) {
+  uint32_t hash = 2166136261;
+  for (; *id != '\0'; ++id) {
+    hash = (hash ^ (uint8_t) *id) * 16777619;
+  }
+  return hash;
+}
+
+// Get a string from a JSON message, or an empty string if it is missing or not a string.
+static const char *json_string(const JsonVariant &value) {
+  const char *string = value.as<const char *>();
+  return string != nullptr ? string : "";
+}
+
+static void handle_on_off(const char *device_id, JsonVariant value) {
+  JsonVariant on = value["on"];
+  // Sinric has sent this both as a boolean and as a string.
+  switch_device(device_id, on.is<bool>() ? on.as<bool>() : strcmp(json_string(on), "true") == 0);
+}
+
+static void handle_set_power_state(const char *device_id, JsonVariant value) {
+  switch_device(device_id, strcmp(json_string(value), "ON") == 0);
+}
+
+static void handle_brightness_absolute(const char *device_id, JsonVariant value) {
+  set_brightness(device_id, value["brightness"].as<int>());
+}
+
+static void handle_brightness_relative(const char *device_id, JsonVariant value) {
+  adjust_brightness(device_id, value["brightnessRelativePercent"].as<int>());
+}
+
+static void handle_adjust_brightness(const char *device_id, JsonVariant value) {
+  adjust_brightness(device_id, value["brightnessDelta"].as<int>());
+}
+
+static void handle_set_percentage(const char *device_id, JsonVariant value) {
+  set_brightness(device_id, value["percentage"].as<int>());
+}
+
+static void handle_adjust_percentage(const char *device_id, JsonVariant value) {
+  adjust_brightness(device_id, value["percentageDelta"].as<int>());
+}
+
+static void handle_colour_absolute(const char *device_id, JsonVariant value) {
+  JsonVariant colour = value["color"];
+  if (colour["temperature"].success()) {
+    set_colour_temperature(device_id, colour["temperature"].as<int>());
+  } else if (colour["spectrumRGB"].success()) {
+    set_colour_rgb(device_id, colour["spectrumRGB"].as<uint32_t>());
+  }
+}
+
+static void handle_set_colour_temperature(const char *device_id, JsonVariant value) {
+  set_colour_temperature(device_id, value["colorTemperatureInKelvin"].as<int>());
+}
+
+static void handle_test(const char *device_id, JsonVariant value) {
+  LOGLN("Websocket got test command");
+}
+
+typedef void (*SinricActionHandler)(const char *device_id, JsonVariant value);
+
+struct SinricAction {
+  const char *name;
+  SinricActionHandler handler;
+};
+
+// Actions which Sinric may send, from Google Home and from Alexa. To support another capability, add it here.
+static const SinricAction sinric_actions[] = {
+  {"action.devices.commands.OnOff", handle_on_off},
+  {"setPowerState", handle_set_power_state},
+  {"action.devices.commands.BrightnessAbsolute", handle_brightness_absolute},
+  {"action.devices.commands.BrightnessRelative", handle_brightness_relative},
+  {"SetBrightness", handle_brightness_absolute},
+  {"AdjustBrightness", handle_adjust_brightness},
+  {"SetPercentage", handle_set_percentage},
+  {"AdjustPercentage", handle_adjust_percentage},
+  {"action.devices.commands.ColorAbsolute", handle_colour_absolute},
+  {"SetColorTemperature", handle_set_colour_temperature},
+  {"test", handle_test},
+};
+
+#define NUM_SINRIC_ACTIONS (sizeof(sinric_actions) / sizeof(sinric_actions[0]))
+#define NO_ACTION 0xff
+
+static_assert(NUM_SINRIC_ACTIONS < NO_ACTION, "Too many Sinric actions");
+static const size_t action_table_size = id_table_size(NUM_SINRIC_ACTIONS);
+// Action names hashed into a table with open addressing, the same way as switch IDs, so that finding the handler for a
+// message takes the same time however many actions there are.
+static uint8_t action_table[action_table_size];
+
+CommandStats command_stats;
+
+static size_t find_action_slot(const char *name, uint32_t hash) {
+  size_t slot = hash & (action_table_size - 1);
+  while (action_table[slot] != NO_ACTION && strcmp(sinric_actions[action_table[slot]].name, name) != 0) {
+    slot = (slot + 1) & (action_table_size - 1);
+  }
+  return slot;
+}
+
+void build_action_table() {
+  memset(action_table, NO_ACTION, sizeof(action_table));
+  for (size_t action = 0; action < NUM_SINRIC_ACTIONS; ++action) {
+    const char *name = sinric_actions[action].name;
+    action_table[find_action_slot(name, hash_sinric_id(name))] = action;
+  }
+}
+
+static const SinricAction *find_action(const char *name) {
+  uint8_t action = action_table[find_action_slot(name, hash_sinric_id(name))];
+  return action == NO_ACTION ? nullptr : &sinric_actions[action];
+}
+
+// Handle a text message from Sinric, parsing it in place. Returns whether it had a known action.
+bool handle_sinric_message(char *payload) {
+  StaticJsonBuffer<SINRIC_JSON_BUFFER_SIZE> json_buffer;
+  JsonObject& json = json_buffer.parseObject(payload);
+  if (!json.success()) {
+    LOGLN("Failed to parse websocket message");
+    return false;
+  }
+  const char *device_id = json_string(json["deviceId"]);
+  const char *action_name = json_string(json["action"]);
+
+  const SinricAction *action = find_action(action_name);
+  if (action == nullptr) {
+    LOG("Unknown action: ");
+    LOGLN(action_name);
+    ++command_stats.unknown;
+    return false;
+  }
+  action->handler(device_id, json["value"]);
+  ++command_stats.handled;
+  return true;
+}
+
+// Format a message telling Sinric the power state of a device. Returns the length it needed, which is at least the
+// size of the buffer if it didn't fit.
+size_t format_power_state(char *buffer, size_t size, const char *device_id, bool state) {
+  // Device IDs are hex strings, so don't need escaping.
+  return snprintf(buffer, size, "{\"deviceId\":\"%s\",\"action\":\"setPowerState\",\"value\":\"%s\"}", device_id,
+    state ? "ON" : "OFF");
+}
@@ -0,0 +1,207 @@
+/*
+Copyright 2018 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ */
+
+#include "state_store.h"
+
+#include "config.h"
+#include "logging.h"
+#include "sinric.h"
+#include "streamutils.h"
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+
+// The last state of each switch, and the highest counter of any LAN control request, are kept in two places: RTC
+// memory, which survives a soft reset and is written on every change, and a ring of records in flash, which survives a
+// power cut but is only written every SWITCH_STATE_SAVE_INTERVAL to limit wear. So after a power cut, only LAN requests
+// from that long before it could be accepted again. Each record has a sequence number so the latest can be found, and
+// a CRC to detect records which were cut short or RTC memory which has lost power.
+
+extern "C" uint32_t _EEPROM_start;
+
+#define STATE_SECTORS 2
+// The second sector is set aside in the firmware image, as every flash layout has only one sector for EEPROM. It
+// starts out as zeros rather than erased, and is replaced by OTA updates, so it is erased before being written to.
+static const uint8_t spare_sector[SPI_FLASH_SEC_SIZE] PROGMEM __attribute__((aligned(SPI_FLASH_SEC_SIZE))) = {0};
+
+bool restore_last_state = false;
+
+struct StateRecord {
+  uint64_t lan_counter;
+  uint32_t sequence;
+  // The state and brightness of every switch, with the state in the top bit of each byte.
+  uint8_t levels[(NUM_SWITCHES + 3) / 4 * 4];
+  uint32_t crc;
+};
+
+static_assert(sizeof(StateRecord) <= 512 - SWITCH_STATE_RTC_ADDRESS * 4,
+  "Switch state record doesn't fit in RTC memory");
+
+#define STATE_ON_BIT 0x80
+#define RECORDS_PER_SECTOR (SPI_FLASH_SEC_SIZE / sizeof(StateRecord))
+// The first word of an erased record.
+#define ERASED_WORD 0xffffffff
+
+static StateRecord record;
+// The sector being written to, and the index in it where the next record will be written.
+static size_t current_sector = 0;
+static size_t next_flash_slot = RECORDS_PER_SECTOR;
+static bool flash_save_pending = false;
+static unsigned long flash_saved_time = 0;
+
+static uint32_t flash_sector(size_t sector) {
+  uintptr_t address = sector == 0 ? (uintptr_t) &_EEPROM_start : (uintptr_t) spare_sector;
+  return (address - 0x40200000) / SPI_FLASH_SEC_SIZE;
+}
+
+static uint32_t record_crc(const StateRecord &state_record) {
+  return crc32_update(0, &state_record, offsetof(StateRecord, crc));
+}
+
+static uint32_t flash_record_address(size_t sector, size_t slot) {
+  return flash_sector(sector) * SPI_FLASH_SEC_SIZE + slot * sizeof(StateRecord);
+}
+
+static bool read_flash_record(size_t sector, size_t slot, StateRecord *state_record) {
+  return ESP.flashRead(flash_record_address(sector, slot), (uint32_t *) state_record, sizeof(StateRecord));
+}
+
+// Whether the slot can be written without erasing its sector first.
+static bool flash_slot_erased(size_t sector, size_t slot) {
+  uint32_t words[sizeof(StateRecord) / 4];
+  if (!ESP.flashRead(flash_record_address(sector, slot), words, sizeof(words))) {
+    return false;
+  }
+  for (size_t i = 0; i < sizeof(words) / 4; ++i) {
+    if (words[i] != ERASED_WORD) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Find the latest intact record in flash, and carry on writing after it.
+static bool read_latest_flash_record(StateRecord *latest) {
+  StateRecord state_record;
+  bool found = false;
+  current_sector = 0;
+  next_flash_slot = RECORDS_PER_SECTOR;
+  for (size_t sector = 0; sector < STATE_SECTORS; ++sector) {
+    for (size_t slot = 0; slot < RECORDS_PER_SECTOR && read_flash_record(sector, slot, &state_record); ++slot) {
+      if (state_record.crc == record_crc(state_record) && (!found || state_record.sequence > latest->sequence)) {
+        *latest = state_record;
+        found = true;
+        current_sector = sector;
+        next_flash_slot = slot + 1;
+      }
+    }
+  }
+  return found;
+}
+
+static void write_flash_record() {
+  // Skip anything left by a write which was cut short.
+  while (next_flash_slot < RECORDS_PER_SECTOR && !flash_slot_erased(current_sector, next_flash_slot)) {
+    ++next_flash_slot;
+  }
+  if (next_flash_slot >= RECORDS_PER_SECTOR) {
+    size_t other_sector = (current_sector + 1) % STATE_SECTORS;
+    LOGLN("Erasing switch state sector");
+    if (!ESP.flashEraseSector(flash_sector(other_sector))) {
+      LOGLN("Failed to erase switch state sector.");
+      return;
+    }
+    current_sector = other_sector;
+    next_flash_slot = 0;
+  }
+  if (!ESP.flashWrite(flash_record_address(current_sector, next_flash_slot), (uint32_t *) &record, sizeof(record))) {
+    LOGLN("Failed to write switch state.");
+  }
+  // Even if the write failed, don't try the same slot again.
+  ++next_flash_slot;
+}
+
+// Set the state and brightness of each switch from the last saved record, from RTC memory if it survived or else flash.
+// This doesn't touch the pins, so should be called before init_switches.
+bool restore_switch_states() {
+  StateRecord rtc_record;
+  StateRecord flash_record;
+  bool rtc_valid = ESP.rtcUserMemoryRead(SWITCH_STATE_RTC_ADDRESS, (uint32_t *) &rtc_record, sizeof(rtc_record)) &&
+    rtc_record.crc == record_crc(rtc_record);
+  bool flash_valid = read_latest_flash_record(&flash_record);
+  if (rtc_valid && (!flash_valid || rtc_record.sequence >= flash_record.sequence)) {
+    LOGLN("Restoring switch states from RTC memory");
+    record = rtc_record;
+  } else if (flash_valid) {
+    LOGLN("Restoring switch states from flash");
+    record = flash_record;
+  } else {
+    LOGLN("No saved switch states");
+    record.sequence = 0;
+    record.lan_counter = 0;
+    return false;
+  }
+  if (!restore_last_state) {
+    return false;
+  }
+  for (size_t i = 0; i < num_switches; ++i) {
+    switch_state[i] = record.levels[i] & STATE_ON_BIT;
+    switch_brightness[i] = record.levels[i] & ~STATE_ON_BIT;
+  }
+  return true;
+}
+
+// Save the record, to RTC memory straight away and to flash soon.
+static void save_record() {
+  ++record.sequence;
+  record.crc = record_crc(record);
+  ESP.rtcUserMemoryWrite(SWITCH_STATE_RTC_ADDRESS, (uint32_t *) &record, sizeof(record));
+  flash_save_pending = true;
+}
+
+// Save the current state of all switches.
+void switch_states_changed() {
+  if (!restore_last_state) {
+    return;
+  }
+  bool changed = false;
+  for (size_t i = 0; i < num_switches; ++i) {
+    uint8_t level = (switch_state[i] ? STATE_ON_BIT : 0) | switch_brightness[i];
+    changed |= record.levels[i] != level;
+    record.levels[i] = level;
+  }
+  if (changed) {
+    save_record();
+  }
+}
+
+// The highest counter of any LAN control request accepted, including before the last restart.
+uint64_t last_lan_counter() {
+  return record.lan_counter;
+}
+
+void save_lan_counter(uint64_t counter) {
+  record.lan_counter = counter;
+  save_record();
+}
+
+void state_store_loop() {
+  if (flash_save_pending && millis() - flash_saved_time >= SWITCH_STATE_SAVE_INTERVAL) {
+    write_flash_record();
+    flash_save_pending = false;
+    flash_saved_time = millis();
+  }
+}
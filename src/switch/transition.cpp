@@ -0,0 +1,138 @@
+/*
+Copyright 2018 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ */
+
+#include "transition.h"
+
+#include "config.h"
+#include "sinric.h"
+
+#include <Arduino.h>
+#include <Ticker.h>
+
+// PWM duty cycle for each brightness level, so that equal steps in level look like equal steps in brightness. ESP8266
+// uses a 0-1023 range for PWM rather than the standard Arduino 0-255.
+static const uint16_t gamma_table[MAX_LEVEL + 1] PROGMEM = {
+  0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2,
+  2, 3, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 9, 9, 10,
+  11, 11, 12, 13, 14, 15, 16, 16, 17, 18, 19, 20, 21, 23, 24, 25,
+  26, 27, 28, 30, 31, 32, 34, 35, 36, 38, 39, 41, 42, 44, 46, 47,
+  49, 51, 52, 54, 56, 58, 60, 61, 63, 65, 67, 69, 71, 73, 76, 78,
+  80, 82, 84, 87, 89, 91, 94, 96, 98, 101, 103, 106, 109, 111, 114, 117,
+  119, 122, 125, 128, 130, 133, 136, 139, 142, 145, 148, 151, 155, 158, 161, 164,
+  167, 171, 174, 177, 181, 184, 188, 191, 195, 198, 202, 206, 209, 213, 217, 221,
+  225, 228, 232, 236, 240, 244, 248, 252, 257, 261, 265, 269, 274, 278, 282, 287,
+  291, 295, 300, 304, 309, 314, 318, 323, 328, 333, 337, 342, 347, 352, 357, 362,
+  367, 372, 377, 382, 387, 393, 398, 403, 408, 414, 419, 425, 430, 436, 441, 447,
+  452, 458, 464, 470, 475, 481, 487, 493, 499, 505, 511, 517, 523, 529, 535, 542,
+  548, 554, 561, 567, 573, 580, 586, 593, 599, 606, 613, 619, 626, 633, 640, 647,
+  653, 660, 667, 674, 681, 689, 696, 703, 710, 717, 725, 732, 739, 747, 754, 762,
+  769, 777, 784, 792, 800, 807, 815, 823, 831, 839, 847, 855, 863, 871, 879, 887,
+  895, 903, 912, 920, 928, 937, 945, 954, 962, 971, 979, 988, 997, 1005, 1014, 1023,
+};
+
+// A fade of one switch from one brightness level to another.
+struct Transition {
+  uint8_t start_level;
+  uint8_t target_level;
+  // The level most recently written to the pin.
+  uint8_t level;
+  bool active;
+  unsigned long start_time;
+  unsigned long duration;
+};
+
+static Transition transitions[NUM_SWITCHES];
+// Runs transition_tick while any transition is active. The hardware timer is used by the PWM itself, so this uses a
+// software timer. Levels are worked out from the time elapsed rather than the number of ticks, so a late tick makes a
+// fade less smooth but not longer.
+static Ticker transition_ticker;
+
+// Write the given brightness level to the pin of the switch at the given index.
+static void write_level(size_t i, uint8_t level) {
+  transitions[i].level = level;
+  // Avoid PWM when fully on or off, so that relays work too.
+  if (level == 0) {
+    digitalWrite(switch_pins[i], switch_inverted[i] ? HIGH : LOW);
+  } else if (level == MAX_LEVEL) {
+    digitalWrite(switch_pins[i], switch_inverted[i] ? LOW : HIGH);
+  } else {
+    uint16_t duty = pgm_read_word(&gamma_table[level]);
+    analogWrite(switch_pins[i], switch_inverted[i] ? 1023 - duty : duty);
+  }
+}
+
+// Update every switch which is fading to its level for the current time.
+static void transition_tick() {
+  unsigned long now = millis();
+  bool any_active = false;
+  for (size_t i = 0; i < num_switches; ++i) {
+    Transition &transition = transitions[i];
+    if (!transition.active) {
+      continue;
+    }
+    unsigned long elapsed = now - transition.start_time;
+    uint8_t level;
+    if (elapsed >= transition.duration) {
+      level = transition.target_level;
+      transition.active = false;
+    } else {
+      int difference = transition.target_level - transition.start_level;
+      level = transition.start_level + difference * (long) elapsed / (long) transition.duration;
+      any_active = true;
+    }
+    if (level != transition.level) {
+      write_level(i, level);
+    }
+  }
+  if (!any_active) {
+    transition_ticker.detach();
+  }
+}
+
+// Start fading the switch at the given index from its current level to the given one, over a time proportional to the
+// difference, up to SWITCH_FADE_TIME. All transitions started with the same start time stay in step.
+static void start_transition_at(size_t i, uint8_t level, unsigned long start_time) {
+  Transition &transition = transitions[i];
+  uint8_t difference = level > transition.level ? level - transition.level : transition.level - level;
+  unsigned long duration = (unsigned long) SWITCH_FADE_TIME * difference / MAX_LEVEL;
+  if (duration == 0) {
+    transition.active = false;
+    write_level(i, level);
+    return;
+  }
+  transition.start_level = transition.level;
+  transition.target_level = level;
+  transition.start_time = start_time;
+  transition.duration = duration;
+  transition.active = true;
+  if (!transition_ticker.active()) {
+    transition_ticker.attach_ms(SWITCH_FADE_TICK, transition_tick);
+  }
+}
+
+void start_transition(size_t i, uint8_t level) {
+  start_transition_at(i, level, millis());
+}
+
+// Start transitions for all the selected switches together, to the given levels.
+void start_transitions(const uint8_t levels[], const bool selected[]) {
+  unsigned long start_time = millis();
+  for (size_t i = 0; i < num_switches; ++i) {
+    if (selected[i]) {
+      start_transition_at(i, levels[i], start_time);
+    }
+  }
+}
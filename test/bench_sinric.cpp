@@ -0,0 +1,149 @@
+/*
+Copyright 2018 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ */
+
+// Replays Sinric websocket traffic from sinric_traffic.txt through the message handling in sinric_messages.cpp, and
+// reports the time and heap allocations for each message, both for the commands Sinric sends and for the state reports
+// sent back. Neither should allocate at all.
+
+#include "sinric_messages.h"
+#include "test.h"
+
+#include <chrono>
+#include <fstream>
+#include <new>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#define REPLAYS 20000
+// The websocket library's buffer for incoming frames.
+#define FRAME_SIZE 512
+
+static size_t allocations = 0;
+static size_t allocated_bytes = 0;
+
+void *operator new(size_t size) {
+  ++allocations;
+  allocated_bytes += size;
+  void *memory = malloc(size);
+  if (memory == nullptr) {
+    throw std::bad_alloc();
+  }
+  return memory;
+}
+
+void operator delete(void *memory) noexcept {
+  free(memory);
+}
+
+void operator delete(void *memory, size_t size) noexcept {
+  free(memory);
+}
+
+// Count what the messages ask the switches to do, rather than doing it.
+static size_t switch_changes = 0;
+
+void switch_device(const char *device_id, bool on) {
+  ++switch_changes;
+}
+
+void set_brightness(const char *device_id, int brightness) {
+  ++switch_changes;
+}
+
+void adjust_brightness(const char *device_id, int delta) {
+  ++switch_changes;
+}
+
+void set_colour_rgb(const char *device_id, uint32_t rgb) {
+  ++switch_changes;
+}
+
+void set_colour_temperature(const char *device_id, int kelvin) {
+  ++switch_changes;
+}
+
+static std::vector<std::string> load_traffic(const char *path) {
+  std::vector<std::string> frames;
+  std::ifstream file(path);
+  std::string line;
+  while (std::getline(file, line)) {
+    if (!line.empty() && line[0] != '#') {
+      frames.push_back(line);
+    }
+  }
+  return frames;
+}
+
+static double elapsed_nanos(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void report(const char *direction, size_t messages, double nanos, size_t allocations, size_t bytes) {
+  printf("%s: %zu messages, %.0f ns, %.2f allocations and %.1f bytes allocated per message\n", direction, messages,
+    nanos / messages, (double) allocations / messages, (double) bytes / messages);
+}
+
+static void bench_incoming(const std::vector<std::string> &frames) {
+  build_action_table();
+  // The frame is copied into the websocket buffer each time, as parsing it in place changes it.
+  char payload[FRAME_SIZE];
+  size_t start_allocations = allocations;
+  size_t start_bytes = allocated_bytes;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t replay = 0; replay < REPLAYS; ++replay) {
+    for (const std::string &frame : frames) {
+      memcpy(payload, frame.c_str(), frame.size() + 1);
+      handle_sinric_message(payload);
+    }
+  }
+  double nanos = elapsed_nanos(start);
+  size_t messages = REPLAYS * frames.size();
+  report("Incoming", messages, nanos, allocations - start_allocations, allocated_bytes - start_bytes);
+  printf("%u handled, %u with unknown actions, %zu changes to switches\n", command_stats.handled, command_stats.unknown,
+    switch_changes);
+  CHECK(allocations == start_allocations);
+  // All but the unknown action and the frame which was cut short.
+  CHECK(command_stats.handled == REPLAYS * (frames.size() - 2));
+  CHECK(command_stats.unknown == REPLAYS);
+  // All but those two and the test message.
+  CHECK(switch_changes == REPLAYS * (frames.size() - 3));
+}
+
+static void bench_outgoing() {
+  char message[160];
+  size_t start_allocations = allocations;
+  size_t start_bytes = allocated_bytes;
+  size_t length = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < REPLAYS * 10; ++i) {
+    length += format_power_state(message, sizeof(message), "5c1f3e2a9b8d7c6e5f4a3b2c", i % 2 == 0);
+  }
+  double nanos = elapsed_nanos(start);
+  report("Outgoing", REPLAYS * 10, nanos, allocations - start_allocations, allocated_bytes - start_bytes);
+  CHECK(allocations == start_allocations);
+  CHECK(length > 0);
+  CHECK(strcmp(message,
+    "{\"deviceId\":\"5c1f3e2a9b8d7c6e5f4a3b2c\",\"action\":\"setPowerState\",\"value\":\"OFF\"}") == 0);
+}
+
+int main() {
+  std::vector<std::string> frames = load_traffic("sinric_traffic.txt");
+  CHECK(frames.size() > 2);
+  bench_incoming(frames);
+  bench_outgoing();
+  return finish_tests("bench_sinric");
+}
@@ -0,0 +1,243 @@
+/*
+Copyright 2018 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ */
+
+// Just enough of the Arduino core to build firmware sources into host tests.
+
+#pragma once
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include <algorithm>
+#include <string>
+
+using std::max;
+using std::min;
+
+#define HEX 16
+#define DEC 10
+#define LOW 0
+#define HIGH 1
+#define OUTPUT 1
+
+#define constrain(amount, low, high) ((amount) < (low) ? (low) : ((amount) > (high) ? (high) : (amount)))
+
+// The time seen by the code under test, which tests move forward by hand.
+extern unsigned long stub_millis;
+
+inline unsigned long millis() {
+  return stub_millis;
+}
+
+inline void yield() {}
+
+inline void pinMode(uint8_t pin, uint8_t mode) {}
+
+inline void digitalWrite(uint8_t pin, uint8_t value) {}
+
+class String {
+public:
+  String() {}
+  String(const char *value): value(value == nullptr ? "" : value) {}
+  String(const std::string &value): value(value) {}
+  String(char c): value(1, c) {}
+  String(int number): value(std::to_string(number)) {}
+  String(unsigned int number): value(std::to_string(number)) {}
+  String(long number): value(std::to_string(number)) {}
+  String(unsigned long number): value(std::to_string(number)) {}
+
+  const char *c_str() const {
+    return value.c_str();
+  }
+
+  unsigned int length() const {
+    return value.length();
+  }
+
+  long toInt() const {
+    return atol(value.c_str());
+  }
+
+  int indexOf(const String &other) const {
+    size_t i = value.find(other.value);
+    return i == std::string::npos ? -1 : i;
+  }
+
+  String substring(unsigned int from, unsigned int to = -1) const {
+    return value.substr(from, to - from);
+  }
+
+  bool operator==(const String &other) const {
+    return value == other.value;
+  }
+
+  bool operator!=(const String &other) const {
+    return value != other.value;
+  }
+
+  String &operator+=(const String &other) {
+    value += other.value;
+    return *this;
+  }
+
+  friend String operator+(String left, const String &right) {
+    return left += right;
+  }
+
+private:
+  std::string value;
+};
+
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+
+  virtual size_t write(const uint8_t *buffer, size_t size) {
+    size_t written = 0;
+    while (written < size && write(buffer[written]) == 1) {
+      ++written;
+    }
+    return written;
+  }
+
+  size_t print(const char *text) {
+    return write((const uint8_t *) text, strlen(text));
+  }
+
+  size_t print(const String &text) {
+    return print(text.c_str());
+  }
+
+  size_t print(char c) {
+    return write(c);
+  }
+
+  size_t print(unsigned char number, int base = DEC) {
+    return print((unsigned long) number, base);
+  }
+
+  size_t print(int number, int base = DEC) {
+    return print((long) number, base);
+  }
+
+  size_t print(unsigned int number, int base = DEC) {
+    return print((unsigned long) number, base);
+  }
+
+  size_t print(long number, int base = DEC) {
+    char text[24];
+    snprintf(text, sizeof(text), base == HEX ? "%lx" : "%ld", number);
+    return print(text);
+  }
+
+  size_t print(unsigned long number, int base = DEC) {
+    char text[24];
+    snprintf(text, sizeof(text), base == HEX ? "%lx" : "%lu", number);
+    return print(text);
+  }
+
+  template <typename T> size_t println(const T &value) {
+    return print(value) + print("\r\n");
+  }
+
+  size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3))) {
+    char text[512];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    return print(text);
+  }
+};
+
+class Stream : public Print {
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+
+  void setTimeout(unsigned long timeout) {}
+
+  size_t readBytes(uint8_t *buffer, size_t length) {
+    size_t count = 0;
+    int c;
+    while (count < length && (c = read()) >= 0) {
+      buffer[count++] = c;
+    }
+    return count;
+  }
+
+  size_t readBytes(char *buffer, size_t length) {
+    return readBytes((uint8_t *) buffer, length);
+  }
+
+  size_t readBytesUntil(char terminator, char *buffer, size_t length) {
+    size_t count = 0;
+    int c;
+    while (count < length && (c = read()) >= 0 && c != terminator) {
+      buffer[count++] = c;
+    }
+    return count;
+  }
+
+  String readStringUntil(char terminator) {
+    std::string result;
+    int c;
+    while ((c = read()) >= 0 && c != terminator) {
+      result += (char) c;
+    }
+    return result;
+  }
+};
+
+// A serial port whose other end is the test.
+class HardwareSerial : public Stream {
+public:
+  // Bytes waiting to be read by the code under test.
+  std::string input;
+  // Bytes written by the code under test, which the test hasn't taken yet.
+  std::string output;
+
+  using Print::write;
+
+  size_t write(uint8_t c) override {
+    output += (char) c;
+    return 1;
+  }
+
+  int available() override {
+    return input.size();
+  }
+
+  int read() override {
+    if (input.empty()) {
+      return -1;
+    }
+    uint8_t c = input[0];
+    input.erase(0, 1);
+    return c;
+  }
+
+  void begin(unsigned long baud) {}
+  void flush() {}
+};
+
+extern HardwareSerial Serial;
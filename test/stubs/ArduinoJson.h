@@ -0,0 +1,311 @@
+/*
+Copyright 2018 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ */
+
+// A stand-in for the parts of ArduinoJson 5 used by the Sinric message handling and the API: parsing in place into a
+// StaticJsonBuffer, and reading the values. Like the real one, it never allocates; strings point into the parsed text.
+
+#pragma once
+
+#include <Arduino.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+struct JsonNode {
+  enum Type : uint8_t { NUL, BOOLEAN, INTEGER, FLOAT, STRING, OBJECT, ARRAY };
+  Type type;
+  // The member name, if this is a member of an object.
+  const char *key;
+  union {
+    bool boolean;
+    long integer;
+    double real;
+    const char *string;
+    JsonNode *first_child;
+  };
+  JsonNode *next;
+};
+
+#define JSON_OBJECT_SIZE(n) (((n) + 1) * sizeof(JsonNode))
+#define JSON_ARRAY_SIZE(n) (((n) + 1) * sizeof(JsonNode))
+
+class JsonVariant {
+public:
+  JsonVariant(const JsonNode *node = nullptr): node(node) {}
+
+  bool success() const {
+    return node != nullptr;
+  }
+
+  JsonVariant operator[](const char *key) const {
+    if (node == nullptr || node->type != JsonNode::OBJECT) {
+      return JsonVariant();
+    }
+    for (const JsonNode *member = node->first_child; member != nullptr; member = member->next) {
+      if (strcmp(member->key, key) == 0) {
+        return JsonVariant(member);
+      }
+    }
+    return JsonVariant();
+  }
+
+  template <typename T> T as() const {
+    T value;
+    read(&value);
+    return value;
+  }
+
+  template <typename T> bool is() const {
+    return node != nullptr && node->type == type_of((T *) nullptr);
+  }
+
+private:
+  void read(const char **value) const {
+    *value = node != nullptr && node->type == JsonNode::STRING ? node->string : nullptr;
+  }
+
+  void read(bool *value) const {
+    *value = node != nullptr && node->type == JsonNode::BOOLEAN ? node->boolean : number() != 0;
+  }
+
+  // Numbers are converted from whatever the value is, as ArduinoJson does, so "50" reads as 50.
+  template <typename T> void read(T *value) const {
+    *value = (T) number();
+  }
+
+  long number() const {
+    if (node == nullptr) {
+      return 0;
+    }
+    switch (node->type) {
+      case JsonNode::BOOLEAN:
+        return node->boolean;
+      case JsonNode::INTEGER:
+        return node->integer;
+      case JsonNode::FLOAT:
+        return (long) node->real;
+      case JsonNode::STRING:
+        return strtol(node->string, nullptr, 10);
+      default:
+        return 0;
+    }
+  }
+
+  static JsonNode::Type type_of(bool *) {
+    return JsonNode::BOOLEAN;
+  }
+
+  static JsonNode::Type type_of(const char **) {
+    return JsonNode::STRING;
+  }
+
+  template <typename T> static JsonNode::Type type_of(T *) {
+    return JsonNode::INTEGER;
+  }
+
+  const JsonNode *node;
+};
+
+class JsonObject : public JsonVariant {
+public:
+  JsonObject(const JsonNode *node = nullptr): JsonVariant(node) {}
+};
+
+class JsonBuffer {
+public:
+  // Parse the given text as an object, changing it in place. Check success() on the result.
+  JsonObject &parseObject(char *json, uint8_t nesting_limit = 10) {
+    used = 0;
+    text = json;
+    JsonNode *root = parse_value(nesting_limit);
+    skip_whitespace();
+    parsed = JsonObject(root != nullptr && root->type == JsonNode::OBJECT && *text == '\0' ? root : nullptr);
+    return parsed;
+  }
+
+  // Parse the given text as any value, changing it in place. Check success() on the result.
+  JsonVariant parse(char *json, uint8_t nesting_limit = 10) {
+    used = 0;
+    text = json;
+    JsonNode *root = parse_value(nesting_limit);
+    skip_whitespace();
+    return JsonVariant(root != nullptr && *text == '\0' ? root : nullptr);
+  }
+
+protected:
+  JsonBuffer(JsonNode *nodes, size_t capacity): nodes(nodes), capacity(capacity) {}
+
+private:
+  JsonNode *new_node(JsonNode::Type type) {
+    if (used == capacity) {
+      return nullptr;
+    }
+    JsonNode *node = &nodes[used++];
+    node->type = type;
+    node->key = nullptr;
+    node->first_child = nullptr;
+    node->next = nullptr;
+    return node;
+  }
+
+  void skip_whitespace() {
+    while (*text == ' ' || *text == '\t' || *text == '\r' || *text == '\n') {
+      ++text;
+    }
+  }
+
+  // Unescape the string starting at the opening quote in place, and return it.
+  const char *parse_string() {
+    char *start = ++text;
+    char *out = start;
+    while (*text != '"') {
+      char c = *text++;
+      if (c == '\0') {
+        return nullptr;
+      }
+      if (c == '\\') {
+        c = *text++;
+        switch (c) {
+          case 'b': c = '\b'; break;
+          case 'f': c = '\f'; break;
+          case 'n': c = '\n'; break;
+          case 'r': c = '\r'; break;
+          case 't': c = '\t'; break;
+          case 'u': {
+            char hex[5] = {0};
+            for (size_t i = 0; i < 4 && *text != '\0'; ++i) {
+              hex[i] = *text++;
+            }
+            long code = strtol(hex, nullptr, 16);
+            c = code < 0x80 ? (char) code : '?';
+            break;
+          }
+          case '\0':
+            return nullptr;
+        }
+      }
+      *out++ = c;
+    }
+    ++text;
+    *out = '\0';
+    return start;
+  }
+
+  // Parse the members of an object or the elements of an array, after the opening bracket.
+  bool parse_children(JsonNode *parent, char close, uint8_t nesting_limit) {
+    ++text;
+    skip_whitespace();
+    if (*text == close) {
+      ++text;
+      return true;
+    }
+    JsonNode **next = &parent->first_child;
+    while (true) {
+      skip_whitespace();
+      const char *key = nullptr;
+      if (close == '}') {
+        if (*text != '"' || (key = parse_string()) == nullptr) {
+          return false;
+        }
+        skip_whitespace();
+        if (*text++ != ':') {
+          return false;
+        }
+      }
+      JsonNode *child = parse_value(nesting_limit);
+      if (child == nullptr) {
+        return false;
+      }
+      child->key = key;
+      *next = child;
+      next = &child->next;
+      skip_whitespace();
+      if (*text == close) {
+        ++text;
+        return true;
+      }
+      if (*text++ != ',') {
+        return false;
+      }
+    }
+  }
+
+  bool parse_literal(const char *literal) {
+    size_t length = strlen(literal);
+    if (strncmp(text, literal, length) != 0) {
+      return false;
+    }
+    text += length;
+    return true;
+  }
+
+  JsonNode *parse_value(uint8_t nesting_limit) {
+    skip_whitespace();
+    JsonNode *node;
+    switch (*text) {
+      case '{':
+      case '[':
+        if (nesting_limit == 0 || (node = new_node(*text == '{' ? JsonNode::OBJECT : JsonNode::ARRAY)) == nullptr ||
+            !parse_children(node, *text == '{' ? '}' : ']', nesting_limit - 1)) {
+          return nullptr;
+        }
+        return node;
+      case '"':
+        if ((node = new_node(JsonNode::STRING)) == nullptr || (node->string = parse_string()) == nullptr) {
+          return nullptr;
+        }
+        return node;
+      case 't':
+      case 'f':
+        if ((node = new_node(JsonNode::BOOLEAN)) == nullptr) {
+          return nullptr;
+        }
+        node->boolean = *text == 't';
+        return parse_literal(node->boolean ? "true" : "false") ? node : nullptr;
+      case 'n':
+        return parse_literal("null") ? new_node(JsonNode::NUL) : nullptr;
+      default: {
+        char *end;
+        long integer = strtol(text, &end, 10);
+        if (end == text || (node = new_node(JsonNode::INTEGER)) == nullptr) {
+          return nullptr;
+        }
+        if (*end == '.' || *end == 'e' || *end == 'E') {
+          node->type = JsonNode::FLOAT;
+          node->real = strtod(text, &end);
+        } else {
+          node->integer = integer;
+        }
+        text = end;
+        return node;
+      }
+    }
+  }
+
+  JsonNode *nodes;
+  size_t capacity;
+  size_t used = 0;
+  char *text = nullptr;
+  JsonObject parsed;
+};
+
+template <size_t CAPACITY> class StaticJsonBuffer : public JsonBuffer {
+public:
+  StaticJsonBuffer(): JsonBuffer(storage, CAPACITY / sizeof(JsonNode)) {}
+
+private:
+  JsonNode storage[CAPACITY / sizeof(JsonNode)];
+};
@@ -0,0 +1,118 @@
+/*
+Copyright 2018 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ */
+
+// A web server which tests send requests to by calling request().
+
+#pragma once
+
+#include <Arduino.h>
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+enum HTTPMethod {
+  HTTP_ANY,
+  HTTP_GET,
+  HTTP_HEAD,
+  HTTP_POST,
+  HTTP_PUT,
+  HTTP_PATCH,
+  HTTP_DELETE,
+  HTTP_OPTIONS,
+};
+
+#define CONTENT_LENGTH_UNKNOWN ((size_t) -1)
+
+class ESP8266WebServer {
+public:
+  typedef std::function<void()> THandlerFunction;
+  typedef std::map<std::string, std::string> Arguments;
+
+  // The status and body of the last response.
+  int response_code = 0;
+  std::string response;
+
+  void on(const String &uri, THandlerFunction handler) {
+    on(uri, HTTP_ANY, handler);
+  }
+
+  void on(const String &uri, HTTPMethod method, THandlerFunction handler) {
+    routes.push_back({uri.c_str(), method, handler});
+  }
+
+  // Run the handler for a request, and return the response's status, which is 404 if no handler matched.
+  int request(HTTPMethod method, const char *uri, const Arguments &arguments = Arguments()) {
+    response_code = 404;
+    response.clear();
+    request_method = method;
+    request_arguments.clear();
+    for (const auto &argument : arguments) {
+      request_arguments[argument.first] = argument.second.c_str();
+    }
+    for (const Route &route : routes) {
+      if (route.uri == uri && (route.method == HTTP_ANY || route.method == method)) {
+        route.handler();
+        break;
+      }
+    }
+    return response_code;
+  }
+
+  HTTPMethod method() const {
+    return request_method;
+  }
+
+  bool hasArg(const String &name) const {
+    return request_arguments.count(name.c_str()) != 0;
+  }
+
+  // Like the real server, this returns the server's own copy, which lasts until the next request.
+  const String &arg(const String &name) const {
+    static const String empty;
+    auto argument = request_arguments.find(name.c_str());
+    return argument == request_arguments.end() ? empty : argument->second;
+  }
+
+  void setContentLength(size_t length) {}
+
+  void sendHeader(const String &name, const String &value) {}
+
+  void send(int code, const char *content_type, const String &content) {
+    response_code = code;
+    response = content.c_str();
+  }
+
+  void sendContent(const String &content) {
+    response += content.c_str();
+  }
+
+  void sendContent(const char *content, size_t length) {
+    response.append(content, length);
+  }
+
+private:
+  struct Route {
+    std::string uri;
+    HTTPMethod method;
+    THandlerFunction handler;
+  };
+
+  std::vector<Route> routes;
+  HTTPMethod request_method = HTTP_GET;
+  std::map<std::string, String> request_arguments;
+};
@@ -0,0 +1,129 @@
+/*
+Copyright 2018 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ */
+
+// An in-memory SPIFFS, whose files tests can read and change directly.
+
+#pragma once
+
+#include <Arduino.h>
+
+#include <map>
+#include <string>
+
+enum SeekMode {
+  SeekSet,
+  SeekCur,
+  SeekEnd,
+};
+
+class File : public Stream {
+public:
+  File(): data(nullptr), position(0) {}
+  File(std::string *data, size_t position): data(data), position(position) {}
+
+  explicit operator bool() const {
+    return data != nullptr;
+  }
+
+  size_t write(uint8_t c) override {
+    return write(&c, 1);
+  }
+
+  size_t write(const uint8_t *buffer, size_t size) override {
+    data->replace(position, min(size, data->size() - position), (const char *) buffer, size);
+    position += size;
+    return size;
+  }
+
+  int available() override {
+    return data->size() - position;
+  }
+
+  int read() override {
+    return position < data->size() ? (uint8_t) (*data)[position++] : -1;
+  }
+
+  size_t read(uint8_t *buffer, size_t size) {
+    size = min(size, data->size() - position);
+    memcpy(buffer, data->data() + position, size);
+    position += size;
+    return size;
+  }
+
+  bool seek(uint32_t offset, SeekMode mode = SeekSet) {
+    size_t base = mode == SeekSet ? 0 : mode == SeekCur ? position : data->size();
+    if (base + offset > data->size()) {
+      return false;
+    }
+    position = base + offset;
+    return true;
+  }
+
+  size_t size() const {
+    return data->size();
+  }
+
+  void close() {
+    data = nullptr;
+  }
+
+private:
+  std::string *data;
+  size_t position;
+};
+
+class FS {
+public:
+  // The contents of each file, by path.
+  std::map<std::string, std::string> files;
+
+  bool begin() {
+    return true;
+  }
+
+  File open(const char *path, const char *mode) {
+    auto file = files.find(path);
+    if (mode[0] == 'r') {
+      return file == files.end() ? File() : File(&file->second, 0);
+    }
+    std::string &data = files[path];
+    if (mode[0] == 'w') {
+      data.clear();
+    }
+    return File(&data, data.size());
+  }
+
+  bool exists(const char *path) {
+    return files.count(path) != 0;
+  }
+
+  bool remove(const char *path) {
+    return files.erase(path) != 0;
+  }
+
+  // Like SPIFFS, this fails rather than replace an existing file.
+  bool rename(const char *from, const char *to) {
+    auto file = files.find(from);
+    if (file == files.end() || exists(to)) {
+      return false;
+    }
+    files[to] = file->second;
+    files.erase(file);
+    return true;
+  }
+};
+
+extern FS SPIFFS;
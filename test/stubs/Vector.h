@@ -0,0 +1,76 @@
+/*
+Copyright 2018 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ */
+
+// The Vector library, over a fixed array given to the constructor.
+
+#pragma once
+
+#include <stddef.h>
+
+template <typename T> class Vector {
+public:
+  template <size_t N> Vector(T (&values)[N]): values(values), capacity(N), length(0) {}
+
+  const T &operator[](size_t index) const {
+    return values[index];
+  }
+
+  T &operator[](size_t index) {
+    return values[index];
+  }
+
+  void push_back(const T &value) {
+    if (length < capacity) {
+      values[length++] = value;
+    }
+  }
+
+  void remove(size_t index) {
+    for (size_t i = index + 1; i < length; ++i) {
+      values[i - 1] = values[i];
+    }
+    --length;
+  }
+
+  size_t size() const {
+    return length;
+  }
+
+  size_t max_size() const {
+    return capacity;
+  }
+
+  bool empty() const {
+    return length == 0;
+  }
+
+  bool full() const {
+    return length == capacity;
+  }
+
+  void clear() {
+    length = 0;
+  }
+
+  T *data() {
+    return values;
+  }
+
+private:
+  T *values;
+  size_t capacity;
+  size_t length;
+};
@@ -0,0 +1,43 @@
+/*
+Copyright 2018 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ */
+
+// A websocket client which never connects.
+
+#pragma once
+
+#include <Arduino.h>
+
+enum WStype_t {
+  WStype_ERROR,
+  WStype_DISCONNECTED,
+  WStype_CONNECTED,
+  WStype_TEXT,
+};
+
+class WebSocketsClient {
+public:
+  typedef void (*WebSocketClientEvent)(WStype_t type, uint8_t *payload, size_t length);
+
+  void begin(const char *host, uint16_t port, const char *path) {}
+  void onEvent(WebSocketClientEvent event) {}
+  void setReconnectInterval(unsigned long interval) {}
+  void disconnect() {}
+  void loop() {}
+
+  bool sendTXT(const char *payload) {
+    return false;
+  }
+};
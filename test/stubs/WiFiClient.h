@@ -0,0 +1,110 @@
+/*
+Copyright 2018 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ */
+
+// WiFiClient connections to stand-in servers written by the tests.
+
+#pragma once
+
+#include <Arduino.h>
+
+#include <memory>
+#include <string>
+
+// One connection between a WiFiClient and a stand-in server.
+struct StubSocket {
+  std::string host;
+  uint16_t port = 0;
+  // Bytes written by the client which the server hasn't used yet.
+  std::string written;
+  // Bytes sent by the server which the client hasn't read yet.
+  std::string unread;
+  // Once the server closes its end, the client can still read what was already sent, but nothing more arrives.
+  bool server_closed = false;
+  bool client_closed = false;
+};
+
+// Whatever the test wants to be at the other end of connections.
+class StubNetwork {
+public:
+  virtual ~StubNetwork() {}
+  // Return false to refuse the connection.
+  virtual bool accept(const std::shared_ptr<StubSocket> &socket) = 0;
+  // Called each time the client writes to the socket.
+  virtual void receive(StubSocket &socket) = 0;
+};
+
+// Connections fail while this is null.
+extern StubNetwork *stub_network;
+
+class WiFiClient : public Stream {
+public:
+  int connect(const char *host, uint16_t port) {
+    stop();
+    std::shared_ptr<StubSocket> new_socket = std::make_shared<StubSocket>();
+    new_socket->host = host;
+    new_socket->port = port;
+    if (stub_network == nullptr || !stub_network->accept(new_socket)) {
+      return 0;
+    }
+    socket = new_socket;
+    return 1;
+  }
+
+  uint8_t connected() {
+    return socket && (!socket->server_closed || !socket->unread.empty());
+  }
+
+  void stop() {
+    if (socket) {
+      socket->client_closed = true;
+      socket.reset();
+    }
+  }
+
+  void setNoDelay(bool no_delay) {}
+
+  size_t write(uint8_t c) override {
+    return write(&c, 1);
+  }
+
+  // Like TCP, writing after the server has closed its end can appear to succeed. The data is just lost.
+  size_t write(const uint8_t *buffer, size_t size) override {
+    if (!socket) {
+      return 0;
+    }
+    if (!socket->server_closed) {
+      socket->written.append((const char *) buffer, size);
+      stub_network->receive(*socket);
+    }
+    return size;
+  }
+
+  int available() override {
+    return socket ? socket->unread.size() : 0;
+  }
+
+  int read() override {
+    if (available() == 0) {
+      return -1;
+    }
+    uint8_t c = socket->unread[0];
+    socket->unread.erase(0, 1);
+    return c;
+  }
+
+private:
+  std::shared_ptr<StubSocket> socket;
+};
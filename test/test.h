@@ -0,0 +1,40 @@
+/*
+Copyright 2018 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ */
+
+// A minimal check macro for the host tests. Each test program returns non-zero if any check failed.
+
+#pragma once
+
+#include <stdio.h>
+
+static int check_failures = 0;
+
+#define CHECK(condition) do { \
+    if (!(condition)) { \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+      ++check_failures; \
+    } \
+  } while (0)
+
+// Print the result and return the exit code for main.
+static int finish_tests(const char *name) {
+  if (check_failures != 0) {
+    fprintf(stderr, "%s: %d checks failed\n", name, check_failures);
+    return 1;
+  }
+  printf("%s: passed\n", name);
+  return 0;
+}
@@ -0,0 +1,262 @@
+/*
+Copyright 2018 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ */
+
+// Runs HTTP actions against a stand-in server, to check when connections are reused and when a request is retried.
+
+#include "actions.h"
+#include "command_arena.h"
+#include "config.h"
+#include "rf.h"
+#include "test.h"
+
+#include <WiFiClient.h>
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+static ButtonCommand storage_array[MAX_COMMANDS];
+Vector<ButtonCommand> button_commands(storage_array);
+
+void rebuild_code_index() {}
+
+bool queue_transmit(const char *target) {
+  return false;
+}
+
+bool auth_and_send_request(const char *command) {
+  return false;
+}
+
+void publish_event(const char *type, const char *format, ...) {}
+
+// What the stand-in server does with a request.
+enum Reply {
+  REPLY_OK,
+  REPLY_OK_WITH_BODY,
+  REPLY_OK_THEN_CLOSE,
+  REPLY_OK_WITHOUT_LENGTH,
+  REPLY_ERROR,
+  REPLY_ERROR_THEN_CLOSE,
+  // Close the connection without answering, as a server does when it times out an idle connection just as a request
+  // arrives.
+  REPLY_NOTHING,
+};
+
+// An HTTP/1.1 server which answers requests as it is told to, and counts what it sees.
+class StandInServer : public StubNetwork {
+public:
+  size_t connections = 0;
+  bool refuse_connections = false;
+  // The bodies of all requests received, in order.
+  std::vector<std::string> requests;
+  // How to answer each request, in order. Requests are answered with REPLY_OK once this is empty.
+  std::deque<Reply> replies;
+
+  bool accept(const std::shared_ptr<StubSocket> &socket) override {
+    if (refuse_connections) {
+      return false;
+    }
+    ++connections;
+    sockets.push_back(socket);
+    return true;
+  }
+
+  void receive(StubSocket &socket) override {
+    size_t header_end = socket.written.find("\r\n\r\n");
+    if (header_end == std::string::npos) {
+      return;
+    }
+    std::string header = socket.written.substr(0, header_end + 2);
+    CHECK(header.compare(0, 19, "POST /hook HTTP/1.1") == 0);
+    CHECK(header.find("\r\nHost: " + socket.host + "\r\n") != std::string::npos);
+    size_t length_start = header.find("Content-Length: ");
+    CHECK(length_start != std::string::npos);
+    size_t body_length = atoi(header.c_str() + length_start + 16);
+    size_t body_start = header_end + 4;
+    if (socket.written.size() < body_start + body_length) {
+      return;
+    }
+    requests.push_back(socket.written.substr(body_start, body_length));
+    socket.written.erase(0, body_start + body_length);
+
+    Reply reply = REPLY_OK;
+    if (!replies.empty()) {
+      reply = replies.front();
+      replies.pop_front();
+    }
+    switch (reply) {
+      case REPLY_OK:
+        socket.unread += "HTTP/1.1 204 No Content\r\nContent-Length: 0\r\n\r\n";
+        break;
+      case REPLY_OK_WITH_BODY:
+        socket.unread += "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: 100\r\n\r\n" +
+          std::string(100, 'b');
+        break;
+      case REPLY_OK_THEN_CLOSE:
+        socket.unread += "HTTP/1.1 200 OK\r\nConnection: close\r\nContent-Length: 2\r\n\r\nok";
+        socket.server_closed = true;
+        break;
+      case REPLY_OK_WITHOUT_LENGTH:
+        socket.unread += "HTTP/1.1 200 OK\r\n\r\nok";
+        socket.server_closed = true;
+        break;
+      case REPLY_ERROR:
+        socket.unread += "HTTP/1.1 500 Internal Server Error\r\nContent-Length: 5\r\n\r\nerror";
+        break;
+      case REPLY_ERROR_THEN_CLOSE:
+        socket.unread += "HTTP/1.1 503 Service Unavailable\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+        socket.server_closed = true;
+        break;
+      case REPLY_NOTHING:
+        socket.server_closed = true;
+        break;
+    }
+  }
+
+  // Close every connection which is still open, as a server does after they have been idle for a while.
+  void close_idle_connections() {
+    for (const std::weak_ptr<StubSocket> &socket : sockets) {
+      if (std::shared_ptr<StubSocket> open = socket.lock()) {
+        open->server_closed = true;
+      }
+    }
+  }
+
+  // Connections which the client hasn't closed.
+  size_t open_connections() {
+    size_t count = 0;
+    for (const std::weak_ptr<StubSocket> &socket : sockets) {
+      std::shared_ptr<StubSocket> open = socket.lock();
+      count += open && !open->client_closed;
+    }
+    return count;
+  }
+
+private:
+  std::vector<std::weak_ptr<StubSocket>> sockets;
+};
+
+static StandInServer *server;
+
+// Send an HTTP action with the given body to the stand-in server.
+static bool send(const char *body, const char *target = "http://hook.local:8123/hook") {
+  arena_clear();
+  ButtonCommand button_command;
+  button_command.action = ACTION_HTTP;
+  CHECK(arena_store(body, &button_command.command_offset));
+  CHECK(arena_store(target, &button_command.target_offset));
+  stub_millis += 1000;
+  return run_action(button_command);
+}
+
+// Start each test with a new server, and no connections kept open from the last one.
+static void reset_server() {
+  if (server != nullptr) {
+    server->close_idle_connections();
+    delete server;
+  }
+  server = new StandInServer();
+  stub_network = server;
+}
+
+static void test_connection_is_reused() {
+  reset_server();
+  CHECK(send("one"));
+  CHECK(send("two"));
+  server->replies.push_back(REPLY_OK_WITH_BODY);
+  CHECK(send("three"));
+  CHECK(send("four"));
+  CHECK(server->connections == 1);
+  CHECK(server->requests == std::vector<std::string>({"one", "two", "three", "four"}));
+}
+
+static void test_connection_closed_by_server_is_not_reused() {
+  reset_server();
+  server->replies.push_back(REPLY_OK_THEN_CLOSE);
+  CHECK(send("one"));
+  CHECK(server->open_connections() == 0);
+  server->replies.push_back(REPLY_OK_WITHOUT_LENGTH);
+  CHECK(send("two"));
+  CHECK(server->open_connections() == 0);
+  CHECK(send("three"));
+  server->close_idle_connections();
+  CHECK(send("four"));
+  CHECK(server->connections == 4);
+  CHECK(server->requests.size() == 4);
+}
+
+// A reused connection which the server closed just as the request was sent gets no answer, so is retried once.
+static void test_unanswered_request_on_reused_connection_is_retried() {
+  reset_server();
+  CHECK(send("one"));
+  server->replies.push_back(REPLY_NOTHING);
+  CHECK(send("two"));
+  CHECK(server->connections == 2);
+  CHECK(server->requests == std::vector<std::string>({"one", "two", "two"}));
+
+  // Only once: if the new connection fails too, the action fails.
+  server->replies.push_back(REPLY_NOTHING);
+  server->replies.push_back(REPLY_NOTHING);
+  CHECK(!send("three"));
+  CHECK(server->requests.size() == 5);
+}
+
+// On a new connection there is no reason to think that trying again would help.
+static void test_unanswered_request_on_new_connection_is_not_retried() {
+  reset_server();
+  server->replies.push_back(REPLY_NOTHING);
+  CHECK(!send("one"));
+  CHECK(server->requests.size() == 1);
+  CHECK(server->open_connections() == 0);
+}
+
+// Once the server has answered, even with an error, it has seen the request, so sending it again could run it twice.
+static void test_error_response_is_not_retried() {
+  reset_server();
+  CHECK(send("one"));
+  server->replies.push_back(REPLY_ERROR);
+  CHECK(!send("two"));
+  server->replies.push_back(REPLY_ERROR_THEN_CLOSE);
+  CHECK(!send("three"));
+  CHECK(server->requests == std::vector<std::string>({"one", "two", "three"}));
+  CHECK(server->open_connections() == 0);
+  CHECK(send("four"));
+  CHECK(server->connections == 2);
+}
+
+static void test_connection_failures() {
+  reset_server();
+  server->refuse_connections = true;
+  CHECK(!send("one"));
+  server->refuse_connections = false;
+  CHECK(!send("two", "http://:8123/hook"));
+  CHECK(!send("three", "hook.local:0/hook"));
+  CHECK(server->requests.empty());
+  CHECK(send("four"));
+  CHECK(server->requests.size() == 1);
+}
+
+int main() {
+  test_connection_is_reused();
+  test_connection_closed_by_server_is_not_reused();
+  test_unanswered_request_on_reused_connection_is_retried();
+  test_unanswered_request_on_new_connection_is_not_retried();
+  test_error_response_is_not_retried();
+  test_connection_failures();
+  return finish_tests("test_actions");
+}
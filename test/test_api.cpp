@@ -0,0 +1,118 @@
+/*
+Copyright 2018 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ */
+
+// Sends JSON API requests through the bulk and object parsing in api.cpp, to check that malformed requests are rejected
+// before anything is applied, and that the server's copy of the request body is left as it was.
+
+#include "api.h"
+#include "test.h"
+#include "webserver.h"
+
+#include <ESP8266WebServer.h>
+
+#include <string>
+#include <vector>
+
+ESP8266WebServer server;
+
+uint32_t submit_job(const char *name, const JobStep &step) {
+  return 0;
+}
+
+// The numbers in the elements which were applied.
+static std::vector<int> applied;
+
+static void handle_bulk() {
+  api_bulk([](JsonVariant element) -> const char * {
+    if (!element.is<int>()) {
+      return "Not a number";
+    }
+    applied.push_back(element.as<int>());
+    return nullptr;
+  });
+}
+
+static void handle_object() {
+  StaticJsonBuffer<API_JSON_BUFFER_SIZE> json_buffer;
+  JsonObject *json = api_parse_object(json_buffer);
+  if (json == nullptr) {
+    return;
+  }
+  JsonWriter writer(server);
+  writer.begin();
+  writer.begin_object().field("name", (*json)["name"].as<const char *>()).end_object();
+  writer.end();
+}
+
+static int post(const char *uri, const std::string &body) {
+  applied.clear();
+  int code = server.request(HTTP_POST, uri, {{"plain", body}});
+  CHECK(server.arg("plain") == body.c_str());
+  return code;
+}
+
+static void test_bulk() {
+  CHECK(post("/bulk", " [1, 2 ,3] ") == 200);
+  CHECK(server.response == "{\"results\":[null,null,null],\"succeeded\":3,\"failed\":0}");
+  CHECK((applied == std::vector<int>{1, 2, 3}));
+
+  CHECK(post("/bulk", "[]") == 200);
+  CHECK(server.response == "{\"results\":[],\"succeeded\":0,\"failed\":0}");
+
+  // Elements which aren't numbers fail on their own, even with brackets and commas in strings.
+  CHECK(post("/bulk", "[4, \"a],\", {\"b\": [5, 6]}, 7]") == 200);
+  CHECK(server.response ==
+    "{\"results\":[null,\"Not a number\",\"Not a number\",null],\"succeeded\":2,\"failed\":2}");
+  CHECK((applied == std::vector<int>{4, 7}));
+
+  // So do elements which aren't valid JSON, as long as the array is.
+  CHECK(post("/bulk", "[1 2, 3]") == 200);
+  CHECK(server.response == "{\"results\":[\"Invalid JSON\",null],\"succeeded\":1,\"failed\":1}");
+
+  // An element too long to parse fails on its own.
+  CHECK(post("/bulk", "[8, \"" + std::string(API_MAX_JSON_SIZE, 'x') + "\"]") == 200);
+  CHECK(server.response == "{\"results\":[null,\"Element too long\"],\"succeeded\":1,\"failed\":1}");
+}
+
+static void test_bulk_malformed() {
+  const char *const malformed[] = {
+    "", "{}", "[", "[1", "[1, 2", "[1,]", "[1, ]", "[,]", "[, 1]", "[1,,2]", "[\"a]", "[{\"a\": 1]",
+    "[1]]", "[1] x",
+  };
+  for (const char *body : malformed) {
+    if (post("/bulk", body) != 400 || !applied.empty()) {
+      fprintf(stderr, "Bulk request %s wasn't rejected\n", body);
+      ++check_failures;
+    }
+  }
+  CHECK(server.response == "{\"error\":\"Expected a complete JSON array\"}");
+}
+
+static void test_object() {
+  CHECK(post("/object", "{\"name\": \"a\\\"b\"}") == 200);
+  CHECK(server.response == "{\"name\":\"a\\\"b\"}");
+  CHECK(post("/object", "[1]") == 400);
+  CHECK(post("/object", "{\"name\": \"" + std::string(API_MAX_JSON_SIZE, 'x') + "\"}") == 413);
+}
+
+int main() {
+  server.on("/bulk", HTTP_POST, handle_bulk);
+  server.on("/object", HTTP_POST, handle_object);
+  test_bulk();
+  test_bulk_malformed();
+  test_object();
+  return finish_tests("test_api");
+}
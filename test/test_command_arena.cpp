@@ -0,0 +1,265 @@
+/*
+Copyright 2018 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ */
+
+// Adds, changes and removes commands at random for a long time, to check that the command arena never loses or mixes up
+// text however fragmented it gets, and that compacting it recovers all the space which is no longer used.
+
+#include "command_arena.h"
+#include "command_store.h"
+#include "config.h"
+#include "rf.h"
+#include "test.h"
+
+#include <FS.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+static ButtonCommand storage_array[MAX_COMMANDS];
+Vector<ButtonCommand> button_commands(storage_array);
+
+void rebuild_code_index() {}
+
+#define SOAK_STEPS 200000
+// How often to load the commands back from the log, and check them again.
+#define RELOAD_INTERVAL 5000
+
+struct ExpectedCommand {
+  uint8_t code;
+  ActionType action;
+  std::string command;
+  std::string target;
+};
+
+static std::mt19937 rng(2018);
+static std::vector<ExpectedCommand> expected;
+
+static uint32_t random_below(uint32_t limit) {
+  return std::uniform_int_distribution<uint32_t>(0, limit - 1)(rng);
+}
+
+// Mostly short text, with the occasional command as long as is allowed.
+static std::string random_text() {
+  size_t length = random_below(8) == 0 ? random_below(MAX_COMMAND_LENGTH) : random_below(60);
+  std::string text;
+  for (size_t i = 0; i < length; ++i) {
+    text += (char) ('a' + random_below(26));
+  }
+  return text;
+}
+
+static RfCode make_code(uint8_t n) {
+  uint8_t bytes[RF_CODE_LENGTH] = {n, 0x55, 0xaa};
+  RfCode code;
+  code.copy_from(bytes);
+  return code;
+}
+
+static size_t text_size(uint16_t offset) {
+  return offset == NO_TEXT ? 0 : strlen(arena_text(offset)) + 1;
+}
+
+// Bytes of the arena used by text which is still referenced.
+static size_t live_size() {
+  size_t size = 0;
+  for (size_t i = 0; i < button_commands.size(); ++i) {
+    size += text_size(button_commands[i].command_offset) + text_size(button_commands[i].target_offset);
+  }
+  return size;
+}
+
+static bool matches_expected() {
+  if (button_commands.size() != expected.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < expected.size(); ++i) {
+    const ButtonCommand &button_command = button_commands[i];
+    // Assistant commands have no target, so it isn't kept in the log.
+    bool target_matches = expected[i].action == ACTION_ASSISTANT || button_command.target() == expected[i].target;
+    if (button_command.code.bytes[0] != expected[i].code || button_command.action != expected[i].action ||
+        button_command.command() != expected[i].command || !target_matches) {
+      fprintf(stderr, "Command %zu is \"%s\" \"%s\", expected \"%s\" \"%s\"\n", i, button_command.command(),
+        button_command.target(), expected[i].command.c_str(), expected[i].target.c_str());
+      return false;
+    }
+  }
+  return true;
+}
+
+static ActionType random_action() {
+  return (ActionType) random_below(ACTION_TYPE_COUNT);
+}
+
+static void soak_step(size_t *compactions, size_t *rejections) {
+  size_t before = arena_used();
+  size_t live = live_size();
+  switch (random_below(4)) {
+    case 0: {
+      ExpectedCommand added = {(uint8_t) random_below(256), random_action(), random_text(), ""};
+      size_t needed = added.command.size() + 1;
+      if (added.action != ACTION_ASSISTANT) {
+        added.target = random_text();
+        needed += added.target.size() + 1;
+      }
+      bool fits = expected.size() < MAX_COMMANDS && live + needed <= COMMAND_ARENA_SIZE;
+      bool added_ok = add_command(make_code(added.code), added.command.c_str(), added.action, added.target.c_str());
+      CHECK(added_ok == fits);
+      if (added_ok) {
+        expected.push_back(added);
+      } else {
+        ++*rejections;
+      }
+      break;
+    }
+    case 1: {
+      if (expected.empty()) {
+        return;
+      }
+      size_t i = random_below(expected.size());
+      std::string command = random_text();
+      // The old text is still in use while the new text is stored.
+      bool fits = live + command.size() + 1 <= COMMAND_ARENA_SIZE;
+      bool updated = update_command(i, command.c_str());
+      CHECK(updated == fits);
+      if (updated) {
+        expected[i].command = command;
+      } else {
+        ++*rejections;
+      }
+      break;
+    }
+    case 2: {
+      if (expected.empty()) {
+        return;
+      }
+      size_t i = random_below(expected.size());
+      ActionType action = random_action();
+      std::string target = random_text();
+      bool fits = live + target.size() + 1 <= COMMAND_ARENA_SIZE;
+      bool set = set_command_action(i, action, target.c_str());
+      CHECK(set == fits);
+      if (set) {
+        expected[i].action = action;
+        expected[i].target = target;
+      } else {
+        ++*rejections;
+      }
+      break;
+    }
+    case 3: {
+      if (expected.empty()) {
+        return;
+      }
+      size_t i = random_below(expected.size());
+      CHECK(remove_command(i));
+      expected.erase(expected.begin() + i);
+      break;
+    }
+  }
+  if (arena_used() < before) {
+    ++*compactions;
+  }
+  CHECK(arena_used() <= COMMAND_ARENA_SIZE);
+}
+
+static void test_soak() {
+  SPIFFS.files.clear();
+  load_commands();
+  size_t compactions = 0;
+  size_t rejections = 0;
+  for (size_t step = 1; step <= SOAK_STEPS && check_failures == 0; ++step) {
+    soak_step(&compactions, &rejections);
+    if (!matches_expected()) {
+      fprintf(stderr, "Commands differ after step %zu\n", step);
+      ++check_failures;
+    }
+    if (step % RELOAD_INTERVAL == 0) {
+      CHECK(load_commands());
+      CHECK(matches_expected());
+      compact_arena();
+      CHECK(arena_used() == live_size());
+    }
+  }
+  // Make sure the soak actually filled and compacted the arena many times.
+  CHECK(compactions > SOAK_STEPS / 100);
+  CHECK(rejections > 0);
+  printf("%zu arena compactions, %zu changes rejected for lack of space\n", compactions, rejections);
+}
+
+static void test_compact_recovers_all_space() {
+  SPIFFS.files.clear();
+  load_commands();
+  expected.clear();
+  for (uint8_t i = 0; i < MAX_COMMANDS; ++i) {
+    CHECK(add_command(make_code(i), "command", ACTION_HTTP, "target"));
+    expected.push_back({i, ACTION_HTTP, "command", "target"});
+  }
+  // Fragment the arena by replacing every other command with longer text.
+  for (size_t round = 0; round < 5; ++round) {
+    for (size_t i = round % 2; i < MAX_COMMANDS; i += 2) {
+      std::string command = "command " + std::to_string(round);
+      CHECK(update_command(i, command.c_str()));
+      expected[i].command = command;
+    }
+  }
+  CHECK(arena_used() > live_size());
+  compact_arena();
+  CHECK(arena_used() == live_size());
+  CHECK(matches_expected());
+  // Compacting an already compact arena changes nothing.
+  compact_arena();
+  CHECK(arena_used() == live_size());
+  CHECK(matches_expected());
+}
+
+// Store text which is already in the arena, such as a command's own target when only its action changes, while the
+// arena is full, so that compacting it moves the text being stored.
+static void test_store_arena_text_when_full() {
+  SPIFFS.files.clear();
+  load_commands();
+  expected.clear();
+  for (uint8_t i = 0; i < MAX_COMMANDS; ++i) {
+    std::string command = "command " + std::to_string(i);
+    // Long enough that the live text nearly fills the arena, so that compacting it overwrites where the text was.
+    std::string target = "target " + std::to_string(i) + std::string(COMMAND_ARENA_SIZE / MAX_COMMANDS * 3 / 4, 'x');
+    CHECK(add_command(make_code(i), command.c_str(), ACTION_HTTP, target.c_str()));
+    expected.push_back({i, ACTION_HTTP, command, target});
+  }
+  size_t compactions = 0;
+  for (size_t round = 0; round < 100 && check_failures == 0; ++round) {
+    for (size_t i = 0; i < MAX_COMMANDS; ++i) {
+      size_t before = arena_used();
+      ActionType action = round % 2 == 0 ? ACTION_UDP : ACTION_HTTP;
+      CHECK(set_command_action(i, action, button_commands[i].target()));
+      expected[i].action = action;
+      CHECK(update_command(i, button_commands[i].command()));
+      compactions += arena_used() < before;
+    }
+    CHECK(matches_expected());
+  }
+  CHECK(compactions > 0);
+  // The log has the same text.
+  CHECK(load_commands());
+  CHECK(matches_expected());
+}
+
+int main() {
+  test_soak();
+  test_compact_recovers_all_space();
+  test_store_arena_text_when_full();
+  return finish_tests("test_command_arena");
+}
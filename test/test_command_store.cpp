@@ -0,0 +1,215 @@
+/*
+Copyright 2018 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ */
+
+// Simulates losing power at every byte of writing the command log, and checks that each time every record which was
+// completely written is loaded again.
+
+#include "command_arena.h"
+#include "command_store.h"
+#include "config.h"
+#include "rf.h"
+#include "streamutils.h"
+#include "test.h"
+
+#include <FS.h>
+
+#include <string>
+#include <vector>
+
+static ButtonCommand storage_array[MAX_COMMANDS];
+Vector<ButtonCommand> button_commands(storage_array);
+
+void rebuild_code_index() {}
+
+static const char *log_path = "/commands.log";
+
+static RfCode make_code(uint8_t n) {
+  uint8_t bytes[RF_CODE_LENGTH] = {n, (uint8_t) (n * 3), (uint8_t) (n * 7)};
+  RfCode code;
+  code.timings[0] = 9000 + n;
+  code.timings[1] = 300;
+  code.timings[2] = 900;
+  code.copy_from(bytes);
+  return code;
+}
+
+// The command table as one string per command, for comparing and printing.
+typedef std::vector<std::string> Table;
+
+static Table current_table() {
+  Table table;
+  for (size_t i = 0; i < button_commands.size(); ++i) {
+    const ButtonCommand &button_command = button_commands[i];
+    char hex[RF_CODE_HEX_SIZE];
+    table.push_back(std::string(button_command.code.to_hex(hex)) + " " + std::to_string(button_command.action) + " " +
+      button_command.command() + " " + button_command.target());
+  }
+  return table;
+}
+
+static void print_table(const char *name, const Table &table) {
+  fprintf(stderr, "  %s:\n", name);
+  for (const std::string &line : table) {
+    fprintf(stderr, "    %s\n", line.c_str());
+  }
+}
+
+// The table after each change, along with the length of the log once the change was written.
+struct Snapshot {
+  size_t log_length;
+  Table table;
+};
+
+static std::vector<Snapshot> snapshots;
+
+static void take_snapshot() {
+  snapshots.push_back({SPIFFS.files[log_path].size(), current_table()});
+}
+
+static void test_power_cut_at_every_byte() {
+  SPIFFS.files.clear();
+  load_commands();
+  snapshots.clear();
+  take_snapshot();
+
+  CHECK(add_command(make_code(1), "turn on the kitchen lights", ACTION_ASSISTANT, ""));
+  take_snapshot();
+  CHECK(add_command(make_code(2), "toggle", ACTION_HTTP, "lamp.local:8080/switch"));
+  take_snapshot();
+  CHECK(add_command(make_code(3), "dim", ACTION_UDP, "10.0.0.7:5454"));
+  take_snapshot();
+  CHECK(update_command(0, "turn off the kitchen lights"));
+  take_snapshot();
+  CHECK(set_command_action(2, ACTION_WEBSOCKET, "ws://hub.local/ws"));
+  take_snapshot();
+  CHECK(remove_command(1));
+  take_snapshot();
+  CHECK(add_command(make_code(4), "", ACTION_RF, "000102030405060708"));
+  take_snapshot();
+  CHECK(update_command(2, std::string(MAX_COMMAND_LENGTH - 1, 'x').c_str()));
+  take_snapshot();
+  CHECK(set_command_action(0, ACTION_ASSISTANT, ""));
+  take_snapshot();
+
+  const std::string full_log = SPIFFS.files[log_path];
+  CHECK(full_log.size() == snapshots.back().log_length);
+  size_t next_snapshot = 0;
+  for (size_t length = 0; length <= full_log.size(); ++length) {
+    while (next_snapshot < snapshots.size() && snapshots[next_snapshot].log_length <= length) {
+      ++next_snapshot;
+    }
+    const Table &expected = snapshots[next_snapshot - 1].table;
+
+    SPIFFS.files.clear();
+    SPIFFS.files[log_path] = full_log.substr(0, length);
+    CHECK(load_commands());
+    Table loaded = current_table();
+    if (loaded != expected) {
+      fprintf(stderr, "Log cut at byte %zu of %zu loaded the wrong commands\n", length, full_log.size());
+      print_table("expected", expected);
+      print_table("loaded", loaded);
+      ++check_failures;
+      continue;
+    }
+
+    // A damaged log is compacted when loaded, which must leave only whole records behind.
+    CHECK(!SPIFFS.exists("/commands.new"));
+    CHECK(load_commands());
+    CHECK(current_table() == expected);
+    CHECK(add_command(make_code(5), "after recovery", ACTION_ASSISTANT, ""));
+    CHECK(load_commands());
+    CHECK(current_table().size() == expected.size() + 1);
+  }
+}
+
+// Build a record with a valid CRC in the format written by command_store.cpp.
+static std::string make_record(uint8_t type, const std::string &payload) {
+  std::string record;
+  record += (char) type;
+  record += (char) (payload.size() & 0xff);
+  record += (char) (payload.size() >> 8);
+  record += payload;
+  uint32_t crc = crc32_update(0, record.data(), record.size());
+  for (int i = 0; i < 4; ++i) {
+    record += (char) (crc >> (8 * i));
+  }
+  return record;
+}
+
+static void test_unapplied_record_is_skipped() {
+  SPIFFS.files.clear();
+  load_commands();
+  CHECK(add_command(make_code(1), "first", ACTION_ASSISTANT, ""));
+  // Update the command at index 7, which doesn't exist.
+  SPIFFS.files[log_path] += make_record(2, std::string("\x07\x00", 2) + "nothing");
+  // An add record with an action type which doesn't exist.
+  SPIFFS.files[log_path] += make_record(1, std::string(RF_TIMING_COUNT * 2 + RF_CODE_LENGTH, '\x01') + "bad" +
+    std::string(1, '\0') + "\x7f" + "target");
+  CHECK(add_command(make_code(2), "second", ACTION_ASSISTANT, ""));
+
+  CHECK(load_commands());
+  CHECK(button_commands.size() == 2);
+  CHECK(strcmp(button_commands[0].command(), "first") == 0);
+  CHECK(strcmp(button_commands[1].command(), "second") == 0);
+}
+
+static void test_interrupted_compaction() {
+  SPIFFS.files.clear();
+  load_commands();
+  CHECK(add_command(make_code(1), "old", ACTION_ASSISTANT, ""));
+  const std::string old_log = SPIFFS.files[log_path];
+  CHECK(update_command(0, "new"));
+  CHECK(compact_commands());
+  const std::string new_log = SPIFFS.files[log_path];
+
+  // Power lost before the old log was removed: the new one may be incomplete, so it is thrown away.
+  SPIFFS.files.clear();
+  SPIFFS.files[log_path] = old_log;
+  SPIFFS.files["/commands.new"] = new_log.substr(0, new_log.size() / 2);
+  CHECK(load_commands());
+  CHECK(button_commands.size() == 1 && strcmp(button_commands[0].command(), "old") == 0);
+  CHECK(!SPIFFS.exists("/commands.new"));
+
+  // Power lost after the old log was removed: the new one is complete.
+  SPIFFS.files.clear();
+  SPIFFS.files["/commands.new"] = new_log;
+  CHECK(load_commands());
+  CHECK(button_commands.size() == 1 && strcmp(button_commands[0].command(), "new") == 0);
+  CHECK(SPIFFS.exists(log_path) && !SPIFFS.exists("/commands.new"));
+}
+
+static void test_overlong_command_is_rejected() {
+  SPIFFS.files.clear();
+  load_commands();
+  CHECK(add_command(make_code(1), "short", ACTION_HTTP, "host"));
+  const std::string log = SPIFFS.files[log_path];
+  const std::string overlong(MAX_COMMAND_LENGTH, 'x');
+  CHECK(!add_command(make_code(2), overlong.c_str(), ACTION_ASSISTANT, ""));
+  CHECK(!add_command(make_code(2), "short", ACTION_HTTP, overlong.c_str()));
+  CHECK(!update_command(0, overlong.c_str()));
+  CHECK(!set_command_action(0, ACTION_UDP, overlong.c_str()));
+  CHECK(SPIFFS.files[log_path] == log);
+  CHECK(button_commands.size() == 1);
+  CHECK(strcmp(button_commands[0].command(), "short") == 0 && strcmp(button_commands[0].target(), "host") == 0);
+}
+
+int main() {
+  test_power_cut_at_every_byte();
+  test_unapplied_record_is_skipped();
+  test_interrupted_compaction();
+  test_overlong_command_is_rejected();
+  return finish_tests("test_command_store");
+}
@@ -0,0 +1,392 @@
+/*
+Copyright 2018 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ */
+
+// Runs rf.cpp against a simulated RF module on the other end of the serial port, to check the message framing, the
+// transmit queue and its retries, and learning.
+
+#include "actions.h"
+#include "command_arena.h"
+#include "config.h"
+#include "rf.h"
+#include "rf_capture.h"
+#include "test.h"
+#include "webserver.h"
+
+#include <ESP8266WebServer.h>
+#include <FS.h>
+
+#include <string>
+#include <vector>
+
+ESP8266WebServer server;
+
+bool authenticate_admin() {
+  return true;
+}
+
+void publish_event(const char *type, const char *format, ...) {}
+
+const char *const action_names[ACTION_TYPE_COUNT] = {"assistant", "http", "udp", "websocket", "rf"};
+
+// Commands run, by their text.
+static std::vector<std::string> actions_run;
+
+bool run_action(const ButtonCommand &button_command) {
+  actions_run.push_back(button_command.command());
+  return true;
+}
+
+void record_action_result(ActionType action, bool success, uint32_t latency) {}
+
+void handle_button(const RfCode &code, unsigned long received_time);
+
+// The RF module, as seen through the serial port. It answers each message the way the real one does, unless told not
+// to acknowledge transmissions.
+class SimulatedModule {
+public:
+  // The codes transmitted, in order, and when each transmission started.
+  std::vector<std::string> transmitted;
+  std::vector<unsigned long> transmit_times;
+  size_t acks_received = 0;
+  size_t learn_requests = 0;
+  bool acknowledge_transmissions = true;
+
+  // Send a message to the bridge, one byte at a time over the given number of loops.
+  void send(uint8_t type, const std::vector<uint8_t> &body) {
+    std::string message;
+    message += (char) 0xaa;
+    message += (char) type;
+    message.append(body.begin(), body.end());
+    message += (char) 0x55;
+    Serial.input += message;
+  }
+
+  void send_code(uint8_t type, const RfCode &code) {
+    std::vector<uint8_t> body(RF_TIMING_COUNT * 2 + RF_CODE_LENGTH);
+    code.to_message(body.data());
+    send(type, body);
+  }
+
+  // Handle everything the bridge has written since last time.
+  void receive() {
+    received += Serial.output;
+    Serial.output.clear();
+    while (received.size() >= 3) {
+      CHECK((uint8_t) received[0] == 0xaa);
+      uint8_t type = received[1];
+      size_t size = type == 0xa5 ? 3 + RF_TIMING_COUNT * 2 + RF_CODE_LENGTH : 3;
+      if (received.size() < size) {
+        return;
+      }
+      CHECK((uint8_t) received[size - 1] == 0x55);
+      switch (type) {
+        case 0xa0:
+          ++acks_received;
+          break;
+        case 0xa1:
+          ++learn_requests;
+          send(0xa0, {});
+          break;
+        case 0xa5: {
+          RfCode code = RfCode::from_message((const uint8_t *) &received[2]);
+          char hex[RF_CODE_HEX_SIZE];
+          transmitted.push_back(code.to_hex(hex));
+          transmit_times.push_back(millis());
+          if (acknowledge_transmissions) {
+            send(0xa0, {});
+          }
+          break;
+        }
+        case 0xa7:
+        case 0xb1:
+          break;
+        default:
+          fprintf(stderr, "Unexpected message type %02x\n", type);
+          ++check_failures;
+      }
+      received.erase(0, size);
+    }
+  }
+
+private:
+  std::string received;
+};
+
+static SimulatedModule *module = new SimulatedModule();
+
+// Run the loop for the given number of milliseconds, with the RF module answering as it goes.
+static void run_for(unsigned long duration) {
+  for (unsigned long i = 0; i < duration; ++i) {
+    ++stub_millis;
+    rf_loop();
+    module->receive();
+  }
+}
+
+static RfCode make_code(uint8_t n, uint16_t sync = 9000) {
+  uint8_t bytes[RF_CODE_LENGTH] = {0x12, 0x34, n};
+  RfCode code;
+  code.timings[0] = sync;
+  code.timings[1] = 300;
+  code.timings[2] = 900;
+  code.copy_from(bytes);
+  return code;
+}
+
+static std::string hex(const RfCode &code) {
+  char buffer[RF_CODE_HEX_SIZE];
+  return code.to_hex(buffer);
+}
+
+static void add_command(const RfCode &code, const char *command) {
+  ButtonCommand button_command;
+  button_command.code = code;
+  button_commands.push_back(button_command);
+  CHECK(arena_store(command, &button_commands[button_commands.size() - 1].command_offset));
+  rebuild_code_index();
+}
+
+// Start each test with a new RF module and nothing left in the queue from the last one.
+static void reset() {
+  run_for(RF_TRANSMIT_GAP + RF_ACK_TIMEOUT * (RF_TRANSMIT_RETRIES + 2) * RF_MAX_REPEATS * RF_TRANSMIT_QUEUE_SIZE);
+  RfCode code;
+  while (learn_result(&code) == LEARN_WAITING) {
+    run_for(RF_LEARN_TIMEOUT);
+  }
+  delete module;
+  module = new SimulatedModule();
+  Serial.input.clear();
+  Serial.output.clear();
+  button_commands.clear();
+  arena_clear();
+  rebuild_code_index();
+  actions_run.clear();
+  transmit_stats = TransmitStats();
+}
+
+static void test_received_codes_run_matching_commands() {
+  reset();
+  add_command(make_code(2), "second");
+  add_command(make_code(1), "first");
+  add_command(make_code(2), "second again");
+
+  module->send_code(0xa4, make_code(2));
+  run_for(1);
+  CHECK(module->acks_received == 1);
+  CHECK(actions_run == std::vector<std::string>({"second", "second again"}));
+
+  actions_run.clear();
+  module->send_code(0xa4, make_code(3));
+  module->send_code(0xa4, make_code(1));
+  run_for(1);
+  CHECK(module->acks_received == 3);
+  CHECK(actions_run == std::vector<std::string>({"first"}));
+
+  // The right data with timings too far off doesn't match.
+  actions_run.clear();
+  module->send_code(0xa4, make_code(1, 9000 * (100 + RF_TIMING_TOLERANCE + 5) / 100));
+  run_for(1);
+  CHECK(actions_run.empty());
+  CHECK(button_commands[1].stats.timing_rejects == 1);
+}
+
+// Messages may arrive a byte at a time, and there may be noise between them.
+static void test_messages_split_across_loops() {
+  reset();
+  add_command(make_code(1), "first");
+  module->send_code(0xa4, make_code(1));
+  std::string bytes = "\x01\x55" + Serial.input + "\x55";
+  Serial.input.clear();
+  for (char c : bytes) {
+    Serial.input += c;
+    run_for(1);
+  }
+  CHECK(actions_run == std::vector<std::string>({"first"}));
+
+  // A message which doesn't end where it should is dropped, and the next one still gets through.
+  actions_run.clear();
+  module->send_code(0xa4, make_code(1));
+  Serial.input[Serial.input.size() - 1] = 0x00;
+  module->send_code(0xa4, make_code(1));
+  run_for(1);
+  CHECK(actions_run == std::vector<std::string>({"first"}));
+}
+
+static void test_transmit_queue() {
+  reset();
+  CHECK(queue_transmit(make_code(1), 3));
+  CHECK(queue_transmit(make_code(2), 1));
+  run_for(RF_TRANSMIT_GAP * 5);
+  std::string first = hex(make_code(1));
+  CHECK(module->transmitted == std::vector<std::string>({first, first, first, hex(make_code(2))}));
+  for (size_t i = 1; i < module->transmit_times.size(); ++i) {
+    CHECK(module->transmit_times[i] - module->transmit_times[i - 1] >= RF_TRANSMIT_GAP);
+  }
+  CHECK(transmit_stats.transmits == 4);
+
+  // Codes without timings can't be transmitted.
+  CHECK(!queue_transmit(RfCode(), 1));
+
+  for (size_t i = 0; i < RF_TRANSMIT_QUEUE_SIZE; ++i) {
+    CHECK(queue_transmit(make_code(i), 1));
+  }
+  CHECK(!queue_transmit(make_code(0), 1));
+  CHECK(transmit_stats.dropped == 1);
+}
+
+static void test_unacknowledged_transmission_is_retried() {
+  reset();
+  module->acknowledge_transmissions = false;
+  CHECK(queue_transmit(make_code(1), 2));
+  CHECK(queue_transmit(make_code(2), 1));
+  run_for(RF_TRANSMIT_GAP * (RF_TRANSMIT_RETRIES + 2));
+  // The first code is tried once and retried, then given up on altogether, repeats and all.
+  CHECK(module->transmitted.size() >= RF_TRANSMIT_RETRIES + 2);
+  for (size_t i = 0; i <= RF_TRANSMIT_RETRIES; ++i) {
+    CHECK(module->transmitted[i] == hex(make_code(1)));
+  }
+  CHECK(module->transmitted[RF_TRANSMIT_RETRIES + 1] == hex(make_code(2)));
+  CHECK(transmit_stats.failures == 1);
+  CHECK(transmit_stats.transmits == 0);
+
+  // Once the RF module answers again, the next code goes through.
+  module->acknowledge_transmissions = true;
+  run_for(RF_TRANSMIT_GAP * 2);
+  CHECK(transmit_stats.transmits == 1);
+  CHECK(transmit_stats.failures == 1);
+}
+
+static void test_transmit_target() {
+  reset();
+  std::string code = hex(make_code(1));
+  CHECK(queue_transmit(code.c_str()));
+  CHECK(queue_transmit((code + "*2").c_str()));
+  CHECK(queue_transmit((code + "*" + std::to_string(RF_MAX_REPEATS)).c_str()));
+  CHECK(!queue_transmit((code + "*0").c_str()));
+  CHECK(!queue_transmit((code + "*" + std::to_string(RF_MAX_REPEATS + 1)).c_str()));
+  // Would wrap around to 44 in a byte.
+  CHECK(!queue_transmit((code + "*300").c_str()));
+  CHECK(!queue_transmit((code + "*-1").c_str()));
+  CHECK(!queue_transmit((code + "*").c_str()));
+  CHECK(!queue_transmit((code + "*2x").c_str()));
+  CHECK(!queue_transmit((code + "0").c_str()));
+  run_for(RF_TRANSMIT_GAP * (RF_MAX_REPEATS + 4));
+  CHECK(module->transmitted.size() == 1 + 2 + RF_MAX_REPEATS);
+}
+
+static void test_transmit_page() {
+  reset();
+  std::string code = hex(make_code(1));
+  CHECK(server.request(HTTP_GET, "/transmit", {{"code", code}}) == 404);
+  CHECK(server.request(HTTP_POST, "/transmit", {{"code", "1234"}}) == 400);
+  CHECK(server.request(HTTP_POST, "/transmit", {{"code", code}, {"repeats", "300"}}) == 400);
+  CHECK(server.request(HTTP_POST, "/transmit", {{"code", code}, {"repeats", "two"}}) == 400);
+  CHECK(server.request(HTTP_POST, "/transmit", {{"code", code}, {"repeats", "2"}}) == 200);
+  CHECK(server.request(HTTP_POST, "/transmit", {{"code", code}}) == 200);
+  run_for(RF_TRANSMIT_GAP * 4);
+  CHECK(module->transmitted.size() == 3);
+}
+
+static void test_learning() {
+  reset();
+  // Learning waits for the transmission in progress to be acknowledged, and holds up any after it.
+  CHECK(queue_transmit(make_code(1), 1));
+  CHECK(queue_transmit(make_code(2), 1));
+  run_for(1);
+  CHECK(module->transmitted.size() == 1);
+  CHECK(start_learning());
+  CHECK(!start_learning());
+  run_for(RF_TRANSMIT_GAP * 3);
+  CHECK(module->learn_requests == 1);
+  CHECK(module->transmitted.size() == 1);
+
+  RfCode learned;
+  CHECK(learn_result(&learned) == LEARN_WAITING);
+  module->send_code(0xa3, make_code(9));
+  run_for(1);
+  CHECK(learn_result(&learned) == LEARN_SUCCEEDED);
+  CHECK(hex(learned) == hex(make_code(9)));
+  CHECK(learn_result(&learned) == LEARN_IDLE);
+  run_for(RF_TRANSMIT_GAP);
+  CHECK(module->transmitted.size() == 2);
+
+  // The RF module gives up after a while.
+  CHECK(start_learning());
+  run_for(1);
+  module->send(0xa2, {});
+  run_for(1);
+  CHECK(learn_result(&learned) == LEARN_FAILED);
+
+  // If the RF module never answers, learning times out.
+  CHECK(start_learning());
+  run_for(RF_LEARN_TIMEOUT + 2);
+  CHECK(learn_result(&learned) == LEARN_FAILED);
+}
+
+// Raw frames are matched by their signature, and kept for download.
+static void test_raw_frames() {
+  reset();
+  std::vector<uint8_t> frame = {2, 0x01, 0x2c, 0x03, 0x84, 0x01, 0x10, 0x01, 0x10};
+  std::vector<uint8_t> message = {0xaa, 0xb1};
+  message.insert(message.end(), frame.begin(), frame.end());
+  message.push_back(0x55);
+  add_command(raw_signature(message.data(), message.size()), "raw");
+  size_t frames = capture_stats.frames;
+  // The bucket timings contain 0x55, which mustn't be taken as the end of the frame.
+  module->send(0xb1, frame);
+  run_for(1);
+  CHECK(capture_stats.frames == frames + 1);
+  CHECK(actions_run == std::vector<std::string>({"raw"}));
+}
+
+// The longest frame which can be received is listed in full, and only a POST can change anything.
+static void test_capture_page() {
+  reset();
+  std::vector<uint8_t> frame = {2, 0x01, 0x2c, 0x03, 0x84};
+  frame.resize(RF_MAX_MESSAGE_SIZE - 3, 0x01);
+  module->send(0xb1, frame);
+  run_for(1);
+  CHECK(capture_used() >= RF_MAX_MESSAGE_SIZE + 1);
+
+  CHECK(server.request(HTTP_GET, "/capture") == 200);
+  std::string last_line = server.response.substr(server.response.rfind('\n', server.response.size() - 2) + 1);
+  CHECK(last_line.size() == RF_CODE_HEX_SIZE + RF_MAX_MESSAGE_SIZE * 2 + 1);
+  CHECK(last_line.compare(RF_CODE_HEX_SIZE, 6, "aab102") == 0);
+
+  CHECK(server.request(HTTP_GET, "/capture", {{"clear", "1"}}) == 405);
+  CHECK(server.request(HTTP_GET, "/capture", {{"raw", "1"}}) == 405);
+  CHECK(!raw_mode);
+  CHECK(capture_used() != 0);
+  CHECK(server.request(HTTP_POST, "/capture", {{"raw", "1"}}) == 200);
+  CHECK(raw_mode);
+  CHECK(server.request(HTTP_POST, "/capture", {{"raw", "0"}, {"clear", "1"}}) == 200);
+  CHECK(!raw_mode);
+  CHECK(capture_used() == 0);
+}
+
+int main() {
+  rf_init();
+  test_received_codes_run_matching_commands();
+  test_messages_split_across_loops();
+  test_transmit_queue();
+  test_unacknowledged_transmission_is_retried();
+  test_transmit_target();
+  test_transmit_page();
+  test_learning();
+  test_raw_frames();
+  test_capture_page();
+  return finish_tests("test_rf");
+}
@@ -0,0 +1,131 @@
+#!/usr/bin/env python3
+# Copyright 2018 Google LLC
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     https://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+"""Control a qswitch over the LAN, and measure how long it takes to respond.
+
+See src/switch/lan_control.cpp for the protocol.
+
+Examples:
+  lan_client.py --key secret qswitch.local on 1
+  lan_client.py --key secret qswitch.local brightness 1 30
+  lan_client.py --key secret --count 1000 qswitch.local toggle 0
+"""
+
+import argparse
+import hmac
+import hashlib
+import socket
+import statistics
+import struct
+import sys
+import time
+
+PORT = 5454
+VERSION = 1
+REQUEST = 1
+REPLY = 2
+TAG_SIZE = 16
+OPS = {'off': 0, 'on': 1, 'brightness': 2, 'query': 3, 'scene': 4}
+
+last_counter = 0
+
+
+def next_counter():
+  # Milliseconds since the epoch, but always increasing even if requests are sent faster than that.
+  global last_counter
+  last_counter = max(last_counter + 1, int(time.time() * 1000))
+  return last_counter
+
+
+def build_request(key, operations):
+  body = struct.pack('<2sBBQB', b'QS', VERSION, REQUEST, next_counter(), len(operations))
+  for index, op, value in operations:
+    body += struct.pack('<HBB', index, op, value)
+  return body + hmac.new(key, body, hashlib.sha256).digest()[:TAG_SIZE]
+
+
+def parse_reply(key, request, reply):
+  body, tag = reply[:-TAG_SIZE], reply[-TAG_SIZE:]
+  if not hmac.compare_digest(hmac.new(key, body, hashlib.sha256).digest()[:TAG_SIZE], tag):
+    raise ValueError('reply has wrong authentication code')
+  magic, version, message_type, counter, count = struct.unpack_from('<2sBBQB', body)
+  if magic != b'QS' or message_type != REPLY or counter != struct.unpack_from('<Q', request, 4)[0]:
+    raise ValueError('unexpected reply')
+  return [struct.unpack_from('<HBB', body, 13 + 4 * i) for i in range(count)]
+
+
+def send(sock, address, key, operations):
+  request = build_request(key, operations)
+  start = time.perf_counter()
+  sock.sendto(request, address)
+  while True:
+    reply, _ = sock.recvfrom(512)
+    try:
+      states = parse_reply(key, request, reply)
+      return time.perf_counter() - start, states
+    except ValueError:
+      # Probably a late reply to an earlier request which timed out.
+      continue
+
+
+def main():
+  parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+  parser.add_argument('--key', required=True, help='LAN key set in the web interface')
+  parser.add_argument('--port', type=int, default=PORT)
+  parser.add_argument('--count', type=int, default=1, help='number of requests to send, one at a time')
+  parser.add_argument('--timeout', type=float, default=1.0, help='seconds to wait for each reply')
+  parser.add_argument('host')
+  parser.add_argument('operation', choices=list(OPS) + ['toggle'])
+  parser.add_argument('switches', help='comma separated switch indices')
+  parser.add_argument('value', nargs='?', type=int, default=0, help='brightness in percent, or scene index')
+  args = parser.parse_args()
+
+  key = args.key.encode()
+  address = (socket.gethostbyname(args.host), args.port)
+  indices = [int(i) for i in args.switches.split(',')]
+  sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+  sock.settimeout(args.timeout)
+
+  times = []
+  lost = 0
+  state = True
+  for _ in range(args.count):
+    if args.operation == 'toggle':
+      op = OPS['on'] if state else OPS['off']
+      state = not state
+    else:
+      op = OPS[args.operation]
+    try:
+      elapsed, states = send(sock, address, key, [(i, op, args.value) for i in indices])
+    except socket.timeout:
+      lost += 1
+      continue
+    times.append(elapsed * 1000)
+    if args.count == 1:
+      for index, on, brightness in states:
+        print('switch %d: %s, %d%%' % (index, 'on' if on else 'off', brightness))
+
+  if times:
+    times.sort()
+    print('%d replies, %d lost; round trip ms: min %.2f, median %.2f, p95 %.2f, p99 %.2f, max %.2f' % (
+        len(times), lost, times[0], statistics.median(times), times[int(len(times) * 0.95)],
+        times[int(len(times) * 0.99)], times[-1]))
+  else:
+    print('no replies')
+    sys.exit(1)
+
+
+if __name__ == '__main__':
+  main()
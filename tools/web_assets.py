@@ -0,0 +1,108 @@
+#!/usr/bin/env python3
+# Copyright 2018 Google LLC
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     https://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+"""Compress the static files in web/ into include/web_assets.h, to be served from flash.
+
+Runs before each PlatformIO build, or can be run by hand.
+"""
+
+import gzip
+import hashlib
+import os
+
+CONTENT_TYPES = {
+  '.css': 'text/css',
+  '.html': 'text/html',
+  '.js': 'application/javascript',
+}
+
+HEADER = '''/*
+Copyright 2018 Google LLC
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+ */
+
+// Generated by tools/web_assets.py from the files in web/. Do not edit.
+
+#pragma once
+
+#include <Arduino.h>
+
+struct WebAsset {
+  const char *path;
+  const char *content_type;
+  // Quoted, as it is sent in the ETag header.
+  const char *etag;
+  const uint8_t *data;
+  size_t length;
+};
+'''
+
+
+def identifier(name):
+  return ''.join(c if c.isalnum() else '_' for c in name)
+
+
+def generate(root):
+  web_dir = os.path.join(root, 'web')
+  output = HEADER
+  assets = []
+  for name in sorted(os.listdir(web_dir)):
+    content_type = CONTENT_TYPES.get(os.path.splitext(name)[1])
+    if content_type is None:
+      continue
+    with open(os.path.join(web_dir, name), 'rb') as f:
+      content = f.read()
+    # Fix the timestamp so the output only changes when the file does.
+    data = gzip.compress(content, compresslevel=9, mtime=0)
+    etag = hashlib.sha1(content).hexdigest()[:8]
+    var = identifier(name)
+    output += '\n// %s: %d bytes, %d compressed.\n' % (name, len(content), len(data))
+    output += '#define %s_ETAG "%s"\n' % (var.upper(), etag)
+    output += 'static const uint8_t %s_gz[] PROGMEM = {' % var
+    for i in range(0, len(data), 16):
+      output += '\n  ' + ', '.join('0x%02x' % b for b in data[i:i + 16]) + ','
+    output += '\n};\n'
+    assets.append((name, content_type, var))
+  output += '\nstatic const WebAsset web_assets[] = {\n'
+  for name, content_type, var in assets:
+    output += '  {"/%s", "%s", "\\"" %s_ETAG "\\"", %s_gz, sizeof(%s_gz)},\n' % (
+        name, content_type, var.upper(), var, var)
+  output += '};\n'
+
+  path = os.path.join(root, 'include', 'web_assets.h')
+  if os.path.exists(path):
+    with open(path) as f:
+      if f.read() == output:
+        return
+  with open(path, 'w') as f:
+    f.write(output)
+
+
+try:
+  Import('env')
+  generate(env.subst('$PROJECT_DIR'))
+except NameError:
+  generate(os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
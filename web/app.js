@@ -0,0 +1,23 @@
+// Ask before deleting anything, as there is no undo.
+document.addEventListener('click', function(event) {
+  var target = event.target;
+  if (target.type == 'submit' && target.name.indexOf('delete') == 0 && !confirm(target.value + '?')) {
+    event.preventDefault();
+  }
+});
+
+// Show events from the device as they happen, newest first.
+var events = document.getElementById('events');
+if (events && window.EventSource) {
+  var source = new EventSource('/events');
+  ['switch', 'rf', 'action', 'job', 'log'].forEach(function(type) {
+    source.addEventListener(type, function(event) {
+      var item = document.createElement('li');
+      item.textContent = type + ': ' + event.data;
+      events.insertBefore(item, events.firstChild);
+      while (events.children.length > 20) {
+        events.removeChild(events.lastChild);
+      }
+    });
+  });
+}